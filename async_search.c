@@ -0,0 +1,351 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <liburing.h>
+
+#define ASYNC_BLOCK_BYTES 4096   // Bytes per read without opts.io_block_size
+#define ASYNC_RING_DEPTH 4096    // Largest submission queue of the own ring
+
+// One lookup in flight: the lower bound of target is known to lie in
+// [lo, hi], and every read narrows the range around the block it returns
+typedef struct {
+    uint64_t target;
+    bss_async_cb cb;
+    void *arg;
+    size_t lo;
+    size_t hi;
+    uint64_t hi_key;             // Key at hi, when has_hi_key
+    int has_hi_key;
+    size_t read_first;           // Element at the start of buf
+    int rounds;                  // Reads issued so far
+    uint64_t *buf;
+} async_lookup;
+
+struct bss_async {
+    bss_handle_t *handle;
+    struct io_uring *ring;       // The caller's ring, or own_ring
+    struct io_uring own_ring;
+    int own;                     // The context set up (and tears down) the ring
+    int event_fd;                // Signaled by completions on the own ring, or -1
+    int fd;                      // Descriptor the reads go to (the O_DIRECT one with opts.use_direct)
+    size_t block_elems;          // Elements per read outside the sparse index
+    size_t buf_bytes;            // Bytes of every lookup's buffer
+    async_lookup *lookups;
+    int *free_lookups;           // Stack of free lookup slots
+    unsigned num_free;
+    unsigned capacity;
+    uint64_t finished;           // Lookups finished so far
+    uint64_t *bufs;
+};
+
+// Set up asynchronous lookups on a handle of a sorted file of 8-byte keys,
+// at most max_lookups of them in flight. With ring NULL the context sets up
+// its own ring and an eventfd it signals on completions (see bss_async_fd()
+// and bss_async_poll()); otherwise its reads go on the caller's ring, whose
+// completions the caller hands to bss_async_handle_cqe().
+bss_async_t *bss_async_create(bss_handle_t *handle, struct io_uring *ring, unsigned max_lookups) {
+    const bss_options_t *opts = &handle->opts;
+    if (opts->engine == BSS_ENGINE_EYTZINGER || opts->engine == BSS_ENGINE_COMPRESSED ||
+        opts->key_size != sizeof(uint64_t) || opts->record_size != sizeof(uint64_t)) {
+        fprintf(stderr, "Asynchronous lookups need a sorted file of 8-byte keys\n");
+        return NULL;
+    }
+    if (max_lookups == 0) {
+        fprintf(stderr, "Asynchronous lookups need room for at least one lookup\n");
+        return NULL;
+    }
+
+    bss_async_t *ctx = (bss_async_t *)calloc(1, sizeof(bss_async_t));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+    ctx->handle = handle;
+    ctx->event_fd = -1;
+    ctx->fd = handle->direct_fd >= 0 ? handle->direct_fd : handle->fd;
+    ctx->capacity = max_lookups;
+
+    size_t block_bytes = opts->io_block_size ? opts->io_block_size : ASYNC_BLOCK_BYTES;
+    if (handle->direct_fd >= 0 && block_bytes < BSS_DIRECT_ALIGNMENT) {
+        block_bytes = BSS_DIRECT_ALIGNMENT;
+    }
+    ctx->block_elems = block_bytes / sizeof(uint64_t);
+    ctx->buf_bytes = block_bytes;
+    if (handle->index.keys && handle->index.stride * sizeof(uint64_t) > ctx->buf_bytes) {
+        ctx->buf_bytes = handle->index.stride * sizeof(uint64_t);
+    }
+    // O_DIRECT reads whole, aligned pages into aligned buffers
+    ctx->buf_bytes = (ctx->buf_bytes + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+
+    ctx->lookups = (async_lookup *)calloc(max_lookups, sizeof(async_lookup));
+    ctx->free_lookups = (int *)malloc(max_lookups * sizeof(int));
+    ctx->bufs = (uint64_t *)aligned_alloc(BSS_DIRECT_ALIGNMENT, max_lookups * ctx->buf_bytes);
+    if (!ctx->lookups || !ctx->free_lookups || !ctx->bufs) {
+        perror("malloc");
+        bss_async_destroy(ctx);
+        return NULL;
+    }
+    for (unsigned i = 0; i < max_lookups; i++) {
+        ctx->lookups[i].buf = ctx->bufs + i * (ctx->buf_bytes / sizeof(uint64_t));
+        ctx->free_lookups[i] = max_lookups - 1 - i;
+    }
+    ctx->num_free = max_lookups;
+
+    if (ring) {
+        ctx->ring = ring;
+        return ctx;
+    }
+
+    // The submission queue need not take every lookup at once (queue_read()
+    // submits when it is full), but the completion queue holds one read per
+    // lookup in flight; the kernel clamps both to its limits
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = max_lookups;
+    int ret = io_uring_queue_init_params(max_lookups < ASYNC_RING_DEPTH ? max_lookups : ASYNC_RING_DEPTH,
+                                         &ctx->own_ring, &params);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_queue_init: %s\n", strerror(-ret));
+        bss_async_destroy(ctx);
+        return NULL;
+    }
+    ctx->ring = &ctx->own_ring;
+    ctx->own = 1;
+
+    ctx->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctx->event_fd < 0) {
+        perror("eventfd");
+        bss_async_destroy(ctx);
+        return NULL;
+    }
+    ret = io_uring_register_eventfd(ctx->ring, ctx->event_fd);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_register_eventfd: %s\n", strerror(-ret));
+        bss_async_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// Queue the read of count elements from first into the lookup's buffer.
+// The SQE is only prepared; it goes out with the ring's next submit, or
+// right away when the submission queue is full. Returns 0 on success, -1 on
+// error.
+static int queue_read(bss_async_t *ctx, async_lookup *lk, size_t first, size_t count) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ctx->ring);
+    if (!sqe) {
+        io_uring_submit(ctx->ring);
+        sqe = io_uring_get_sqe(ctx->ring);
+        if (!sqe) {
+            fprintf(stderr, "Could not get SQE\n");
+            return -1;
+        }
+    }
+
+    size_t len = count * sizeof(uint64_t);
+    if (ctx->handle->direct_fd >= 0) {
+        len = (len + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+    }
+    lk->read_first = first;
+    lk->rounds++;
+    io_uring_prep_read(sqe, ctx->fd, lk->buf, len, first * sizeof(uint64_t));
+    io_uring_sqe_set_data(sqe, lk);
+    return 0;
+}
+
+// Read the aligned block holding the middle of the lookup's range
+static int queue_next_block(bss_async_t *ctx, async_lookup *lk) {
+    size_t mid = lk->lo + (lk->hi - lk->lo) / 2;
+    return queue_read(ctx, lk, mid / ctx->block_elems * ctx->block_elems, ctx->block_elems);
+}
+
+// Release the lookup's slot, then report its outcome (the callback may
+// submit new lookups into the slot)
+static void finish_lookup(bss_async_t *ctx, async_lookup *lk, int found, int64_t index) {
+    bss_async_cb cb = lk->cb;
+    void *arg = lk->arg;
+    uint64_t target = lk->target;
+    bss_handle_t *handle = ctx->handle;
+
+    if (handle->opts.collect_counters) {
+        handle->counters.lookups++;
+        handle->counters.probed_lookups++;
+        handle->counters.probes += lk->rounds;
+    }
+    ctx->free_lookups[ctx->num_free++] = (int)(lk - ctx->lookups);
+    ctx->finished++;
+    cb(arg, target, found, found > 0 ? index : -1);
+}
+
+// Start looking up target; cb(arg, target, found, index) runs once it is
+// known, with found 1 (index is the first copy's element index), 0 or -1
+// on error. Returns 0 on success, -1 with errno EAGAIN when max_lookups are
+// already in flight, -1 on other errors.
+int bss_async_submit(bss_async_t *ctx, uint64_t target, bss_async_cb cb, void *arg) {
+    if (ctx->num_free == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    async_lookup *lk = &ctx->lookups[ctx->free_lookups[--ctx->num_free]];
+    lk->target = target;
+    lk->cb = cb;
+    lk->arg = arg;
+    lk->rounds = 0;
+    lk->has_hi_key = 0;
+
+    bss_handle_t *handle = ctx->handle;
+    int ret;
+    if (handle->index.keys) {
+        // One read of the index block the lower bound starts in; the first
+        // key of the next block covers a run of target starting right after it
+        const bss_sparse_index *index = &handle->index;
+        size_t lo, hi;
+        if (sparse_index_lower_block(index, handle->num_elements, target, &lo, &hi) < 0) {
+            lo = 0;    // The bound is element 0
+            hi = (index->stride < handle->num_elements ? index->stride : handle->num_elements) - 1;
+        }
+        lk->lo = lo;
+        lk->hi = hi + 1;
+        if (lk->hi < handle->num_elements) {
+            lk->hi_key = index->keys[lk->hi / index->stride];
+            lk->has_hi_key = 1;
+        }
+        ret = queue_read(ctx, lk, lo, hi - lo + 1);
+    } else {
+        lk->lo = 0;
+        lk->hi = handle->num_elements;
+        ret = queue_next_block(ctx, lk);
+    }
+    if (ret < 0) {
+        ctx->free_lookups[ctx->num_free++] = (int)(lk - ctx->lookups);
+        return -1;
+    }
+    return 0;
+}
+
+// Advance the lookup whose read completed with res bytes: finish it within
+// the block, or narrow its range to one side of the block and read again
+static void advance_lookup(bss_async_t *ctx, async_lookup *lk, int res) {
+    if (res < 0) {
+        fprintf(stderr, "Asynchronous read failed: %s\n", strerror(-res));
+        finish_lookup(ctx, lk, -1, -1);
+        return;
+    }
+
+    size_t end = lk->read_first + (size_t)res / sizeof(uint64_t);
+    size_t w0 = lk->read_first > lk->lo ? lk->read_first : lk->lo;
+    size_t w1 = end < lk->hi ? end : lk->hi;
+    if (w0 >= w1) {
+        fprintf(stderr, "Short asynchronous read at element %zu\n", lk->read_first);
+        finish_lookup(ctx, lk, -1, -1);
+        return;
+    }
+
+    const uint64_t *window = lk->buf + (w0 - lk->read_first);
+    size_t n = w1 - w0;
+    if (window[n - 1] < lk->target) {
+        lk->lo = w1;
+    } else if (window[0] >= lk->target) {
+        lk->hi = w0;
+        lk->hi_key = window[0];
+        lk->has_hi_key = 1;
+    } else {
+        size_t pos = ctx->handle->lower_bound(window, n, lk->target);
+        finish_lookup(ctx, lk, window[pos] == lk->target, (int64_t)(w0 + pos));
+        return;
+    }
+
+    if (lk->lo >= lk->hi) {
+        // The lower bound is hi, whose key came with the read that set it
+        finish_lookup(ctx, lk, lk->has_hi_key && lk->hi_key == lk->target, (int64_t)lk->hi);
+        return;
+    }
+    if (queue_next_block(ctx, lk) < 0) {
+        finish_lookup(ctx, lk, -1, -1);
+    }
+}
+
+// Hand a completion of the ring to the context. Returns 1 when it was one of
+// the context's reads (the caller then marks it seen), 0 when it belongs to
+// someone else. Follow-up reads are prepared on the ring for its next submit.
+int bss_async_handle_cqe(bss_async_t *ctx, const struct io_uring_cqe *cqe) {
+    uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+    uintptr_t first = (uintptr_t)ctx->lookups;
+    if (data < first || data >= first + ctx->capacity * sizeof(async_lookup)) {
+        return 0;
+    }
+    advance_lookup(ctx, (async_lookup *)data, cqe->res);
+    return 1;
+}
+
+// Submit the prepared reads of the context's own ring and handle the
+// completions that are in. With wait, block until at least one lookup
+// finishes (unless none is in flight). Returns the number of lookups
+// finished, -1 on error.
+int bss_async_poll(bss_async_t *ctx, int wait) {
+    if (!ctx->own) {
+        fprintf(stderr, "bss_async_poll() needs a context with its own ring\n");
+        return -1;
+    }
+
+    uint64_t events;
+    if (read(ctx->event_fd, &events, sizeof(events)) < 0 && errno != EAGAIN) {
+        perror("read");
+        return -1;
+    }
+
+    uint64_t before = ctx->finished;
+    do {
+        int ret = io_uring_submit_and_wait(ctx->ring, wait && bss_async_in_flight(ctx) ? 1 : 0);
+        if (ret < 0 && ret != -EINTR) {
+            fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+            return -1;
+        }
+
+        struct io_uring_cqe *cqe;
+        while (io_uring_peek_cqe(ctx->ring, &cqe) == 0) {
+            bss_async_handle_cqe(ctx, cqe);
+            io_uring_cqe_seen(ctx->ring, cqe);
+        }
+    } while (wait && ctx->finished == before && bss_async_in_flight(ctx));
+    return (int)(ctx->finished - before);
+}
+
+// Eventfd signaled when the context's own ring has completions (for epoll
+// loops), or -1 on the caller's ring
+int bss_async_fd(const bss_async_t *ctx) {
+    return ctx->event_fd;
+}
+
+size_t bss_async_in_flight(const bss_async_t *ctx) {
+    return ctx->capacity - ctx->num_free;
+}
+
+// Tear down the context. Lookups still in flight on the own ring are waited
+// for first (their callbacks run); on the caller's ring none may be left.
+void bss_async_destroy(bss_async_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+    if (ctx->own) {
+        while (bss_async_in_flight(ctx) && bss_async_poll(ctx, 1) >= 0) {
+        }
+        io_uring_queue_exit(&ctx->own_ring);
+    } else if (ctx->ring && bss_async_in_flight(ctx)) {
+        fprintf(stderr, "Warning: destroying an asynchronous context with %zu lookups in flight\n",
+                bss_async_in_flight(ctx));
+    }
+    if (ctx->event_fd >= 0) {
+        close(ctx->event_fd);
+    }
+    free(ctx->bufs);
+    free(ctx->free_lookups);
+    free(ctx->lookups);
+    free(ctx);
+}
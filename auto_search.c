@@ -0,0 +1,236 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define AUTO_REGIONS 256         // Key ranges whose page cache residency is tracked separately
+#define AUTO_WINDOW_PAGES 256    // Pages mincore() looks at per residency probe
+#define AUTO_REFRESH 64          // Lookups into a region before its residency is probed again
+#define AUTO_CLASSES 4           // Residency classes: under 1/4 of the pages resident, ..., at least 3/4
+#define AUTO_EXPLORE 1024        // Lookups of a class between tries of an engine as fast as the best one
+#define AUTO_EXPLORE_MAX (AUTO_EXPLORE * 256)  // Longest gap between tries of a slower engine
+#define AUTO_SAMPLE 8            // Every this many lookups on the best engine of a class are timed
+#define AUTO_EWMA_WEIGHT 8       // A new latency moves the average by 1/AUTO_EWMA_WEIGHT of the difference
+#define AUTO_OUTLIER 4           // Latencies count as at most this many times the average
+
+typedef unsigned __int128 key128_t;
+
+// One key range: its residency as of the last probe
+typedef struct {
+    size_t first;                // First element of the region
+    size_t count;                // Elements in the region
+    uint32_t lookups;            // Lookups since the last probe
+    int klass;                   // Residency class of the last probe
+} auto_region;
+
+// Latency feedback of one residency class
+typedef struct {
+    uint64_t lookups;            // Lookups routed in this class
+    double latency[AUTO_ROUTES]; // Moving average of ns per lookup, 0 until an engine is tried
+    uint64_t next_try[AUTO_ROUTES];  // Lookup count at which an engine that is not the best is tried again
+} auto_class;
+
+struct bss_auto_ctx {
+    const uint8_t *map;          // Mapping of the file (the mmap route's)
+    size_t record_size;
+    size_t key_size;
+    size_t page_size;
+    int available[AUTO_ROUTES];  // Routes the handle could open
+    size_t num_regions;
+    key128_t *bounds;            // First key of every region, then the last key of the file
+    auto_region *regions;
+    unsigned char *residency;    // mincore() vector of one window
+    auto_class classes[AUTO_CLASSES];
+    uint64_t routed[AUTO_ROUTES];
+};
+
+// Key of size bytes (native endian), widened
+static key128_t widen_key(const void *key, size_t size) {
+    key128_t wide = 0;
+    memcpy(&wide, key, size);    // Little-endian: the low bytes come first
+    return wide;
+}
+
+// Sample the first key of every region through the mapping. Touches one page
+// per region, which leaves the residency of a large file about as it was.
+bss_auto_ctx *auto_ctx_create(const void *map, size_t num_elements, size_t record_size, size_t key_size,
+                              const int *available) {
+    bss_auto_ctx *ctx = (bss_auto_ctx *)calloc(1, sizeof(bss_auto_ctx));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+    ctx->map = (const uint8_t *)map;
+    ctx->record_size = record_size;
+    ctx->key_size = key_size;
+    ctx->page_size = sysconf(_SC_PAGESIZE);
+    memcpy(ctx->available, available, sizeof(ctx->available));
+    ctx->num_regions = num_elements < AUTO_REGIONS ? num_elements : AUTO_REGIONS;
+
+    ctx->bounds = (key128_t *)malloc((ctx->num_regions + 1) * sizeof(key128_t));
+    ctx->regions = (auto_region *)calloc(ctx->num_regions, sizeof(auto_region));
+    ctx->residency = (unsigned char *)malloc(AUTO_WINDOW_PAGES);
+    if (!ctx->bounds || !ctx->regions || !ctx->residency) {
+        perror("malloc");
+        auto_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    for (size_t r = 0; r < ctx->num_regions; r++) {
+        auto_region *region = &ctx->regions[r];
+        region->first = r * num_elements / ctx->num_regions;
+        region->count = (r + 1) * num_elements / ctx->num_regions - region->first;
+        region->lookups = AUTO_REFRESH;    // Probe on first use
+        ctx->bounds[r] = widen_key(ctx->map + region->first * record_size, key_size);
+    }
+    ctx->bounds[ctx->num_regions] = widen_key(ctx->map + (num_elements - 1) * record_size, key_size);
+    return ctx;
+}
+
+void auto_ctx_destroy(bss_auto_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+    free(ctx->residency);
+    free(ctx->regions);
+    free(ctx->bounds);
+    free(ctx);
+}
+
+// Region whose key range holds key (the first or last one outside the file's
+// range). Branchless: the keys of consecutive lookups are unrelated, so the
+// branches of a plain binary search would mispredict half the time.
+static size_t region_of(const bss_auto_ctx *ctx, key128_t key) {
+    const key128_t *base = ctx->bounds;
+    size_t len = ctx->num_regions;
+    while (len > 1) {
+        size_t half = len / 2;
+        base = base[half] <= key ? base + half : base;
+        len -= half;
+    }
+    return base - ctx->bounds;
+}
+
+// Share of a window of the region that is in the page cache, as a class.
+// Large regions are sampled around the position interpolated for key, where
+// the last levels of the search will land. A failed mincore() keeps the class
+// of the previous probe.
+static void probe_residency(bss_auto_ctx *ctx, size_t r, key128_t key) {
+    auto_region *region = &ctx->regions[r];
+    size_t start = region->first * ctx->record_size;
+    size_t end = (region->first + region->count) * ctx->record_size;
+    size_t first_page = start / ctx->page_size;
+    size_t pages = (end - 1) / ctx->page_size - first_page + 1;
+
+    if (pages > AUTO_WINDOW_PAGES) {
+        key128_t lo = ctx->bounds[r], hi = ctx->bounds[r + 1];
+        double frac = hi > lo && key > lo ? (double)(key - lo) / (double)(hi - lo) : 0;
+        size_t center = first_page + (size_t)((frac < 1 ? frac : 1) * (pages - 1));
+        size_t offset = center > first_page + AUTO_WINDOW_PAGES / 2 ? center - AUTO_WINDOW_PAGES / 2 - first_page : 0;
+        first_page += offset < pages - AUTO_WINDOW_PAGES ? offset : pages - AUTO_WINDOW_PAGES;
+        pages = AUTO_WINDOW_PAGES;
+    }
+
+    region->lookups = 0;
+    if (mincore((void *)(ctx->map + first_page * ctx->page_size), pages * ctx->page_size, ctx->residency) != 0) {
+        return;
+    }
+    size_t resident = 0;
+    for (size_t p = 0; p < pages; p++) {
+        resident += ctx->residency[p] & 1;
+    }
+    int klass = resident * AUTO_CLASSES / pages;
+    region->klass = klass < AUTO_CLASSES ? klass : AUTO_CLASSES - 1;
+}
+
+// Route of a lookup in a class. Engines not tried in the class yet go first,
+// cached ranges starting with mmap and cold ones with io_uring; after that the
+// fastest on average wins. The others are tried again now and then so their
+// averages follow the cache as it warms up or is evicted: an engine k times
+// slower than the best every k * AUTO_EXPLORE lookups, which keeps the cost
+// of exploring at about 1/AUTO_EXPLORE of the lookup time per engine.
+// *is_best says whether the route is the class's current best.
+static int choose_route(const bss_auto_ctx *ctx, auto_class *cls, int klass, int *is_best) {
+    static const int warm_order[AUTO_ROUTES] = {AUTO_ROUTE_MMAP, AUTO_ROUTE_PARALLEL, AUTO_ROUTE_IOURING};
+    static const int cold_order[AUTO_ROUTES] = {AUTO_ROUTE_IOURING, AUTO_ROUTE_PARALLEL, AUTO_ROUTE_MMAP};
+    const int *order = klass == AUTO_CLASSES - 1 ? warm_order : cold_order;
+    uint64_t n = ++cls->lookups;
+    int best = -1;
+
+    *is_best = 0;
+    for (int i = 0; i < AUTO_ROUTES; i++) {
+        int route = order[i];
+        if (!ctx->available[route]) {
+            continue;
+        }
+        if (cls->latency[route] == 0) {
+            return route;
+        }
+        if (best < 0 || cls->latency[route] < cls->latency[best]) {
+            best = route;
+        }
+    }
+
+    for (int route = 0; route < AUTO_ROUTES; route++) {
+        if (!ctx->available[route] || route == best || n < cls->next_try[route]) {
+            continue;
+        }
+        double ratio = cls->latency[route] / cls->latency[best];
+        double gap = AUTO_EXPLORE * (ratio > 1 ? ratio : 1);
+        cls->next_try[route] = n + (gap < AUTO_EXPLORE_MAX ? (uint64_t)gap : AUTO_EXPLORE_MAX);
+        if (n >= AUTO_EXPLORE) {
+            return route;
+        }
+    }
+    *is_best = 1;
+    return best;
+}
+
+// Pick the route for a lookup of key (size bytes) and start its ticket.
+// Tries of other engines are always timed, lookups on the best one every
+// AUTO_SAMPLE-th time, which is enough to notice it slowing down.
+int auto_begin(bss_auto_ctx *ctx, const void *key, size_t size, bss_auto_ticket *ticket) {
+    key128_t wide = widen_key(key, size);
+    size_t r = region_of(ctx, wide);
+
+    if (++ctx->regions[r].lookups > AUTO_REFRESH) {
+        probe_residency(ctx, r, wide);
+    }
+    ticket->klass = ctx->regions[r].klass;
+
+    auto_class *cls = &ctx->classes[ticket->klass];
+    int is_best;
+    ticket->route = choose_route(ctx, cls, ticket->klass, &is_best);
+    ticket->start = !is_best || cls->lookups % AUTO_SAMPLE == 0 ? get_nanoseconds() : 0;
+    return ticket->route;
+}
+
+// Finish the ticket of num_lookups lookups, feeding back their latency if
+// they were timed. A single stall (a preemption, a major fault) is capped so
+// it cannot push the route behind a slower one for thousands of lookups; a
+// lasting slowdown still raises the average by a good share per sample.
+void auto_end(bss_auto_ctx *ctx, const bss_auto_ticket *ticket, uint64_t num_lookups) {
+    ctx->routed[ticket->route] += num_lookups;
+    if (!ticket->start) {
+        return;
+    }
+
+    double *latency = &ctx->classes[ticket->klass].latency[ticket->route];
+    double sample = (double)(get_nanoseconds() - ticket->start) / (num_lookups ? num_lookups : 1);
+    sample = sample > 1 ? sample : 1;   // 0 means untried
+    if (*latency == 0) {
+        *latency = sample;
+    } else {
+        sample = sample < AUTO_OUTLIER * *latency ? sample : AUTO_OUTLIER * *latency;
+        *latency += (sample - *latency) / AUTO_EWMA_WEIGHT;
+    }
+}
+
+void auto_add_counters(const bss_auto_ctx *ctx, bss_counters_t *counters) {
+    counters->routed_mmap += ctx->routed[AUTO_ROUTE_MMAP];
+    counters->routed_parallel += ctx->routed[AUTO_ROUTE_PARALLEL];
+    counters->routed_iouring += ctx->routed[AUTO_ROUTE_IOURING];
+}
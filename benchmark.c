@@ -0,0 +1,320 @@
+#include "bssearch_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DEFAULT_BENCH_KEYS 1000000      // Keys in the default key set
+#define DEFAULT_BENCH_LOOKUPS 1000000   // Timed lookups in the default run
+#define DEFAULT_ZIPF_THETA 0.99         // The usual YCSB skew
+#define MISS_ATTEMPTS 64                // Positions tried before giving up on finding a gap for a miss
+
+// Fill in the default benchmark configuration: a million uniform hits, warm
+void bss_default_bench_config(bss_bench_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->num_keys = DEFAULT_BENCH_KEYS;
+    cfg->num_lookups = DEFAULT_BENCH_LOOKUPS;
+    cfg->distribution = BSS_WORKLOAD_UNIFORM;
+    cfg->zipf_theta = DEFAULT_ZIPF_THETA;
+    cfg->hit_ratio = 1.0;
+    cfg->batch_size = 1;
+    cfg->seed = 0x9E3779B97F4A7C15ULL;
+}
+
+// splitmix64: full period, and any seed (including 0) is fine
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform double in [0, 1)
+static double next_unit(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Zipfian ranks in [0, n) by the method of Gray et al. ("Quickly generating
+// billion-record synthetic databases"), as used by YCSB: rank 0 is the most
+// popular. Setup is O(n) for the zeta constant; each draw is O(1).
+typedef struct {
+    size_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} zipf_gen;
+
+static void zipf_init(zipf_gen *z, size_t n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zetan = 0;
+    for (size_t i = 1; i <= n; i++) {
+        z->zetan += pow((double)i, -theta);
+    }
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static size_t zipf_next(const zipf_gen *z, uint64_t *state) {
+    double u = next_unit(state);
+    double uz = u * z->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta)) {
+        return 1;
+    }
+    size_t rank = (size_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return rank < z->n ? rank : z->n - 1;
+}
+
+// Key of record i of a mapped file of sorted keys
+static uint64_t load_key(const uint8_t *map, size_t i, size_t key_size, size_t record_size) {
+    if (key_size == sizeof(uint32_t)) {
+        uint32_t key;
+        memcpy(&key, map + i * record_size, sizeof(key));
+        return key;
+    }
+    uint64_t key;
+    memcpy(&key, map + i * record_size, sizeof(key));
+    return key;
+}
+
+// A key that is not in the file: one past a key whose successor is further
+// away. Returns 0 if the sampled positions have no such gap.
+static int draw_miss(const uint8_t *map, size_t n, size_t key_size, size_t record_size, uint64_t *state,
+                     uint64_t *key) {
+    uint64_t max_key = key_size == sizeof(uint32_t) ? UINT32_MAX : UINT64_MAX;
+    for (int attempt = 0; attempt < MISS_ATTEMPTS; attempt++) {
+        size_t i = next_random(state) % n;
+        uint64_t k = load_key(map, i, key_size, record_size);
+        if (k == max_key) {
+            continue;
+        }
+        if (i + 1 == n || load_key(map, i + 1, key_size, record_size) > k + 1) {
+            *key = k + 1;
+            return 1;
+        }
+    }
+
+    // Densely packed keys: fall back to the ends of the file
+    uint64_t first = load_key(map, 0, key_size, record_size);
+    uint64_t last = load_key(map, n - 1, key_size, record_size);
+    if (first > 0) {
+        *key = first - 1;
+        return 1;
+    }
+    if (last < max_key) {
+        *key = last + 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Draw the key set from a sorted file (hits at uniformly random positions,
+// misses next to them) and expand it into the lookup sequence. The key set
+// is in random order, so the hot ranks of a Zipfian workload are spread over
+// the whole file. Returns 0 on success, -1 on error.
+int bss_workload_create(const char *sorted_path, size_t key_size, size_t record_size, const bss_bench_config_t *cfg,
+                        bss_workload_t *workload) {
+    struct stat st;
+    int ret = -1;
+
+    memset(workload, 0, sizeof(*workload));
+    key_size = key_size ? key_size : sizeof(uint64_t);
+    record_size = record_size ? record_size : key_size;
+    if (key_size != sizeof(uint32_t) && key_size != sizeof(uint64_t)) {
+        fprintf(stderr, "Benchmark workloads need 4 or 8 byte keys\n");
+        return -1;
+    }
+    if (record_size < key_size || cfg->num_keys == 0 || cfg->num_lookups == 0 ||
+        cfg->hit_ratio < 0 || cfg->hit_ratio > 1) {
+        fprintf(stderr, "Invalid benchmark configuration\n");
+        return -1;
+    }
+    if (cfg->distribution == BSS_WORKLOAD_ZIPF && (cfg->zipf_theta <= 0 || cfg->zipf_theta >= 1)) {
+        fprintf(stderr, "Zipfian skew must be between 0 and 1 (exclusive)\n");
+        return -1;
+    }
+
+    int fd = open(sorted_path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0 || st.st_size % record_size != 0) {
+        fprintf(stderr, "Benchmark key file is empty or not a multiple of the %zu byte record size\n", record_size);
+        close(fd);
+        return -1;
+    }
+    size_t n = st.st_size / record_size;
+
+    const uint8_t *map = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    uint64_t *keys = (uint64_t *)malloc(cfg->num_keys * sizeof(uint64_t));
+    unsigned char *hit = (unsigned char *)malloc(cfg->num_keys);
+    workload->lookups = (uint64_t *)malloc(cfg->num_lookups * sizeof(uint64_t));
+    if (!keys || !hit || !workload->lookups) {
+        perror("malloc");
+        goto out;
+    }
+
+    uint64_t state = cfg->seed;
+    for (size_t k = 0; k < cfg->num_keys; k++) {
+        hit[k] = next_unit(&state) < cfg->hit_ratio;
+        if (hit[k]) {
+            keys[k] = load_key(map, next_random(&state) % n, key_size, record_size);
+        } else if (!draw_miss(map, n, key_size, record_size, &state, &keys[k])) {
+            fprintf(stderr, "The file holds every key; a benchmark with misses is not possible\n");
+            goto out;
+        }
+    }
+
+    zipf_gen zipf = {0};
+    if (cfg->distribution == BSS_WORKLOAD_ZIPF) {
+        zipf_init(&zipf, cfg->num_keys, cfg->zipf_theta);
+    }
+    for (uint64_t i = 0; i < cfg->num_lookups; i++) {
+        size_t k = cfg->distribution == BSS_WORKLOAD_ZIPF ? zipf_next(&zipf, &state)
+                                                          : next_random(&state) % cfg->num_keys;
+        workload->lookups[i] = keys[k];
+        workload->expected_hits += hit[k];
+    }
+    workload->num_lookups = cfg->num_lookups;
+    ret = 0;
+
+out:
+    if (ret < 0) {
+        bss_workload_free(workload);
+    }
+    free(hit);
+    free(keys);
+    munmap((void *)map, st.st_size);
+    return ret;
+}
+
+void bss_workload_free(bss_workload_t *workload) {
+    free(workload->lookups);
+    workload->lookups = NULL;
+    workload->num_lookups = 0;
+    workload->expected_hits = 0;
+}
+
+// Drop the clean pages of a file from the page cache (no root needed).
+// Pages still mapped by other processes stay.
+static int evict_file(const char *filepath) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    if (ret != 0) {
+        fprintf(stderr, "posix_fadvise: %s\n", strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+// Run count lookups with a single call (bss_find_batch() for more than one).
+// Returns the number found, or -1 on error.
+static int run_lookups(bss_handle_t *handle, const uint64_t *lookups, size_t count, int64_t *indices) {
+    if (count == 1) {
+        return bss_find(handle, lookups[0], &indices[0]);
+    }
+    return bss_find_batch(handle, lookups, count, indices);
+}
+
+// Time one engine against a workload: open, an untimed warm-up pass unless
+// cfg->cold is set (in which case the file is evicted first), the timed
+// lookups with per-call latencies in a histogram (constant memory however
+// long the run), and close. Returns 0 on success, -1 on error.
+int bss_benchmark(const char *filepath, const bss_options_t *opts, const bss_workload_t *workload,
+                  const bss_bench_config_t *cfg, bss_bench_result_t *result) {
+    size_t batch = cfg->batch_size ? cfg->batch_size : 1;
+    int ret = -1;
+
+    memset(result, 0, sizeof(*result));
+    bss_histogram_t *latencies = (bss_histogram_t *)malloc(sizeof(bss_histogram_t));
+    int64_t *indices = (int64_t *)malloc(batch * sizeof(int64_t));
+    if (!latencies || !indices) {
+        perror("malloc");
+        free(latencies);
+        free(indices);
+        return -1;
+    }
+    bss_histogram_init(latencies);
+
+    if (cfg->cold && evict_file(filepath) < 0) {
+        goto out;
+    }
+
+    uint64_t start = get_nanoseconds();
+    bss_handle_t *handle = bss_open(filepath, opts);
+    result->open_ms = (get_nanoseconds() - start) / 1e6;
+    if (!handle) {
+        goto out;
+    }
+
+    // One pass over the workload brings its pages into the cache
+    if (!cfg->cold) {
+        start = get_nanoseconds();
+        for (uint64_t i = 0; i < workload->num_lookups; i += batch) {
+            size_t count = workload->num_lookups - i < batch ? workload->num_lookups - i : batch;
+            if (run_lookups(handle, workload->lookups + i, count, indices) < 0) {
+                bss_close(handle);
+                goto out;
+            }
+        }
+        result->warmup_ms = (get_nanoseconds() - start) / 1e6;
+    }
+
+    // Counters cover the timed lookups only
+    bss_reset_counters(handle);
+    uint64_t search_start = get_nanoseconds();
+    for (uint64_t i = 0; i < workload->num_lookups; i += batch) {
+        size_t count = workload->num_lookups - i < batch ? workload->num_lookups - i : batch;
+        uint64_t t0 = get_nanoseconds();
+        int found = run_lookups(handle, workload->lookups + i, count, indices);
+        bss_histogram_record(latencies, get_nanoseconds() - t0);
+        if (found < 0) {
+            bss_close(handle);
+            goto out;
+        }
+        result->found += found;
+    }
+    result->search_ms = (get_nanoseconds() - search_start) / 1e6;
+    result->lookups = workload->num_lookups;
+    result->throughput = result->search_ms > 0 ? result->lookups / (result->search_ms / 1e3) : 0;
+    bss_get_counters(handle, &result->counters);
+
+    start = get_nanoseconds();
+    bss_close(handle);
+    result->close_ms = (get_nanoseconds() - start) / 1e6;
+
+    bss_histogram_stats(latencies, 1e-3, &result->latency);
+    ret = 0;
+
+out:
+    free(indices);
+    free(latencies);
+    return ret;
+}
@@ -0,0 +1,160 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+enum {
+    SLOT_EMPTY = 0,
+    SLOT_LOADING,              // A read into the slot is in flight
+    SLOT_READY
+};
+
+// One cached block of the data file
+typedef struct {
+    uint64_t block_no;         // Block number within the file
+    size_t count;              // Values held (the last block may be short)
+    int state;                 // SLOT_*
+    int referenced;            // CLOCK reference bit
+    int next;                  // Next slot in the same hash bucket, or -1
+} cache_slot;
+
+// Fixed-size block cache with CLOCK replacement
+struct bss_block_cache {
+    size_t block_size;         // Bytes per block
+    size_t num_slots;
+    uint64_t *memory;          // num_slots blocks, back to back
+    cache_slot *slots;
+    int *buckets;              // Hash of block number -> first slot, or -1
+    size_t bucket_mask;
+    size_t hand;               // CLOCK hand
+};
+
+static size_t bucket_of(const bss_block_cache *cache, uint64_t block_no) {
+    return (block_no * 0x9E3779B97F4A7C15ULL >> 17) & cache->bucket_mask;
+}
+
+// Create a cache of num_blocks blocks of block_size bytes each
+bss_block_cache *block_cache_create(size_t block_size, size_t num_blocks) {
+    bss_block_cache *cache = (bss_block_cache *)calloc(1, sizeof(bss_block_cache));
+    if (!cache) {
+        perror("calloc");
+        return NULL;
+    }
+    cache->block_size = block_size;
+    cache->num_slots = num_blocks;
+
+    size_t num_buckets = 1;
+    while (num_buckets < 2 * num_blocks) {
+        num_buckets <<= 1;
+    }
+    cache->bucket_mask = num_buckets - 1;
+
+    // Block buffers start on a page boundary, as O_DIRECT needs
+    size_t bytes = num_blocks * block_size;
+    bytes = (bytes + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+    cache->memory = (uint64_t *)aligned_alloc(BSS_DIRECT_ALIGNMENT, bytes);
+    cache->slots = (cache_slot *)calloc(num_blocks, sizeof(cache_slot));
+    cache->buckets = (int *)malloc(num_buckets * sizeof(int));
+    if (!cache->memory || !cache->slots || !cache->buckets) {
+        perror("malloc");
+        block_cache_destroy(cache);
+        return NULL;
+    }
+    memset(cache->buckets, 0xff, num_buckets * sizeof(int));
+    return cache;
+}
+
+void block_cache_destroy(bss_block_cache *cache) {
+    if (!cache) {
+        return;
+    }
+    free(cache->memory);
+    free(cache->slots);
+    free(cache->buckets);
+    free(cache);
+}
+
+size_t block_cache_block_size(const bss_block_cache *cache) {
+    return cache->block_size;
+}
+
+// Memory holding every block, e.g. for buffer registration
+void *block_cache_memory(const bss_block_cache *cache, size_t *size) {
+    *size = cache->num_slots * cache->block_size;
+    return cache->memory;
+}
+
+// Buffer of a slot
+uint64_t *block_cache_data(const bss_block_cache *cache, int slot) {
+    return cache->memory + (size_t)slot * (cache->block_size / sizeof(uint64_t));
+}
+
+// Number of values in a ready slot
+size_t block_cache_count(const bss_block_cache *cache, int slot) {
+    return cache->slots[slot].count;
+}
+
+// Look up a block. Returns its slot, or -1 if it is not cached. *ready tells
+// whether the data is there yet or a read into the slot is still in flight.
+int block_cache_find(bss_block_cache *cache, uint64_t block_no, int *ready) {
+    for (int s = cache->buckets[bucket_of(cache, block_no)]; s >= 0; s = cache->slots[s].next) {
+        if (cache->slots[s].block_no == block_no) {
+            cache->slots[s].referenced = 1;
+            *ready = cache->slots[s].state == SLOT_READY;
+            return s;
+        }
+    }
+    return -1;
+}
+
+static void unlink_slot(bss_block_cache *cache, int slot) {
+    int *link = &cache->buckets[bucket_of(cache, cache->slots[slot].block_no)];
+    while (*link != slot) {
+        link = &cache->slots[*link].next;
+    }
+    *link = cache->slots[slot].next;
+}
+
+// Claim a slot for block_no, evicting with CLOCK, and mark it loading.
+// Returns -1 if every slot has a read in flight.
+int block_cache_reserve(bss_block_cache *cache, uint64_t block_no) {
+    for (size_t scanned = 0; scanned < 2 * cache->num_slots; scanned++) {
+        size_t s = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->num_slots;
+
+        cache_slot *slot = &cache->slots[s];
+        if (slot->state == SLOT_LOADING) {
+            continue;
+        }
+        if (slot->state == SLOT_READY && slot->referenced) {
+            slot->referenced = 0;   // Second chance
+            continue;
+        }
+
+        if (slot->state == SLOT_READY) {
+            unlink_slot(cache, s);
+        }
+        size_t bucket = bucket_of(cache, block_no);
+        slot->block_no = block_no;
+        slot->count = 0;
+        slot->state = SLOT_LOADING;
+        slot->referenced = 1;
+        slot->next = cache->buckets[bucket];
+        cache->buckets[bucket] = s;
+        return s;
+    }
+    return -1;
+}
+
+// The read into a loading slot completed with count values
+void block_cache_fill(bss_block_cache *cache, int slot, size_t count) {
+    cache->slots[slot].count = count;
+    cache->slots[slot].state = SLOT_READY;
+}
+
+// The read into a loading slot failed: forget the block
+void block_cache_drop(bss_block_cache *cache, int slot) {
+    unlink_slot(cache, slot);
+    cache->slots[slot].state = SLOT_EMPTY;
+}
@@ -0,0 +1,247 @@
+#ifndef BSSEARCH_INTERNAL_H
+#define BSSEARCH_INTERNAL_H
+
+#include "bssearch_lib.h"
+
+// io_uring engine state (ring, read buffers); defined in iouring_search.c
+typedef struct bss_iouring_ctx bss_iouring_ctx;
+
+// Offset, length and buffer alignment of O_DIRECT reads
+#define BSS_DIRECT_ALIGNMENT 4096
+
+// Fixed-size cache of file blocks with CLOCK replacement; defined in block_cache.c
+typedef struct bss_block_cache bss_block_cache;
+
+// Multi-threaded io_uring engine state (workers, rings, queue); defined in iouring_mt_search.c
+typedef struct bss_iouring_mt_ctx bss_iouring_mt_ctx;
+
+// Compressed file opened over a mapping (block headers); defined in compressed_search.c
+typedef struct bss_compressed_ctx bss_compressed_ctx;
+
+// Parallel mmap engine state (worker pool, scratch); defined in parallel_mmap_search.c
+typedef struct bss_parallel_ctx bss_parallel_ctx;
+
+// Routing state of the auto engine (residency, latencies); defined in auto_search.c
+typedef struct bss_auto_ctx bss_auto_ctx;
+
+// Engines the auto engine routes lookups to
+typedef enum {
+    AUTO_ROUTE_MMAP = 0,
+    AUTO_ROUTE_PARALLEL,
+    AUTO_ROUTE_IOURING,
+    AUTO_ROUTES
+} bss_auto_route_t;
+
+// A lookup routed by the auto engine, from auto_begin() to auto_end()
+typedef struct {
+    int route;
+    int klass;               // Residency class of the key's range
+    uint64_t start;          // Start time, or 0 if the lookup is not timed
+} bss_auto_ticket;
+
+// Persistent worker pool; defined in thread_pool.c
+typedef struct bss_pool bss_pool_t;
+typedef void (*bss_pool_fn)(void *arg, int worker_id);
+
+bss_pool_t *bss_pool_create(int num_threads, int pin_threads);
+int bss_pool_size(const bss_pool_t *pool);
+void bss_pool_run(bss_pool_t *pool, bss_pool_fn fn, void *arg);
+void bss_pool_run_any(bss_pool_t *pool, bss_pool_fn fn, void *arg);
+void bss_pool_signal(bss_pool_t *pool);
+void bss_pool_quiesce(bss_pool_t *pool);
+void bss_pool_destroy(bss_pool_t *pool);
+void bss_futex_wait(void *addr, int expected);
+void bss_futex_wake(void *addr, int count);
+
+// Lower bound kernel: first index i in [0, n) with data[i] >= target, or n
+typedef size_t (*bss_lower_bound_fn)(const uint64_t *data, size_t n, uint64_t target);
+
+// Sparse in-memory index over the sorted file (fence pointers)
+typedef struct {
+    uint64_t *keys;          // First key of every sampled block
+    size_t num_keys;         // Number of sampled blocks
+    size_t stride;           // Elements per sampled block
+    bss_lower_bound_fn lower_bound;  // Kernel searching keys
+} bss_sparse_index;
+
+// One piece of a piecewise-linear model: keys from first_key on are predicted
+// to sit at intercept + slope * (key - first_key)
+typedef struct {
+    uint64_t first_key;
+    double slope;
+    double intercept;
+} bss_model_segment;
+
+// Learned index: segments sorted by first key, every prediction within error
+typedef struct {
+    bss_model_segment *segments;
+    size_t num_segments;
+    size_t error;
+} bss_learned_model;
+
+// Search handle: everything that is set up once and reused across lookups
+struct bss_handle {
+    bss_options_t opts;      // Options the handle was opened with
+    int fd;                  // Open file descriptor of the data file
+    int direct_fd;           // O_DIRECT descriptor of the data file (io_uring engine with use_direct), or -1
+    size_t file_size;        // Size of the data file in bytes
+    size_t num_elements;     // Number of uint64_t values (or records) in the file
+    uint64_t *data;          // Read-only mapping (mmap engines only)
+    bss_iouring_ctx *uring;  // Ring and buffers (io_uring engine only)
+    bss_parallel_ctx *parallel;  // Worker pool (parallel mmap engine only)
+    bss_iouring_mt_ctx *uring_mt;  // Workers and their rings (multi-threaded io_uring engine only)
+    bss_sparse_index index;  // Sparse index (when opts.use_index is set)
+    bss_learned_model model; // Learned model (interpolation engine with opts.model_error)
+    bss_compressed_ctx *compressed;  // Block headers of the mapping (compressed engine only)
+    uint64_t *block_buf;     // Buffer for one index block (io_uring engine with index)
+    bss_block_cache *cache;  // Blocks read so far (io_uring engine with block reads)
+    bss_lower_bound_fn lower_bound;  // Kernel selected by opts.kernel
+    bss_handle_t *routes[AUTO_ROUTES];  // Handles the auto engine picks from (NULL where unavailable)
+    bss_auto_ctx *autosel;   // Routing state (auto engine only)
+    bss_counters_t counters; // Lookups, faults and probes since open or the last reset
+    bss_counters_t io_base;  // Ring totals at the last reset
+};
+
+bss_lower_bound_fn lower_bound_kernel(bss_kernel_t kernel);
+size_t linear_lower_bound(const uint64_t *data, size_t n, uint64_t target);
+
+// Engine cores. Each returns 1 if the target was found (storing its element
+// index in *index), 0 if it is absent and -1 on error.
+int mmap_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                int64_t *index, int *comparisons);
+int kernel_lookup(bss_lower_bound_fn lower_bound, const uint64_t *data, size_t num_elements, uint64_t target,
+                  int64_t *index);
+int mmap_lookup_batch(bss_lower_bound_fn lower_bound, const uint64_t *data, size_t num_elements,
+                      const uint64_t *targets, size_t num_targets, int64_t *indices);
+bss_parallel_ctx *parallel_ctx_create(int num_threads, int pin_threads);
+void parallel_ctx_destroy(bss_parallel_ctx *ctx);
+int parallel_mmap_lookup(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                         int64_t *index, int *comparisons);
+int parallel_mmap_kary_lookup(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                              int64_t *index, int *comparisons);
+int eytzinger_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                     int64_t *index, int *comparisons);
+int interpolation_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                         int64_t *index, int *probes);
+int learned_lookup(const bss_learned_model *model, bss_lower_bound_fn lower_bound, const uint64_t *data,
+                   size_t num_elements, uint64_t target, int64_t *index);
+
+// Bound searches: *pos (or the return value) is the first element index whose
+// value is >= target, or num_elements if there is none. They return 0 on
+// success and -1 on error.
+int parallel_mmap_lower_bound(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                              bss_lower_bound_fn lower_bound, size_t *pos);
+size_t eytzinger_lower_bound(const uint64_t *data, size_t num_elements, uint64_t target);
+// Runs of equal values, from the position of the first copy found by a lower bound
+size_t mmap_run_end(const uint64_t *data, size_t num_elements, size_t first, uint64_t target);
+size_t eytzinger_run(const uint64_t *data, size_t num_elements, size_t first, uint64_t target, size_t *last);
+size_t interpolation_lower_bound(const uint64_t *data, size_t num_elements, uint64_t target, int *probes);
+size_t learned_lower_bound(const bss_learned_model *model, bss_lower_bound_fn lower_bound, const uint64_t *data,
+                           size_t num_elements, uint64_t target);
+// Record kernels for keys other than dense uint64_t (opts.key_size and
+// opts.record_size); keys point to key_size native-endian bytes
+size_t record_lower_bound(const uint8_t *data, size_t n, size_t record_size, size_t key_size, const void *key);
+int record_key_compare(const void *record, const void *key, size_t key_size);
+int record_lookup(const uint8_t *data, size_t n, size_t record_size, size_t key_size, const void *key,
+                  int64_t *index, void *record);
+// Lock or madvise() the pages of the top levels of the search tree over a mapping
+int64_t mmap_touch_levels(const uint8_t *data, size_t count, size_t stride, int eytzinger, int levels,
+                          int advice, int lock);
+// Hand [start, end) of the mapping to fn in chunks, reading it sequentially.
+// advice is the madvise() advice the mapping returns to afterwards.
+int64_t mmap_scan(const uint64_t *data, size_t start, size_t end, int advice, bss_scan_fn fn, void *arg);
+
+bss_block_cache *block_cache_create(size_t block_size, size_t num_blocks);
+void block_cache_destroy(bss_block_cache *cache);
+size_t block_cache_block_size(const bss_block_cache *cache);
+void *block_cache_memory(const bss_block_cache *cache, size_t *size);
+uint64_t *block_cache_data(const bss_block_cache *cache, int slot);
+size_t block_cache_count(const bss_block_cache *cache, int slot);
+int block_cache_find(bss_block_cache *cache, uint64_t block_no, int *ready);
+int block_cache_reserve(bss_block_cache *cache, uint64_t block_no);
+void block_cache_fill(bss_block_cache *cache, int slot, size_t count);
+void block_cache_drop(bss_block_cache *cache, int slot);
+
+// With a cache, single-target lookups read whole blocks through it; with a
+// direct_fd (-1 for none) all reads go to that O_DIRECT descriptor
+bss_iouring_ctx *iouring_ctx_create(const bss_options_t *opts, bss_block_cache *cache,
+                                    bss_lower_bound_fn lower_bound, int direct_fd);
+void iouring_ctx_destroy(bss_iouring_ctx *ctx);
+void iouring_add_counters(const bss_iouring_ctx *ctx, bss_counters_t *counters);
+unsigned iouring_rounds(const bss_iouring_ctx *ctx);
+// Search one block [lo, lo + count) with a single read into buf
+int iouring_lookup_block(bss_iouring_ctx *ctx, int fd, uint64_t *buf, size_t lo, size_t count, uint64_t target,
+                         bss_lower_bound_fn lower_bound, int64_t *index);
+int iouring_lookup(bss_iouring_ctx *ctx, int fd, size_t num_elements, uint64_t target,
+                   int64_t *index, int *total_reads);
+int iouring_lower_bound(bss_iouring_ctx *ctx, int fd, size_t num_elements, uint64_t target,
+                        size_t *pos, int *total_reads);
+// Search fixed-size records, reading whole records so a hit brings its payload along
+int iouring_lookup_record(bss_iouring_ctx *ctx, int fd, size_t num_elements, size_t record_size, size_t key_size,
+                          const void *key, int bound, size_t *pos, void *record, int *total_reads);
+int iouring_lower_bound_block(bss_iouring_ctx *ctx, int fd, uint64_t *buf, size_t lo, size_t count, uint64_t target,
+                              bss_lower_bound_fn lower_bound, size_t *pos);
+// Hand [start, end) to fn in order, read with large linked reads
+int64_t iouring_scan(bss_iouring_ctx *ctx, int fd, size_t start, size_t end, bss_scan_fn fn, void *arg);
+// One block read per target, all in flight together, then the search in memory
+int iouring_lookup_blocks(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                          const uint64_t *targets, size_t num_targets, int64_t *indices);
+// Batched variant; returns the number of targets found, or -1 on error.
+// When sparse_index is not NULL every search starts from its index block.
+int iouring_lookup_batch(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                         const uint64_t *targets, size_t num_targets, int64_t *indices, uint64_t *total_reads);
+
+// Multi-threaded io_uring engine; lookups may be submitted from any thread
+bss_iouring_mt_ctx *iouring_mt_create(const bss_options_t *opts, int fd, int direct_fd, size_t num_elements,
+                                      bss_lower_bound_fn lower_bound, size_t block_size, size_t cache_blocks);
+void iouring_mt_destroy(bss_iouring_mt_ctx *ctx);
+void iouring_mt_add_counters(const bss_iouring_mt_ctx *ctx, bss_counters_t *counters);
+int iouring_mt_lookup(bss_iouring_mt_ctx *ctx, uint64_t target, int64_t *index);
+int iouring_mt_lookup_batch(bss_iouring_mt_ctx *ctx, const uint64_t *targets, size_t num_targets, int64_t *indices);
+int iouring_mt_lower_bound(bss_iouring_mt_ctx *ctx, uint64_t target, size_t *pos);
+
+// Auto engine: available[route] says which routes are open; map is the
+// mmap route's mapping, whose residency steers the choice
+bss_auto_ctx *auto_ctx_create(const void *map, size_t num_elements, size_t record_size, size_t key_size,
+                              const int *available);
+void auto_ctx_destroy(bss_auto_ctx *ctx);
+int auto_begin(bss_auto_ctx *ctx, const void *key, size_t size, bss_auto_ticket *ticket);
+void auto_end(bss_auto_ctx *ctx, const bss_auto_ticket *ticket, uint64_t num_lookups);
+void auto_add_counters(const bss_auto_ctx *ctx, bss_counters_t *counters);
+
+bss_compressed_ctx *compressed_open(const void *map, size_t file_size, size_t *num_elements);
+void compressed_close(bss_compressed_ctx *ctx);
+const uint8_t *compressed_block_index(const bss_compressed_ctx *ctx, size_t *count, size_t *stride);
+int compressed_lookup(const bss_compressed_ctx *ctx, bss_lower_bound_fn lower_bound, uint64_t target,
+                      int64_t *index);
+size_t compressed_lower_bound(const bss_compressed_ctx *ctx, bss_lower_bound_fn lower_bound, uint64_t target);
+int64_t compressed_scan(const bss_compressed_ctx *ctx, size_t start, size_t end, bss_scan_fn fn, void *arg);
+
+// Sidecar files next to the data file: a header, then a payload. Their
+// paths are at most BSS_SIDECAR_PATH bytes.
+#define BSS_SIDECAR_PATH 4096
+struct stat;
+int sidecar_open(const char *sidecar, const struct stat *data_st, void *header, size_t header_size);
+int sidecar_read(int fd, size_t header_size, void *payload, size_t bytes);
+int sidecar_store(const char *sidecar, const void *header, size_t header_size, const void *payload,
+                  size_t bytes);
+
+int learned_model_open(bss_learned_model *model, const char *filepath, int fd, const uint64_t *data,
+                       size_t num_elements, size_t error, int use_sidecar);
+void learned_model_free(bss_learned_model *model);
+
+int sparse_index_open(bss_sparse_index *index, const char *filepath, int fd, size_t num_elements,
+                      size_t stride, int use_sidecar, bss_lower_bound_fn lower_bound);
+void sparse_index_free(bss_sparse_index *index);
+int sparse_index_lookup(const bss_sparse_index *index, size_t num_elements, uint64_t target,
+                        size_t *lo, size_t *hi);
+int sparse_index_lower_block(const bss_sparse_index *index, size_t num_elements, uint64_t target,
+                             size_t *lo, size_t *hi);
+
+// Print a setup note to stdout if the verbosity is at least level
+void bss_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static inline void search_result_reset(bss_search_result_t *result) {
+    *result = (bss_search_result_t){ .index = -1, .last = -1 };
+}
+#endif // BSSEARCH_INTERNAL_H
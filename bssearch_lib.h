@@ -12,19 +12,293 @@ typedef struct {
     double median;        // Median duration in milliseconds
     double p90;           // 90th percentile duration in milliseconds
     double p95;           // 95th percentile duration in milliseconds
+    double p99;           // 99th percentile duration in milliseconds
+    double p999;          // 99.9th percentile duration in milliseconds
+    double p9999;         // 99.99th percentile duration in milliseconds
     double std_dev;       // Standard deviation of durations
     uint64_t iterations;  // Number of iterations
 } search_stats_t;
 
+// Log-linear latency histogram (HDR style) in constant memory: values below
+// 2^BSS_HISTOGRAM_SUB_BITS are exact, larger ones land in one of
+// 2^(BSS_HISTOGRAM_SUB_BITS - 1) buckets per power of two, so any recorded
+// value is reported within 1 / 2^(BSS_HISTOGRAM_SUB_BITS - 1) of itself
+#define BSS_HISTOGRAM_SUB_BITS 8
+#define BSS_HISTOGRAM_BUCKETS ((64 - BSS_HISTOGRAM_SUB_BITS + 2) << (BSS_HISTOGRAM_SUB_BITS - 1))
+
+typedef struct {
+    uint64_t counts[BSS_HISTOGRAM_BUCKETS];
+    uint64_t total;       // Values recorded
+    uint64_t min;         // Smallest and largest value recorded (exact)
+    uint64_t max;
+    double sum;           // Sum and sum of squares of the values (exact, for mean and deviation)
+    double sum_squares;
+} bss_histogram_t;
+
+// Outcome of one legacy single-shot search (binary_search_uint64_mmap() and
+// friends). The search functions only fill this in; printing is up to the caller.
+typedef struct {
+    int found;            // Values found (0 or 1 for a single target)
+    int64_t index;        // Element index of the target, or -1
+    int64_t last;         // Rightmost copy of the target (equal-range queries), or -1
+    uint64_t count;       // Copies of the target (equal-range queries)
+    int probes;           // Comparisons, probes or reads performed
+    uint64_t bytes_read;  // Bytes read from the file (or touched through the mapping)
+    double elapsed_ms;    // Wall time of open, search and close
+} bss_search_result_t;
+
+// How much the library prints on its own: setup notes such as layout
+// conversions, index builds and ring features go to stdout from
+// BSS_VERBOSITY_NORMAL up. Lookups never print. Errors always go to stderr.
+typedef enum {
+    BSS_VERBOSITY_QUIET = 0,   // Nothing but errors
+    BSS_VERBOSITY_NORMAL = 1,  // Setup notes (the default)
+    BSS_VERBOSITY_DEBUG = 2    // Also details of every open
+} bss_verbosity_t;
+
+// Search engines selectable through the handle API
+typedef enum {
+    BSS_ENGINE_MMAP = 1,           // Simple mmap
+    BSS_ENGINE_IOURING = 2,        // IO_uring
+    BSS_ENGINE_PARALLEL_MMAP = 3,  // Parallel mmap
+    BSS_ENGINE_EYTZINGER = 4,      // Eytzinger-layout file over mmap
+    BSS_ENGINE_IOURING_MT = 5,     // IO_uring with one ring per worker thread
+    BSS_ENGINE_INTERPOLATION = 6,  // Interpolation search (or a learned model) over mmap
+    BSS_ENGINE_COMPRESSED = 7,     // Frame-of-reference compressed file over mmap
+    BSS_ENGINE_AUTO = 8            // Per lookup, whichever of mmap, parallel mmap and io_uring suits the page cache
+} bss_engine_t;
+
+// In-memory search kernels for the mmap engine
+typedef enum {
+    BSS_KERNEL_SCALAR = 0,   // Classic binary search with early exit
+    BSS_KERNEL_SIMD = 1,     // k-ary AVX2/AVX-512 search, picked at runtime
+    BSS_KERNEL_BRANCHLESS = 2  // Branchless binary search with next-level prefetching
+} bss_kernel_t;
+
+// Work split of the parallel mmap engine
+typedef enum {
+    BSS_PARALLEL_SLICES = 0,       // Each thread binary-searches its own slice
+    BSS_PARALLEL_COOPERATIVE = 1   // Threads probe shared pivots per round (k-ary search)
+} bss_parallel_mode_t;
+
+// Options for bss_open()
+typedef struct {
+    bss_engine_t engine;  // Engine used for lookups
+    int num_threads;      // Number of threads (parallel mmap and multi-threaded io_uring)
+    bss_parallel_mode_t parallel_mode;  // Work split (parallel mmap only)
+    int pin_threads;      // Pin pool workers to CPUs (parallel mmap and multi-threaded io_uring)
+    int use_sqpoll;       // Use SQPOLL mode, sharing one poller thread per process (io_uring only)
+    int sqpoll_idle_ms;   // Idle time of the shared SQPOLL thread, set by its first user (io_uring only; 0 = 2000)
+    int use_iopoll;       // Poll the device for completions (io_uring with use_direct only)
+    int use_buffers;      // Register read buffers (io_uring only)
+    int use_readahead;    // Page-granular reads with the default block size (io_uring only)
+    size_t io_block_size; // Bytes per read, a power of two; 0 = single values (io_uring only)
+    size_t io_cache_blocks;  // Blocks kept in the handle's CLOCK cache (io_uring only; 0 = 256)
+    int use_direct;       // Bypass the page cache: O_DIRECT block reads into registered buffers (io_uring only)
+    int io_fanout;        // Speculative reads per round, 1 to 64 (io_uring only; 0 = adaptive default)
+    int io_speculate;     // Also issue the next round's reads for every outcome (io_uring only)
+    int use_index;        // Build a sparse in-memory index of block first keys
+    size_t index_stride;  // Elements per index block (default: one 4 KiB page)
+    int index_sidecar;    // Load/store the index from/to <filepath>.idx
+    bss_kernel_t kernel;  // In-memory search kernel (mmap engine and index blocks)
+    size_t model_error;   // Fit a piecewise-linear model predicting positions within this many elements
+                          // (interpolation engine; 0 = plain interpolation search)
+    int model_sidecar;    // Load/store the model from/to <filepath>.pla
+    size_t key_size;      // Bytes per unsigned, native-endian key: 4, 8 or 16 (0 = 8)
+    size_t record_size;   // Bytes per record, the key followed by its payload (0 = key_size).
+                          // Anything but dense 8-byte keys needs the mmap or io_uring engine.
+    int map_hugepage;     // Ask for transparent huge pages on the mapping, where file THP is supported (mmap engines)
+    int map_populate;     // Prefault the whole mapping when opening, MAP_POPULATE (mmap engines)
+    int lock_levels;      // mlock() the pages of the top lock_levels levels of the search tree (mmap engines)
+    int prewarm_levels;   // MADV_WILLNEED the pages of the top prewarm_levels levels when opening (mmap engines)
+    int collect_counters; // Count page faults and probe depth around every lookup (see bss_get_counters())
+} bss_options_t;
+
+// Lookup counters of a handle, to tell storage from CPU time (see
+// bss_get_counters()). Lookups, faults and probes are only counted with
+// opts.collect_counters; the io_uring reads, block cache outcomes and routes
+// of the auto engine always are.
+typedef struct {
+    uint64_t lookups;        // Exact-match and bound lookups (each target of a batch counts)
+    uint64_t minor_faults;   // Page faults served from the page cache during lookups
+    uint64_t major_faults;   // Page faults that waited for the device during lookups
+    uint64_t probed_lookups; // Lookups whose engine reports how deep it searched
+    uint64_t probes;         // Levels those lookups searched: comparisons in memory (summed over the threads
+                             // of the parallel engine), rounds of reads for io_uring
+    double log2_elements;    // log2 of the number of elements, the depth of a plain binary search
+    uint64_t io_requests;    // Reads submitted through io_uring
+    uint64_t io_bytes;       // Bytes those reads asked for
+    uint64_t cache_hits;     // Probes served by the io_uring block cache
+    uint64_t cache_misses;   // Probes that had to read their block
+    uint64_t routed_mmap;    // Lookups the auto engine sent to mmap
+    uint64_t routed_parallel;  // ... to parallel mmap
+    uint64_t routed_iouring; // ... to io_uring
+} bss_counters_t;
+
+// Opaque search handle: keeps the file, mapping and io_uring instance alive between lookups
+typedef struct bss_handle bss_handle_t;
+
+// Opaque set of sorted segment files searched as one (see bss_segments_open())
+typedef struct bss_segments bss_segments_t;
+
+// Opaque context of asynchronous lookups on a handle (see bss_async_create())
+typedef struct bss_async bss_async_t;
+
+// Completion of an asynchronous lookup: found is 1 (index is the element
+// index of target), 0 (index is -1) or -1 on error
+typedef void (*bss_async_cb)(void *arg, uint64_t target, int found, int64_t index);
+
+struct io_uring;
+struct io_uring_cqe;
+
+// Range scan callback: receives count consecutive values starting at element
+// first_pos. Returning nonzero stops the scan.
+typedef int (*bss_scan_fn)(const uint64_t *values, size_t count, size_t first_pos, void *arg);
+
+// Key distributions of a benchmark workload
+typedef enum {
+    BSS_WORKLOAD_UNIFORM = 0,  // Every key of the set equally likely
+    BSS_WORKLOAD_ZIPF = 1      // Zipfian popularity over the key set (a few hot keys)
+} bss_distribution_t;
+
+// Benchmark configuration (see bss_workload_create() and bss_benchmark())
+typedef struct {
+    size_t num_keys;      // Distinct keys drawn from the file into the key set
+    uint64_t num_lookups; // Timed lookups per engine
+    bss_distribution_t distribution;  // Which keys of the set the lookups pick
+    double zipf_theta;    // Skew of the Zipfian distribution, in (0, 1)
+    double hit_ratio;     // Fraction of the key set present in the file, 0 to 1
+    size_t batch_size;    // Keys per bss_find_batch() call (1 = single lookups)
+    int cold;             // Evict the file from the page cache before opening (otherwise a warm-up pass runs)
+    uint64_t seed;        // Seed of the key and lookup generators
+} bss_bench_config_t;
+
+// Lookup sequence of a benchmark, generated once and replayed against every engine
+typedef struct {
+    uint64_t *lookups;    // Targets in lookup order
+    uint64_t num_lookups;
+    uint64_t expected_hits;  // Lookups whose target is in the file
+} bss_workload_t;
+
+// Outcome of one benchmark run
+typedef struct {
+    double open_ms;       // bss_open(): mapping, ring setup, indexes and models
+    double warmup_ms;     // Untimed warm-up pass (0 when cold)
+    double search_ms;     // The timed lookups, back to back
+    double close_ms;      // bss_close()
+    uint64_t lookups;     // Lookups performed
+    uint64_t found;       // Lookups that hit
+    double throughput;    // Lookups per second over the search phase
+    search_stats_t latency;  // Per-call latency in microseconds (one call per batch with batch_size > 1)
+    bss_counters_t counters; // Counters of the timed lookups (faults and probes with opts.collect_counters)
+} bss_bench_result_t;
+
+// Gaps between consecutive keys of a generated test file (each averages
+// about cfg->step)
+typedef enum {
+    BSS_DATA_SEQUENTIAL = 0,   // Every gap is step: keys i * step
+    BSS_DATA_RANDOM_GAPS = 1,  // Uniform gaps in [1, 2 * step - 1]
+    BSS_DATA_CLUSTERED = 2,    // Runs of consecutive keys separated by random jumps
+    BSS_DATA_DUPLICATES = 3,   // Runs of equal keys (a quarter of the gaps are 4 * step, the rest 0)
+    BSS_DATA_SKEWED = 4        // Heavy-tailed (Pareto) gaps: dense stretches and a few huge holes
+} bss_data_distribution_t;
+
+// Test file generator configuration (see bss_generate_file())
+typedef struct {
+    size_t num_elements;  // Keys (or records) to write
+    uint64_t step;        // Mean gap between consecutive keys
+    size_t key_size;      // Bytes per key: 4, 8 or 16 (0 = 8)
+    size_t record_size;   // Bytes per record, the key followed by a payload (0 = key_size)
+    bss_data_distribution_t distribution;
+    int num_threads;      // Generator threads (0 = one per online CPU)
+    int preallocate;      // fallocate() the whole file before writing
+    uint64_t seed;        // Seed of the random gaps
+} bss_datagen_config_t;
+
 // Common utility functions
 uint64_t get_microseconds();
+uint64_t get_nanoseconds(void);
 int create_test_file(const char *filepath, size_t num_elements, uint64_t step);
+int create_record_test_file(const char *filepath, size_t num_elements, uint64_t step, size_t key_size,
+                            size_t record_size);
+void bss_default_datagen_config(bss_datagen_config_t *cfg);
+int bss_generate_file(const char *filepath, const bss_datagen_config_t *cfg);
 void calculate_stats(double *durations, uint64_t n, search_stats_t *stats);
+void bss_histogram_init(bss_histogram_t *hist);
+void bss_histogram_record(bss_histogram_t *hist, uint64_t value);
+void bss_histogram_merge(bss_histogram_t *dst, const bss_histogram_t *src);
+uint64_t bss_histogram_percentile(const bss_histogram_t *hist, double percentile);
+void bss_histogram_stats(const bss_histogram_t *hist, double scale, search_stats_t *stats);
 int compare_doubles(const void *a, const void *b);
+void bss_set_verbosity(int level);
+int bss_get_verbosity(void);
+const char *simd_kernel_isa(void);
 
 // Implementation interfaces
-int binary_search_uint64_mmap(const char *filepath, uint64_t target);
-int binary_search_uint64(const char *filepath, uint64_t target, int use_sqpoll, int use_buffers, int use_readahead);
-int parallel_binary_search_uint64_mmap(const char *filepath, uint64_t target, int num_threads);
+int binary_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result);
+int binary_search_uint64(const char *filepath, uint64_t target, int use_sqpoll, int use_buffers, int use_readahead,
+                         bss_search_result_t *result);
+int binary_search_uint64_batch(const char *filepath, const uint64_t *targets, size_t num_targets,
+                               int64_t *indices, int use_sqpoll, int use_buffers, bss_search_result_t *result);
+int parallel_binary_search_uint64_mmap(const char *filepath, uint64_t target, int num_threads,
+                                       bss_search_result_t *result);
+int eytzinger_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result);
+int interpolation_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result);
+int compressed_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result);
+
+// Layout conversion
+int convert_to_eytzinger(const char *src_path, const char *dst_path);
+int convert_to_compressed(const char *src_path, const char *dst_path);
+
+
+// Handle API: open once, search many times. Handles of the multi-threaded
+// io_uring engine accept bss_find()/bss_find_batch()/bss_lower_bound()/
+// bss_upper_bound() from several threads at once.
+void bss_default_options(bss_options_t *opts);
+bss_handle_t *bss_open(const char *filepath, const bss_options_t *opts);
+int bss_find(bss_handle_t *handle, uint64_t target, int64_t *index);
+int bss_find_batch(bss_handle_t *handle, const uint64_t *targets, size_t num_targets, int64_t *indices);
+int bss_find_key(bss_handle_t *handle, const void *key, int64_t *index, void *record);
+int bss_lower_bound(bss_handle_t *handle, uint64_t target, size_t *pos);
+int bss_upper_bound(bss_handle_t *handle, uint64_t target, size_t *pos);
+int bss_equal_range(bss_handle_t *handle, uint64_t target, size_t *first, size_t *last, size_t *count);
+int64_t bss_scan(bss_handle_t *handle, uint64_t lo_key, uint64_t hi_key, bss_scan_fn fn, void *arg);
+size_t bss_num_elements(const bss_handle_t *handle);
+void bss_get_counters(const bss_handle_t *handle, bss_counters_t *counters);
+void bss_reset_counters(bss_handle_t *handle);
+void bss_close(bss_handle_t *handle);
+
+// Segment sets: many sorted files (a directory, or a manifest with the key
+// range of each), pruned by key range so a lookup only searches the segments
+// that can hold its key, side by side on a worker pool
+bss_segments_t *bss_segments_open(const char *path, const bss_options_t *opts);
+int bss_segments_find(bss_segments_t *set, uint64_t target, int *segment, int64_t *index);
+size_t bss_segments_count(const bss_segments_t *set);
+const char *bss_segments_path(const bss_segments_t *set, size_t i);
+bss_handle_t *bss_segments_handle(const bss_segments_t *set, size_t i);
+void bss_segments_close(bss_segments_t *set);
+
+// Asynchronous lookups: submit and get a callback per lookup, with many in
+// flight on one thread. Each probe is one block read; its completion
+// advances the lookup. Runs on the context's own ring (bss_async_poll(),
+// with an eventfd for epoll loops) or on the caller's ring, whose loop
+// submits it and hands back completions with bss_async_handle_cqe(). One
+// thread at a time per context.
+bss_async_t *bss_async_create(bss_handle_t *handle, struct io_uring *ring, unsigned max_lookups);
+int bss_async_submit(bss_async_t *ctx, uint64_t target, bss_async_cb cb, void *arg);
+int bss_async_handle_cqe(bss_async_t *ctx, const struct io_uring_cqe *cqe);
+int bss_async_poll(bss_async_t *ctx, int wait);
+int bss_async_fd(const bss_async_t *ctx);
+size_t bss_async_in_flight(const bss_async_t *ctx);
+void bss_async_destroy(bss_async_t *ctx);
+
+// Benchmark harness: draw a workload from a sorted file once, then time the
+// open, search and close phases of any engine against it
+void bss_default_bench_config(bss_bench_config_t *cfg);
+int bss_workload_create(const char *sorted_path, size_t key_size, size_t record_size, const bss_bench_config_t *cfg,
+                        bss_workload_t *workload);
+void bss_workload_free(bss_workload_t *workload);
+int bss_benchmark(const char *filepath, const bss_options_t *opts, const bss_workload_t *workload,
+                  const bss_bench_config_t *cfg, bss_bench_result_t *result);
 
 #endif // BSSEARCH_LIB_H
\ No newline at end of file
@@ -1,38 +1,64 @@
-#include "bssearch_lib.h"
+#include "bssearch_internal.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
 
-// Function to get current time in microseconds
-uint64_t get_microseconds() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+static int verbosity = BSS_VERBOSITY_NORMAL;
+
+// Set how much the library prints on its own (a bss_verbosity_t level)
+void bss_set_verbosity(int level) {
+    verbosity = level;
 }
 
-// Function to create a test file with sorted uint64_t values
-int create_test_file(const char *filepath, size_t num_elements, uint64_t step) {
-    FILE *file = fopen(filepath, "wb");
-    if (!file) {
-        perror("fopen");
-        return -1;
+int bss_get_verbosity(void) {
+    return verbosity;
+}
+
+void bss_log(int level, const char *fmt, ...) {
+    if (verbosity < level) {
+        return;
     }
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+// Function to get the monotonic time in microseconds
+uint64_t get_microseconds() {
+    return get_nanoseconds() / 1000;
+}
 
-    printf("Creating test file with %zu elements...\n", num_elements);
+// Monotonic time in nanoseconds (CLOCK_MONOTONIC), for timing phases and single lookups
+uint64_t get_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    for (uint64_t i = 0; i < num_elements; i++) {
-        uint64_t value = i * step;
-        if (fwrite(&value, sizeof(uint64_t), 1, file) != 1) {
-            perror("fwrite");
-            fclose(file);
-            return -1;
-        }
-    }
+// Function to create a test file with sorted uint64_t values
+int create_test_file(const char *filepath, size_t num_elements, uint64_t step) {
+    bss_datagen_config_t cfg;
+    bss_default_datagen_config(&cfg);
+    cfg.num_elements = num_elements;
+    cfg.step = step;
+    return bss_generate_file(filepath, &cfg);
+}
 
-    fclose(file);
-    printf("Test file created successfully: %s\n", filepath);
-    return 0;
+// Function to create a test file of fixed-size records: keys i * step of
+// key_size bytes (4, 8 or 16), each followed by a payload made of the low byte of i
+int create_record_test_file(const char *filepath, size_t num_elements, uint64_t step, size_t key_size,
+                            size_t record_size) {
+    bss_datagen_config_t cfg;
+    bss_default_datagen_config(&cfg);
+    cfg.num_elements = num_elements;
+    cfg.step = step;
+    cfg.key_size = key_size;
+    cfg.record_size = record_size;
+    return bss_generate_file(filepath, &cfg);
 }
 
 // Comparison function for qsort
@@ -51,6 +77,9 @@ void calculate_stats(double *durations, uint64_t n, search_stats_t *stats) {
         stats->median = 0;
         stats->p90 = 0;
         stats->p95 = 0;
+        stats->p99 = 0;
+        stats->p999 = 0;
+        stats->p9999 = 0;
         stats->std_dev = 0;
         stats->iterations = 0;
         return;
@@ -76,15 +105,14 @@ void calculate_stats(double *durations, uint64_t n, search_stats_t *stats) {
         stats->median = durations[n/2];
     }
 
-    // 90th percentile (index = 0.9 * n - 1)
-    size_t p90_idx = (size_t)(0.9 * n);
-    if (p90_idx >= n) p90_idx = n - 1;
-    stats->p90 = durations[p90_idx];
-
-    // 95th percentile (index = 0.95 * n - 1)
-    size_t p95_idx = (size_t)(0.95 * n);
-    if (p95_idx >= n) p95_idx = n - 1;
-    stats->p95 = durations[p95_idx];
+    // Percentiles (index = q * n, clamped to the last duration)
+    const double quantiles[] = { 0.9, 0.95, 0.99, 0.999, 0.9999 };
+    double *targets[] = { &stats->p90, &stats->p95, &stats->p99, &stats->p999, &stats->p9999 };
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        size_t idx = (size_t)(quantiles[q] * n);
+        if (idx >= n) idx = n - 1;
+        *targets[q] = durations[idx];
+    }
 
     // Calculate standard deviation
     double variance = 0.0;
@@ -0,0 +1,381 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Compressed layout: a file header, one uncompressed header per block, then
+// the blocks' keys stored frame-of-reference style: every key is its offset
+// from the block's first key, bit-packed at the block's width. A lookup
+// binary-searches the block headers and unpacks a single block.
+#define COMPRESSED_MAGIC 0x3130524f46535342ULL   // "BSSFOR01"
+#define COMPRESSED_BLOCK 128                     // Keys per block
+#define COMPRESSED_PADDING 16                    // Bytes after the last block, so unpacking may over-read
+
+typedef struct {
+    uint64_t magic;
+    uint64_t num_elements;
+    uint64_t block_elems;
+    uint64_t num_blocks;
+} compressed_header;
+
+typedef struct {
+    uint64_t base;          // First (smallest) key of the block
+    uint64_t offset;        // File offset of the packed keys
+    uint32_t bits;          // Bits per packed key, 0 to 64
+    uint32_t count;         // Keys in the block (the last one may be short)
+} compressed_block;
+
+// Compressed file opened by a search handle; points into the handle's mapping
+struct bss_compressed_ctx {
+    const uint8_t *map;
+    const compressed_block *blocks;
+    size_t num_blocks;
+    size_t block_elems;
+    size_t num_elements;
+};
+
+typedef void (*unpack_fn)(const uint8_t *in, uint32_t bits, uint64_t base, size_t count, uint64_t *out);
+
+// Key i of a block packed at the given width. Reads 16 bytes, so the file
+// keeps COMPRESSED_PADDING bytes after the last block.
+static inline uint64_t unpack_key(const uint8_t *in, uint32_t bits, uint64_t mask, size_t i) {
+    size_t bitpos = i * bits;
+    unsigned __int128 word;
+    memcpy(&word, in + bitpos / 8, sizeof(word));
+    return (uint64_t)(word >> (bitpos % 8)) & mask;
+}
+
+static void scalar_unpack(const uint8_t *in, uint32_t bits, uint64_t base, size_t count, uint64_t *out) {
+    uint64_t mask = bits == 64 ? UINT64_MAX : (1ULL << bits) - 1;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = base + unpack_key(in, bits, mask, i);
+    }
+}
+
+#if defined(__x86_64__)
+// Four keys per step: gather the 8 bytes holding each key, shift and mask.
+// A key must fit in a 64-bit load after its bit shift, so widths above 56
+// take the scalar path.
+__attribute__((target("avx2")))
+static void avx2_unpack(const uint8_t *in, uint32_t bits, uint64_t base, size_t count, uint64_t *out) {
+    if (bits > 56) {
+        scalar_unpack(in, bits, base, count, out);
+        return;
+    }
+    const __m256i mask = _mm256_set1_epi64x((long long)((1ULL << bits) - 1));
+    const __m256i vbase = _mm256_set1_epi64x((long long)base);
+    const __m256i seven = _mm256_set1_epi64x(7);
+    const __m256i step = _mm256_set1_epi64x(4LL * bits);
+    __m256i bitpos = _mm256_set_epi64x(3LL * bits, 2LL * bits, bits, 0);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i words = _mm256_i64gather_epi64((const long long *)in, _mm256_srli_epi64(bitpos, 3), 1);
+        __m256i keys = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(bitpos, seven)), mask);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_add_epi64(keys, vbase));
+        bitpos = _mm256_add_epi64(bitpos, step);
+    }
+    for (; i < count; i++) {
+        out[i] = base + unpack_key(in, bits, (1ULL << bits) - 1, i);
+    }
+}
+#endif
+
+// Widest unpacker the running CPU supports
+static void unpack_block(const bss_compressed_ctx *ctx, size_t block, uint64_t *out) {
+    static unpack_fn unpack = NULL;
+    if (!unpack) {
+        unpack = scalar_unpack;
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            unpack = avx2_unpack;
+        }
+#endif
+    }
+    const compressed_block *b = &ctx->blocks[block];
+    unpack(ctx->map + b->offset, b->bits, b->base, b->count, out);
+}
+
+// Validate the header of a mapped compressed file. Returns NULL on error.
+bss_compressed_ctx *compressed_open(const void *map, size_t file_size, size_t *num_elements) {
+    const compressed_header *header = (const compressed_header *)map;
+    if (file_size < sizeof(*header) || header->magic != COMPRESSED_MAGIC || header->block_elems == 0 ||
+        header->block_elems > COMPRESSED_BLOCK || header->num_elements == 0 ||
+        header->num_blocks != (header->num_elements + header->block_elems - 1) / header->block_elems ||
+        file_size < sizeof(*header) + header->num_blocks * sizeof(compressed_block)) {
+        fprintf(stderr, "Not a compressed key file\n");
+        return NULL;
+    }
+
+    bss_compressed_ctx *ctx = (bss_compressed_ctx *)calloc(1, sizeof(bss_compressed_ctx));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+    ctx->map = (const uint8_t *)map;
+    ctx->blocks = (const compressed_block *)(header + 1);
+    ctx->num_blocks = header->num_blocks;
+    ctx->block_elems = header->block_elems;
+    ctx->num_elements = header->num_elements;
+
+    // Every block must lie inside the file, padding included
+    for (size_t b = 0; b < ctx->num_blocks; b++) {
+        const compressed_block *blk = &ctx->blocks[b];
+        size_t expected = b + 1 < ctx->num_blocks ? ctx->block_elems
+                                                  : ctx->num_elements - b * ctx->block_elems;
+        if (blk->bits > 64 || blk->count != expected ||
+            blk->offset + ((uint64_t)blk->count * blk->bits + 7) / 8 + COMPRESSED_PADDING > file_size) {
+            fprintf(stderr, "Corrupt block header %zu in compressed key file\n", b);
+            free(ctx);
+            return NULL;
+        }
+    }
+    *num_elements = ctx->num_elements;
+    return ctx;
+}
+
+void compressed_close(bss_compressed_ctx *ctx) {
+    free(ctx);
+}
+
+// The block headers within the mapping: the sorted array every lookup
+// binary-searches before it unpacks a block
+const uint8_t *compressed_block_index(const bss_compressed_ctx *ctx, size_t *count, size_t *stride) {
+    *count = ctx->num_blocks;
+    *stride = sizeof(compressed_block);
+    return (const uint8_t *)ctx->blocks;
+}
+
+// Last block whose first key is <= target (< target when strict), or -1
+static ptrdiff_t find_block(const bss_compressed_ctx *ctx, uint64_t target, int strict) {
+    size_t left = 0;
+    size_t right = ctx->num_blocks;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        uint64_t base = ctx->blocks[mid].base;
+        if (base < target || (!strict && base == target)) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return (ptrdiff_t)left - 1;
+}
+
+// Exact-match lookup: one header search, one block unpacked
+int compressed_lookup(const bss_compressed_ctx *ctx, bss_lower_bound_fn lower_bound, uint64_t target,
+                      int64_t *index) {
+    uint64_t keys[COMPRESSED_BLOCK];
+    ptrdiff_t block = find_block(ctx, target, 0);
+    if (block < 0) {
+        return 0;
+    }
+
+    unpack_block(ctx, block, keys);
+    int found = kernel_lookup(lower_bound, keys, ctx->blocks[block].count, target, index);
+    if (found > 0) {
+        *index += block * ctx->block_elems;
+    }
+    return found;
+}
+
+// First element index whose key is >= target, or the number of elements.
+// The search starts in the last block whose first key is < target, so runs
+// of duplicates spanning blocks are found from their start.
+size_t compressed_lower_bound(const bss_compressed_ctx *ctx, bss_lower_bound_fn lower_bound, uint64_t target) {
+    uint64_t keys[COMPRESSED_BLOCK];
+    ptrdiff_t block = find_block(ctx, target, 1);
+    if (block < 0) {
+        return 0;
+    }
+
+    unpack_block(ctx, block, keys);
+    return block * ctx->block_elems + lower_bound(keys, ctx->blocks[block].count, target);
+}
+
+// Hand the keys [start, end) to fn, unpacking one block at a time
+int64_t compressed_scan(const bss_compressed_ctx *ctx, size_t start, size_t end, bss_scan_fn fn, void *arg) {
+    uint64_t keys[COMPRESSED_BLOCK];
+    int64_t visited = 0;
+
+    for (size_t pos = start; pos < end; ) {
+        size_t block = pos / ctx->block_elems;
+        size_t first = block * ctx->block_elems;
+        size_t stop = first + ctx->blocks[block].count < end ? first + ctx->blocks[block].count : end;
+
+        unpack_block(ctx, block, keys);
+        visited += stop - pos;
+        if (fn(keys + (pos - first), stop - pos, pos, arg)) {
+            break;
+        }
+        pos = stop;
+    }
+    return visited;
+}
+
+// Bits needed to store value
+static uint32_t bit_width(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+// Pack count offsets from base at the given width into out, which must be
+// zeroed and hold 16 bytes more than the packed bits
+static void pack_block(const uint64_t *keys, size_t count, uint64_t base, uint32_t bits, uint8_t *out) {
+    for (size_t i = 0; i < count && bits > 0; i++) {
+        size_t bitpos = i * bits;
+        unsigned __int128 word;
+        memcpy(&word, out + bitpos / 8, sizeof(word));
+        word |= (unsigned __int128)(keys[i] - base) << (bitpos % 8);
+        memcpy(out + bitpos / 8, &word, sizeof(word));
+    }
+}
+
+// Rewrite a file of sorted uint64_t values into frame-of-reference blocks
+int convert_to_compressed(const char *src_path, const char *dst_path) {
+    struct stat st;
+    int ret = -1;
+    compressed_block *blocks = NULL;
+    FILE *dst = NULL;
+
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd < 0) {
+        perror("open");
+        return -1;
+    }
+
+    if (fstat(src_fd, &st) < 0) {
+        perror("fstat");
+        close(src_fd);
+        return -1;
+    }
+
+    if (st.st_size % sizeof(uint64_t) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Source file is empty or not aligned with uint64_t size\n");
+        close(src_fd);
+        return -1;
+    }
+    size_t num_elements = st.st_size / sizeof(uint64_t);
+    size_t num_blocks = (num_elements + COMPRESSED_BLOCK - 1) / COMPRESSED_BLOCK;
+
+    uint64_t *sorted = (uint64_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0);
+    if (sorted == MAP_FAILED) {
+        perror("mmap");
+        close(src_fd);
+        return -1;
+    }
+    madvise(sorted, st.st_size, MADV_SEQUENTIAL);
+
+    blocks = (compressed_block *)calloc(num_blocks, sizeof(compressed_block));
+    dst = fopen(dst_path, "wb");
+    if (!blocks || !dst) {
+        perror(blocks ? "fopen" : "calloc");
+        goto out;
+    }
+
+    bss_log(BSS_VERBOSITY_NORMAL, "Compressing %zu elements into %zu blocks of %d keys...\n",
+            num_elements, num_blocks, COMPRESSED_BLOCK);
+
+    // The packed keys follow the file header and the block headers
+    uint64_t offset = sizeof(compressed_header) + num_blocks * sizeof(compressed_block);
+    if (fseeko(dst, offset, SEEK_SET) != 0) {
+        perror("fseek");
+        goto out;
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        uint8_t packed[COMPRESSED_BLOCK * sizeof(uint64_t) + COMPRESSED_PADDING] = {0};
+        const uint64_t *keys = sorted + b * COMPRESSED_BLOCK;
+        size_t count = num_elements - b * COMPRESSED_BLOCK < COMPRESSED_BLOCK
+            ? num_elements - b * COMPRESSED_BLOCK : COMPRESSED_BLOCK;
+
+        if (keys[count - 1] < keys[0]) {
+            fprintf(stderr, "Source file is not sorted\n");
+            goto out;
+        }
+        blocks[b].base = keys[0];
+        blocks[b].offset = offset;
+        blocks[b].bits = bit_width(keys[count - 1] - keys[0]);
+        blocks[b].count = count;
+        pack_block(keys, count, keys[0], blocks[b].bits, packed);
+
+        // Whole words keep every block 8-byte aligned
+        size_t bytes = (count * blocks[b].bits + 63) / 64 * sizeof(uint64_t);
+        if (bytes && fwrite(packed, bytes, 1, dst) != 1) {
+            perror("fwrite");
+            goto out;
+        }
+        offset += bytes;
+    }
+
+    uint8_t padding[COMPRESSED_PADDING] = {0};
+    compressed_header header = { COMPRESSED_MAGIC, num_elements, COMPRESSED_BLOCK, num_blocks };
+    if (fwrite(padding, sizeof(padding), 1, dst) != 1 || fseeko(dst, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, dst) != 1 ||
+        fwrite(blocks, sizeof(compressed_block), num_blocks, dst) != num_blocks) {
+        perror("fwrite");
+        goto out;
+    }
+    if (fclose(dst) != 0) {
+        dst = NULL;
+        perror("fclose");
+        goto out;
+    }
+    dst = NULL;
+
+    offset += sizeof(padding);
+    bss_log(BSS_VERBOSITY_NORMAL, "Compressed file created successfully: %s (%" PRIu64 " bytes, %.2fx smaller)\n",
+            dst_path, offset, (double)st.st_size / offset);
+    ret = 0;
+
+out:
+    if (dst) {
+        fclose(dst);
+    }
+    free(blocks);
+    munmap(sorted, st.st_size);
+    close(src_fd);
+    if (ret < 0) {
+        unlink(dst_path);
+    }
+    return ret;
+}
+
+// Search for a target uint64_t in a compressed file using mmap. Fills
+// *result without printing anything. Returns 0 on success, -1 on error.
+int compressed_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open and map the file
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_COMPRESSED;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
+    }
+
+    result->found = compressed_lookup(handle->compressed, handle->lower_bound, target, &result->index);
+
+    // Clean up
+    bss_close(handle);
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
+    return 0;
+}
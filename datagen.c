@@ -0,0 +1,285 @@
+#define _GNU_SOURCE         // For fallocate()
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#define CHUNK_BYTES (8 << 20)    // Bytes of records generated and written per chunk
+#define CLUSTER_KEYS 64          // Consecutive keys per cluster of the clustered distribution
+#define DUPLICATE_RUN 4          // Mean copies of a key in the duplicates distribution
+#define PARETO_ALPHA 1.5         // Tail of the skewed distribution's gaps (finite mean, infinite variance)
+#define PARETO_CAP (1 << 20)     // Largest skewed gap, in multiples of the step
+
+typedef unsigned __int128 key128_t;
+
+// Fill in the default generator configuration: a million keys 10 apart, as
+// create_test_file() has always written, on every CPU
+void bss_default_datagen_config(bss_datagen_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->num_elements = 1000000;
+    cfg->step = 10;
+    cfg->key_size = sizeof(uint64_t);
+    cfg->distribution = BSS_DATA_SEQUENTIAL;
+    cfg->seed = 0x9E3779B97F4A7C15ULL;
+}
+
+// State of one generator run, shared by the workers
+typedef struct {
+    const bss_datagen_config_t *cfg;
+    int fd;
+    size_t record_size;
+    size_t chunk_elems;          // Records per chunk (the last chunk may be short)
+    size_t num_chunks;
+    key128_t *chunk_base;        // First key of each chunk
+    uint8_t **buffers;           // One chunk buffer per worker
+    int fill;                    // 0: measure the key span of each chunk, 1: fill and write the chunks
+    atomic_size_t next_chunk;
+    atomic_int failed;
+} datagen_job;
+
+// splitmix64, seeded per chunk so the keys do not depend on the number of threads
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [1, 2 * mean - 1] (mean at least 1)
+static uint64_t uniform_gap(uint64_t *state, uint64_t mean) {
+    return 1 + next_random(state) % (2 * mean - 1);
+}
+
+// Distance from key i to key i + 1. Every distribution averages about step.
+static uint64_t next_gap(const bss_datagen_config_t *cfg, uint64_t i, uint64_t *state) {
+    uint64_t step = cfg->step;
+    if (step == 0) {
+        return 0;
+    }
+
+    switch (cfg->distribution) {
+        case BSS_DATA_RANDOM_GAPS:
+            return uniform_gap(state, step);
+        case BSS_DATA_CLUSTERED:
+            // Runs of consecutive keys, then a jump making up for them
+            if ((i + 1) % CLUSTER_KEYS != 0) {
+                return 1;
+            }
+            return step == 1 ? 1 : uniform_gap(state, CLUSTER_KEYS * step - (CLUSTER_KEYS - 1));
+        case BSS_DATA_DUPLICATES:
+            // Runs of equal keys, geometric with mean DUPLICATE_RUN
+            return next_random(state) % DUPLICATE_RUN ? 0 : DUPLICATE_RUN * step;
+        case BSS_DATA_SKEWED: {
+            // Pareto gaps: mostly small, a few huge
+            double u = ((next_random(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+            double gap = step * (PARETO_ALPHA - 1) / PARETO_ALPHA / pow(u, 1.0 / PARETO_ALPHA);
+            return gap >= (double)step * PARETO_CAP ? step * PARETO_CAP : (uint64_t)gap;
+        }
+        default:
+            return step;
+    }
+}
+
+// Generate (and with job->fill write) chunk c
+static int run_chunk(datagen_job *job, size_t c, uint8_t *buf) {
+    const bss_datagen_config_t *cfg = job->cfg;
+    size_t first = c * job->chunk_elems;
+    size_t count = cfg->num_elements - first < job->chunk_elems ? cfg->num_elements - first : job->chunk_elems;
+    uint64_t state = cfg->seed ^ (c * 0xD1B54A32D192ED03ULL);
+    key128_t key = job->fill ? job->chunk_base[c] : 0;
+    size_t key_size = cfg->key_size;
+    size_t record_size = job->record_size;
+
+    if (!job->fill) {
+        // Only the span of the chunk is needed to place the chunks after it
+        // (up to the last key of the file, not past it)
+        for (size_t i = 0; i < count && first + i + 1 < cfg->num_elements; i++) {
+            key += next_gap(cfg, first + i, &state);
+        }
+        job->chunk_base[c + 1] = key;
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *record = buf + i * record_size;
+        memcpy(record, &key, key_size);   // Little-endian: the low bytes come first
+        if (record_size > key_size) {
+            memset(record + key_size, (int)((first + i) & 0xff), record_size - key_size);
+        }
+        key += next_gap(cfg, first + i, &state);
+    }
+
+    size_t bytes = count * record_size;
+    off_t offset = (off_t)first * record_size;
+    for (size_t done = 0; done < bytes;) {
+        ssize_t ret = pwrite(job->fd, buf + done, bytes - done, offset + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("pwrite");
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+// Pool job: take chunks until none are left
+static void datagen_worker(void *arg, int worker_id) {
+    datagen_job *job = (datagen_job *)arg;
+    for (;;) {
+        size_t c = atomic_fetch_add_explicit(&job->next_chunk, 1, memory_order_relaxed);
+        if (c >= job->num_chunks || atomic_load_explicit(&job->failed, memory_order_relaxed)) {
+            return;
+        }
+        if (run_chunk(job, c, job->fill ? job->buffers[worker_id] : NULL) < 0) {
+            atomic_store(&job->failed, 1);
+            return;
+        }
+    }
+}
+
+// Run one pass over every chunk on the pool. Returns 0 on success, -1 on error.
+static int run_pass(bss_pool_t *pool, datagen_job *job, int fill) {
+    job->fill = fill;
+    atomic_store(&job->next_chunk, 0);
+    bss_pool_run(pool, datagen_worker, job);
+    return atomic_load(&job->failed) ? -1 : 0;
+}
+
+// Write a sorted test file of cfg->num_elements keys (threads fill chunks of
+// CHUNK_BYTES and pwrite them in place). The first key is 0; the distribution
+// picks the gaps after it. Payload bytes repeat the low byte of the record
+// index. With cfg->preallocate the file's blocks are reserved up front.
+// The file depends only on the configuration, not on the number of threads.
+// Returns 0 on success, -1 on error.
+int bss_generate_file(const char *filepath, const bss_datagen_config_t *cfg) {
+    datagen_job job;
+    size_t key_size = cfg->key_size ? cfg->key_size : sizeof(uint64_t);
+    size_t record_size = cfg->record_size ? cfg->record_size : key_size;
+    int ret = -1;
+
+    bss_datagen_config_t resolved = *cfg;
+    resolved.key_size = key_size;
+    if ((key_size != 4 && key_size != 8 && key_size != 16) || record_size < key_size) {
+        fprintf(stderr, "Invalid record layout: %zu byte keys in %zu byte records\n", key_size, record_size);
+        return -1;
+    }
+    if (cfg->num_elements == 0) {
+        fprintf(stderr, "Test file must hold at least one element\n");
+        return -1;
+    }
+    if (cfg->step > UINT64_MAX / (2 * CLUSTER_KEYS * PARETO_CAP) && cfg->distribution != BSS_DATA_SEQUENTIAL) {
+        fprintf(stderr, "Step %llu is too large for a random distribution\n", (unsigned long long)cfg->step);
+        return -1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.cfg = &resolved;
+    job.record_size = record_size;
+    job.chunk_elems = CHUNK_BYTES / record_size ? CHUNK_BYTES / record_size : 1;
+    job.num_chunks = (cfg->num_elements + job.chunk_elems - 1) / job.chunk_elems;
+
+    int num_threads = cfg->num_threads ? cfg->num_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if ((size_t)num_threads > job.num_chunks) {
+        num_threads = job.num_chunks;
+    }
+
+    bss_log(BSS_VERBOSITY_NORMAL, "Creating test file with %zu %s of %zu bytes on %d threads...\n",
+            cfg->num_elements, key_size == record_size ? "keys" : "records", record_size, num_threads);
+
+    job.chunk_base = (key128_t *)calloc(job.num_chunks + 1, sizeof(key128_t));
+    job.buffers = (uint8_t **)calloc(num_threads, sizeof(uint8_t *));
+    if (!job.chunk_base || !job.buffers) {
+        perror("calloc");
+        free(job.chunk_base);
+        free(job.buffers);
+        return -1;
+    }
+    job.fd = -1;
+
+    bss_pool_t *pool = bss_pool_create(num_threads, 0);
+    if (!pool) {
+        goto out;
+    }
+    num_threads = bss_pool_size(pool);
+
+    // Chunk bases (and the last key after them): arithmetic for sequential
+    // keys, a pass over the gaps otherwise
+    if (cfg->distribution == BSS_DATA_SEQUENTIAL) {
+        for (size_t c = 0; c < job.num_chunks; c++) {
+            job.chunk_base[c] = (key128_t)(c * job.chunk_elems) * cfg->step;
+        }
+        job.chunk_base[job.num_chunks] = (key128_t)(cfg->num_elements - 1) * cfg->step;
+    } else if (run_pass(pool, &job, 0) < 0) {
+        goto out;
+    } else {
+        for (size_t c = 0; c < job.num_chunks; c++) {
+            job.chunk_base[c + 1] += job.chunk_base[c];
+        }
+    }
+
+    // The last key is the largest one; it must fit the key width
+    key128_t largest = job.chunk_base[job.num_chunks];
+    key128_t limit = key_size == 4 ? UINT32_MAX : key_size == 8 ? UINT64_MAX : ~(key128_t)0;
+    if (largest > limit) {
+        fprintf(stderr, "Keys up to %.3g do not fit in %zu bytes\n", (double)largest, key_size);
+        goto out;
+    }
+
+    for (int w = 0; w < num_threads; w++) {
+        job.buffers[w] = (uint8_t *)malloc(job.chunk_elems * record_size);
+        if (!job.buffers[w]) {
+            perror("malloc");
+            goto out;
+        }
+    }
+
+    job.fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job.fd < 0) {
+        perror("open");
+        goto out;
+    }
+    off_t file_size = (off_t)cfg->num_elements * record_size;
+    if (cfg->preallocate) {
+        // Reserve the blocks in one go instead of growing the file chunk by chunk
+        if (fallocate(job.fd, 0, 0, file_size) != 0) {
+            if (errno != EOPNOTSUPP) {
+                perror("fallocate");
+                goto out;
+            }
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: The file system cannot preallocate; writing without it\n");
+        }
+    }
+
+    if (run_pass(pool, &job, 1) < 0) {
+        goto out;
+    }
+    ret = 0;
+    bss_log(BSS_VERBOSITY_NORMAL, "Test file created successfully: %s\n", filepath);
+
+out:
+    if (job.fd >= 0 && close(job.fd) != 0 && ret == 0) {
+        perror("close");
+        ret = -1;
+    }
+    if (pool) {
+        bss_pool_destroy(pool);
+    }
+    for (int w = 0; w < num_threads; w++) {
+        free(job.buffers[w]);
+    }
+    free(job.buffers);
+    free(job.chunk_base);
+    return ret;
+}
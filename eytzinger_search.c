@@ -0,0 +1,216 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+
+// Keys per 64-byte cache line; prefetching data[k * EYTZINGER_PREFETCH] pulls
+// in the line holding all descendants of node k three levels further down
+#define EYTZINGER_PREFETCH (64 / sizeof(uint64_t))
+
+// Eytzinger (BFS) layout: node k (1-based) has children 2k and 2k+1. The file
+// starts with one pad element and stores node k at element index k, so the
+// top levels of the implicit search tree share a handful of pages and cache
+// lines, and nodes 8k..8k+7 fill exactly one line of the page-aligned mapping.
+// num_elements below counts the pad: the tree has num_elements - 1 nodes.
+
+// Fill out[1..n] from sorted[0..n-1] by an in-order walk of the implicit tree.
+// The walk is iterative, with a stack of log2(n) pending nodes.
+static void eytzinger_fill(const uint64_t *sorted, uint64_t *out, size_t n) {
+    size_t stack[64];
+    int depth = 0;
+    size_t i = 0;
+    size_t k = 1;
+
+    for (;;) {
+        // Descend the left spine of the current subtree
+        while (k <= n) {
+            stack[depth++] = k;
+            k = 2 * k;
+        }
+        if (depth == 0) {
+            return;
+        }
+        k = stack[--depth];
+        out[k] = sorted[i++];
+        k = 2 * k + 1;
+    }
+}
+
+// Rewrite a file of sorted uint64_t values into Eytzinger layout, one
+// element longer than the source
+int convert_to_eytzinger(const char *src_path, const char *dst_path) {
+    struct stat st;
+    int ret = -1;
+
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd < 0) {
+        perror("open");
+        return -1;
+    }
+
+    if (fstat(src_fd, &st) < 0) {
+        perror("fstat");
+        close(src_fd);
+        return -1;
+    }
+
+    if (st.st_size % sizeof(uint64_t) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Source file is empty or not aligned with uint64_t size\n");
+        close(src_fd);
+        return -1;
+    }
+    size_t num_elements = st.st_size / sizeof(uint64_t);
+    off_t dst_size = st.st_size + sizeof(uint64_t);   // The pad element comes first
+
+    int dst_fd = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (dst_fd < 0) {
+        perror("open");
+        close(src_fd);
+        return -1;
+    }
+
+    if (ftruncate(dst_fd, dst_size) < 0) {
+        perror("ftruncate");
+        goto out_close;
+    }
+
+    uint64_t *sorted = (uint64_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0);
+    if (sorted == MAP_FAILED) {
+        perror("mmap");
+        goto out_close;
+    }
+    madvise(sorted, st.st_size, MADV_SEQUENTIAL);
+
+    uint64_t *out = (uint64_t *)mmap(NULL, dst_size, PROT_READ | PROT_WRITE, MAP_SHARED, dst_fd, 0);
+    if (out == MAP_FAILED) {
+        perror("mmap");
+        munmap(sorted, st.st_size);
+        goto out_close;
+    }
+
+    bss_log(BSS_VERBOSITY_NORMAL, "Converting %zu elements to Eytzinger layout...\n", num_elements);
+    out[0] = 0;
+    eytzinger_fill(sorted, out, num_elements);
+
+    if (msync(out, dst_size, MS_SYNC) < 0) {
+        perror("msync");
+    } else {
+        bss_log(BSS_VERBOSITY_NORMAL, "Eytzinger file created successfully: %s\n", dst_path);
+        ret = 0;
+    }
+
+    munmap(out, dst_size);
+    munmap(sorted, st.st_size);
+
+out_close:
+    close(dst_fd);
+    close(src_fd);
+    if (ret < 0) {
+        unlink(dst_path);
+    }
+    return ret;
+}
+
+// Branchless search over memory-mapped Eytzinger data. On a hit, *index is the
+// element index within the Eytzinger file, which is the node number (not the
+// rank in sorted order).
+int eytzinger_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                     int64_t *index, int *comparisons) {
+    size_t nodes = num_elements - 1;
+    size_t k = 1;
+    *comparisons = 0;
+
+    while (k <= nodes) {
+        __builtin_prefetch(data + k * EYTZINGER_PREFETCH);
+        k = 2 * k + (data[k] < target);
+        (*comparisons)++;
+    }
+
+    // Undo the trailing right turns to get the lower bound node (0 if none)
+    k >>= __builtin_ffsll(~k);
+
+    if (k != 0 && data[k] == target) {
+        *index = k;
+        return 1;
+    }
+    return 0;
+}
+
+// Lower bound over memory-mapped Eytzinger data: the element index within the
+// Eytzinger file of the smallest value >= target, or num_elements if none.
+// Unlike on a sorted file, the index is not the value's rank.
+size_t eytzinger_lower_bound(const uint64_t *data, size_t num_elements, uint64_t target) {
+    size_t nodes = num_elements - 1;
+    size_t k = 1;
+
+    while (k <= nodes) {
+        __builtin_prefetch(data + k * EYTZINGER_PREFETCH);
+        k = 2 * k + (data[k] < target);
+    }
+    k >>= __builtin_ffsll(~k);
+    return k != 0 ? k : num_elements;
+}
+
+// Count the copies of target in an Eytzinger file, starting from the element
+// index first of the smallest one (its lower bound). The walk follows
+// in-order successors, so it costs O(copies + log n). *last receives the
+// element index of the largest copy.
+size_t eytzinger_run(const uint64_t *data, size_t num_elements, size_t first, uint64_t target, size_t *last) {
+    size_t nodes = num_elements - 1;
+    size_t k = first;
+    size_t count = 0;
+
+    while (k != 0 && data[k] == target) {
+        *last = k;
+        count++;
+
+        // Successor: the leftmost node of the right subtree, or else the
+        // nearest ancestor whose left subtree holds k
+        if (2 * k + 1 <= nodes) {
+            k = 2 * k + 1;
+            while (2 * k <= nodes) {
+                k = 2 * k;
+            }
+        } else {
+            k >>= __builtin_ffsll(~k);
+        }
+    }
+    return count;
+}
+
+// Search for a target uint64_t in an Eytzinger-layout file using mmap. Fills
+// *result without printing anything. Returns 0 on success, -1 on error.
+int eytzinger_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open and map the file
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_EYTZINGER;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
+    }
+
+    result->found = eytzinger_lookup(handle->data, handle->num_elements, target, &result->index, &result->probes);
+    result->bytes_read = (uint64_t)result->probes * sizeof(uint64_t);   // One value per probe
+
+    // Clean up
+    bss_close(handle);
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
+    return 0;
+}
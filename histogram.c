@@ -0,0 +1,96 @@
+#include "bssearch_lib.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define SUB_COUNT (1ULL << BSS_HISTOGRAM_SUB_BITS)   // Exact values, and twice the buckets per power of two
+#define HALF_COUNT (SUB_COUNT / 2)
+
+// Bucket of a value: the value itself below SUB_COUNT, otherwise its top
+// BSS_HISTOGRAM_SUB_BITS bits, offset by the number of bits dropped
+static size_t bucket_of(uint64_t value) {
+    if (value < SUB_COUNT) {
+        return value;
+    }
+    int shift = 64 - __builtin_clzll(value) - BSS_HISTOGRAM_SUB_BITS;
+    return shift * HALF_COUNT + (value >> shift);
+}
+
+// Largest value that lands in a bucket
+static uint64_t bucket_limit(size_t bucket) {
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    int shift = bucket / HALF_COUNT - 1;
+    uint64_t first = (uint64_t)(bucket - shift * HALF_COUNT) << shift;
+    return first + ((1ULL << shift) - 1);
+}
+
+void bss_histogram_init(bss_histogram_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void bss_histogram_record(bss_histogram_t *hist, uint64_t value) {
+    hist->counts[bucket_of(value)]++;
+    hist->total++;
+    hist->min = value < hist->min ? value : hist->min;
+    hist->max = value > hist->max ? value : hist->max;
+    hist->sum += (double)value;
+    hist->sum_squares += (double)value * (double)value;
+}
+
+// Add the values of src to dst (e.g. histograms of several threads)
+void bss_histogram_merge(bss_histogram_t *dst, const bss_histogram_t *src) {
+    for (size_t i = 0; i < BSS_HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->min = src->min < dst->min ? src->min : dst->min;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+    dst->sum += src->sum;
+    dst->sum_squares += src->sum_squares;
+}
+
+// Value at or below which percentile percent of the recorded values lie
+// (the upper end of its bucket, never above the largest value recorded)
+uint64_t bss_histogram_percentile(const bss_histogram_t *hist, double percentile) {
+    if (hist->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * hist->total);
+    rank = rank == 0 ? 1 : rank > hist->total ? hist->total : rank;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BSS_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t limit = bucket_limit(i);
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// Summarize a histogram; scale converts recorded values to the unit of the
+// statistics (e.g. 1e-6 for nanoseconds to milliseconds)
+void bss_histogram_stats(const bss_histogram_t *hist, double scale, search_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (hist->total == 0) {
+        return;
+    }
+
+    double mean = hist->sum / hist->total;
+    double variance = hist->sum_squares / hist->total - mean * mean;
+    stats->min = hist->min * scale;
+    stats->max = hist->max * scale;
+    stats->avg = mean * scale;
+    stats->median = bss_histogram_percentile(hist, 50) * scale;
+    stats->p90 = bss_histogram_percentile(hist, 90) * scale;
+    stats->p95 = bss_histogram_percentile(hist, 95) * scale;
+    stats->p99 = bss_histogram_percentile(hist, 99) * scale;
+    stats->p999 = bss_histogram_percentile(hist, 99.9) * scale;
+    stats->p9999 = bss_histogram_percentile(hist, 99.99) * scale;
+    stats->std_dev = variance > 0 ? sqrt(variance) * scale : 0;
+    stats->iterations = hist->total;
+}
@@ -0,0 +1,293 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define INTERP_LINEAR 16                    // Ranges this small finish with a linear scan
+#define MODEL_MAGIC 0x3130414c50535342ULL   // "BSSPLA01"
+#define MODEL_INITIAL_SEGMENTS 64
+
+// Header of the sidecar model file, followed by num_segments segments
+typedef struct {
+    uint64_t magic;
+    uint64_t error;
+    uint64_t num_elements;
+    uint64_t num_segments;
+} learned_model_header;
+
+// Interpolation search for the first index whose value is >= target. Each
+// step probes where the target would sit if the values of the range were
+// evenly spread; when a probe fails to halve the range a bisection step
+// follows, so skewed data costs at most twice the probes of binary search.
+size_t interpolation_lower_bound(const uint64_t *data, size_t num_elements, uint64_t target, int *probes) {
+    size_t lo = 0;
+    size_t hi = num_elements;   // The bound lies in [lo, hi]
+
+    while (hi - lo > INTERP_LINEAR) {
+        uint64_t first = data[lo];
+        uint64_t last = data[hi - 1];
+        (*probes)++;
+        if (target <= first) {
+            return lo;
+        }
+        if (target > last) {
+            return hi;
+        }
+
+        size_t span = hi - lo;
+        size_t pos = lo + (size_t)((unsigned __int128)(target - first) * (span - 1) / (last - first));
+        (*probes)++;
+        if (data[pos] < target) {
+            lo = pos + 1;
+        } else {
+            hi = pos;
+        }
+
+        if (hi - lo > span / 2) {
+            size_t mid = lo + (hi - lo) / 2;
+            (*probes)++;
+            if (data[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    (*probes)++;
+    return lo + linear_lower_bound(data + lo, hi - lo, target);
+}
+
+// Exact-match interpolation search over memory-mapped sorted data
+int interpolation_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                         int64_t *index, int *probes) {
+    *probes = 0;
+    size_t pos = interpolation_lower_bound(data, num_elements, target, probes);
+    if (pos < num_elements && data[pos] == target) {
+        *index = pos;
+        return 1;
+    }
+    return 0;
+}
+
+// Append a segment, growing the array as needed
+static int model_append(bss_learned_model *model, size_t *capacity, uint64_t first_key, double slope,
+                        double intercept) {
+    if (model->num_segments == *capacity) {
+        size_t new_capacity = *capacity ? 2 * *capacity : MODEL_INITIAL_SEGMENTS;
+        bss_model_segment *segments = (bss_model_segment *)realloc(model->segments,
+                                                                   new_capacity * sizeof(bss_model_segment));
+        if (!segments) {
+            perror("realloc");
+            return -1;
+        }
+        model->segments = segments;
+        *capacity = new_capacity;
+    }
+    bss_model_segment *seg = &model->segments[model->num_segments++];
+    seg->first_key = first_key;
+    seg->slope = slope;
+    seg->intercept = intercept;
+    return 0;
+}
+
+// Fit the file with as few linear segments as the greedy shrinking cone finds.
+// A segment starts at the first occurrence of a key and keeps the range of
+// slopes that predict every later first occurrence within the error. It ends
+// when that range becomes empty.
+static int learned_model_build(bss_learned_model *model, const uint64_t *data, size_t num_elements) {
+    size_t capacity = 0;
+    double error = (double)model->error;
+
+    for (size_t i = 0; i < num_elements; ) {
+        uint64_t first_key = data[i];
+        double origin = (double)i;
+        double slope_lo = 0.0;
+        double slope_hi = INFINITY;
+
+        size_t j;
+        for (j = i + 1; j < num_elements; j++) {
+            if (data[j] == data[j - 1]) {
+                continue;   // Lower bounds only land on first occurrences
+            }
+            double dx = (double)(data[j] - first_key);
+            double lo = ((double)j - error - origin) / dx;
+            double hi = ((double)j + error - origin) / dx;
+            if (lo > slope_hi || hi < slope_lo) {
+                break;
+            }
+            slope_lo = lo > slope_lo ? lo : slope_lo;
+            slope_hi = hi < slope_hi ? hi : slope_hi;
+        }
+
+        double slope = isinf(slope_hi) ? 0.0 : (slope_lo + slope_hi) / 2;
+        if (model_append(model, &capacity, first_key, slope, origin) < 0) {
+            return -1;
+        }
+        i = j;
+    }
+    return 0;
+}
+
+// Load the sidecar model if it exists, matches the data file and is not older than it
+static int learned_model_load(bss_learned_model *model, const char *sidecar, const struct stat *data_st,
+                              size_t num_elements) {
+    learned_model_header header;
+
+    int fd = sidecar_open(sidecar, data_st, &header, sizeof(header));
+    if (fd < 0) {
+        return -1;
+    }
+    if (header.magic != MODEL_MAGIC || header.error != model->error ||
+        header.num_elements != num_elements || header.num_segments == 0 ||
+        header.num_segments > num_elements) {
+        close(fd);
+        return -1;
+    }
+
+    size_t bytes = header.num_segments * sizeof(bss_model_segment);
+    model->segments = (bss_model_segment *)malloc(bytes);
+    if (!model->segments) {
+        perror("malloc");
+        close(fd);
+        return -1;
+    }
+    if (sidecar_read(fd, sizeof(header), model->segments, bytes) < 0) {
+        learned_model_free(model);
+        return -1;
+    }
+    model->num_segments = header.num_segments;
+    return 0;
+}
+
+// Store the model next to the data file
+static int learned_model_store(const bss_learned_model *model, const char *sidecar, size_t num_elements) {
+    learned_model_header header = { MODEL_MAGIC, model->error, num_elements, model->num_segments };
+    return sidecar_store(sidecar, &header, sizeof(header), model->segments,
+                         model->num_segments * sizeof(bss_model_segment));
+}
+
+// Fit (or load from the <filepath>.pla sidecar) a piecewise-linear model
+// that predicts the position of every key within error elements
+int learned_model_open(bss_learned_model *model, const char *filepath, int fd, const uint64_t *data,
+                       size_t num_elements, size_t error, int use_sidecar) {
+    struct stat st;
+    char sidecar[BSS_SIDECAR_PATH];
+
+    model->segments = NULL;
+    model->num_segments = 0;
+    model->error = error;
+
+    if (use_sidecar) {
+        snprintf(sidecar, sizeof(sidecar), "%s.pla", filepath);
+        if (fstat(fd, &st) == 0 && learned_model_load(model, sidecar, &st, num_elements) == 0) {
+            bss_log(BSS_VERBOSITY_NORMAL, "Loaded learned model with %zu segments from %s\n",
+                    model->num_segments, sidecar);
+            return 0;
+        }
+    }
+
+    if (learned_model_build(model, data, num_elements) < 0) {
+        learned_model_free(model);
+        return -1;
+    }
+    bss_log(BSS_VERBOSITY_NORMAL, "Built learned model with %zu segments (error bound %zu)\n",
+            model->num_segments, error);
+
+    if (use_sidecar && learned_model_store(model, sidecar, num_elements) == 0) {
+        bss_log(BSS_VERBOSITY_NORMAL, "Saved learned model to %s\n", sidecar);
+    }
+    return 0;
+}
+
+void learned_model_free(bss_learned_model *model) {
+    free(model->segments);
+    model->segments = NULL;
+    model->num_segments = 0;
+}
+
+// Lower bound through the model: the segment of the target predicts its
+// position, and the kernel searches the error window around it. Should the
+// window miss the bound (an absent key after a run of duplicates, or float
+// rounding), it is widened exponentially towards the bound.
+size_t learned_lower_bound(const bss_learned_model *model, bss_lower_bound_fn lower_bound, const uint64_t *data,
+                           size_t num_elements, uint64_t target) {
+    // Last segment whose first key is <= target
+    size_t left = 0;
+    size_t right = model->num_segments;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (model->segments[mid].first_key <= target) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    if (left == 0) {
+        return 0;
+    }
+
+    const bss_model_segment *seg = &model->segments[left - 1];
+    double predicted = seg->intercept + seg->slope * (double)(target - seg->first_key);
+    size_t guess = predicted <= 0 ? 0 : predicted >= (double)num_elements ? num_elements : (size_t)predicted;
+
+    size_t window = model->error + 1;
+    size_t lo = guess > window ? guess - window : 0;
+    size_t hi = num_elements - guess > window ? guess + window : num_elements;   // The bound should lie in [lo, hi]
+
+    for (size_t step = window; lo > 0 && data[lo - 1] >= target; step *= 2) {
+        hi = lo - 1;
+        lo = lo > step ? lo - step : 0;
+    }
+    for (size_t step = window; hi < num_elements && data[hi] < target; step *= 2) {
+        lo = hi + 1;
+        hi = num_elements - hi > step ? hi + step : num_elements;
+    }
+    return lo + lower_bound(data + lo, hi - lo, target);
+}
+
+// Exact-match lookup through the model
+int learned_lookup(const bss_learned_model *model, bss_lower_bound_fn lower_bound, const uint64_t *data,
+                   size_t num_elements, uint64_t target, int64_t *index) {
+    size_t pos = learned_lower_bound(model, lower_bound, data, num_elements, target);
+    if (pos < num_elements && data[pos] == target) {
+        *index = pos;
+        return 1;
+    }
+    return 0;
+}
+
+// Search for a target uint64_t in a file using interpolation search over
+// mmap. Fills *result without printing anything. Returns 0 on success, -1 on error.
+int interpolation_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open and map the file
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_INTERPOLATION;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
+    }
+
+    result->found = interpolation_lookup(handle->data, handle->num_elements, target, &result->index,
+                                         &result->probes);
+    result->bytes_read = (uint64_t)result->probes * sizeof(uint64_t);   // One value per probe
+
+    // Clean up
+    bss_close(handle);
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
+    return 0;
+}
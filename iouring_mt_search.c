@@ -0,0 +1,363 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define MT_QUEUE_SIZE 1024     // Requests the shared queue holds (power of two)
+#define MT_MAX_BATCH 64        // Requests a worker takes off the queue at once
+#define MT_SPINS 4096          // Spin this many times before parking on a futex
+#define CACHE_LINE_SIZE 64
+
+// Lookups submitted together; the submitter waits for all of them
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_int remaining;   // Requests not answered yet
+    atomic_int found;          // Requests whose target was found
+    atomic_int failed;         // Set when a request hit an I/O error
+} mt_group;
+
+// One lookup travelling through the queue
+typedef struct {
+    uint64_t target;
+    int64_t *index;            // Receives the element index, or -1 if absent
+    size_t *pos;               // Receives the lower bound instead (bound requests), or NULL
+    mt_group *group;
+} mt_request;
+
+// Cell of the bounded MPMC queue (D. Vyukov's sequence-numbered ring)
+typedef struct {
+    atomic_size_t seq;
+    mt_request *req;
+} mt_cell;
+
+// Multi-threaded io_uring engine: every worker owns a ring and pulls lookups
+// from one lock-free queue shared by all submitting threads
+struct bss_iouring_mt_ctx {
+    bss_pool_t *pool;
+    int num_workers;
+    bss_iouring_ctx **rings;   // One ring per worker
+    bss_block_cache **caches;  // One block cache per worker, or NULL for single-value reads
+    int fd;
+    size_t num_elements;
+    mt_cell cells[MT_QUEUE_SIZE];
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_int work_seq;   // Bumped to wake parked workers
+    atomic_int sleepers;       // Workers parked on work_seq
+    atomic_int stop;
+};
+
+static int queue_push(bss_iouring_mt_ctx *ctx, mt_request *req) {
+    size_t pos = atomic_load_explicit(&ctx->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        mt_cell *cell = &ctx->cells[pos & (MT_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ctx->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->req = req;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // Full
+        } else {
+            pos = atomic_load_explicit(&ctx->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static mt_request *queue_pop(bss_iouring_mt_ctx *ctx) {
+    size_t pos = atomic_load_explicit(&ctx->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        mt_cell *cell = &ctx->cells[pos & (MT_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ctx->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                mt_request *req = cell->req;
+                atomic_store_explicit(&cell->seq, pos + MT_QUEUE_SIZE, memory_order_release);
+                return req;
+            }
+        } else if (diff < 0) {
+            return NULL;   // Empty
+        } else {
+            pos = atomic_load_explicit(&ctx->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Wait for the next request; NULL once the engine is stopping
+static mt_request *queue_wait(bss_iouring_mt_ctx *ctx) {
+    for (int spins = 0; ; spins++) {
+        mt_request *req = queue_pop(ctx);
+        if (req || atomic_load_explicit(&ctx->stop, memory_order_acquire)) {
+            return req;
+        }
+        if (spins < MT_SPINS) {
+            continue;
+        }
+
+        // Announce the sleep, then look again so a push in between is not missed
+        atomic_fetch_add(&ctx->sleepers, 1);
+        int seq = atomic_load(&ctx->work_seq);
+        req = queue_pop(ctx);
+        if (!req && !atomic_load(&ctx->stop)) {
+            bss_futex_wait(&ctx->work_seq, seq);
+        }
+        atomic_fetch_sub(&ctx->sleepers, 1);
+        if (req) {
+            return req;
+        }
+        spins = 0;
+    }
+}
+
+// Answer one request and wake its submitter when the group is complete.
+// The group may be gone as soon as remaining drops to zero, so the wake-up
+// does not look at it first; a stray wake-up is harmless.
+static void complete_request(mt_request *req, int found) {
+    mt_group *group = req->group;
+    if (found < 0) {
+        atomic_store(&group->failed, 1);
+    } else {
+        if (!found && req->index) {
+            *req->index = -1;
+        }
+        atomic_fetch_add_explicit(&group->found, found, memory_order_relaxed);
+    }
+    if (atomic_fetch_sub(&group->remaining, 1) == 1) {
+        bss_futex_wake(&group->remaining, 1);
+    }
+}
+
+// Answer a bound request on this worker's ring
+static void serve_bound(bss_iouring_mt_ctx *ctx, bss_iouring_ctx *ring, mt_request *req) {
+    int reads;
+    complete_request(req, iouring_lower_bound(ring, ctx->fd, ctx->num_elements, req->target, req->pos, &reads));
+}
+
+// Worker job: serve requests from the queue on this worker's ring until stopped
+static void mt_worker(void *arg, int worker_id) {
+    bss_iouring_mt_ctx *ctx = (bss_iouring_mt_ctx *)arg;
+    bss_iouring_ctx *ring = ctx->rings[worker_id];
+    mt_request *reqs[MT_MAX_BATCH];
+    uint64_t targets[MT_MAX_BATCH];
+    int64_t indices[MT_MAX_BATCH];
+
+    // The engine is up once any worker runs
+    bss_pool_signal(ctx->pool);
+
+    for (;;) {
+        int count = 0;
+        reqs[count] = queue_wait(ctx);
+        if (!reqs[count]) {
+            return;
+        }
+        if (reqs[count]->pos) {
+            serve_bound(ctx, ring, reqs[count]);
+            continue;
+        }
+        count++;
+
+        if (ctx->caches) {
+            // Block reads go through this worker's cache one lookup at a time
+            int reads;
+            complete_request(reqs[0], iouring_lookup(ring, ctx->fd, ctx->num_elements, reqs[0]->target,
+                                                     reqs[0]->index, &reads));
+            continue;
+        }
+
+        // Interleave every lookup that is already queued over this ring
+        while (count < MT_MAX_BATCH && (reqs[count] = queue_pop(ctx)) != NULL) {
+            if (reqs[count]->pos) {
+                serve_bound(ctx, ring, reqs[count]);
+                continue;
+            }
+            count++;
+        }
+        for (int i = 0; i < count; i++) {
+            targets[i] = reqs[i]->target;
+        }
+        uint64_t total_reads;
+        int ret = iouring_lookup_batch(ring, ctx->fd, ctx->num_elements, NULL, targets, count, indices,
+                                       &total_reads);
+        for (int i = 0; i < count; i++) {
+            *reqs[i]->index = indices[i];
+            complete_request(reqs[i], ret < 0 ? -1 : indices[i] >= 0);
+        }
+    }
+}
+
+// Start num_workers workers, each with its own ring (and, with block_size
+// set, its own block cache of cache_blocks blocks). Returns NULL on error.
+bss_iouring_mt_ctx *iouring_mt_create(const bss_options_t *opts, int fd, int direct_fd, size_t num_elements,
+                                      bss_lower_bound_fn lower_bound, size_t block_size, size_t cache_blocks) {
+    bss_iouring_mt_ctx *ctx = (bss_iouring_mt_ctx *)calloc(1, sizeof(bss_iouring_mt_ctx));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+    ctx->num_workers = opts->num_threads;
+    ctx->fd = fd;
+    ctx->num_elements = num_elements;
+    for (size_t i = 0; i < MT_QUEUE_SIZE; i++) {
+        atomic_init(&ctx->cells[i].seq, i);
+    }
+
+    ctx->rings = (bss_iouring_ctx **)calloc(ctx->num_workers, sizeof(bss_iouring_ctx *));
+    if (block_size) {
+        ctx->caches = (bss_block_cache **)calloc(ctx->num_workers, sizeof(bss_block_cache *));
+    }
+    if (!ctx->rings || (block_size && !ctx->caches)) {
+        perror("calloc");
+        iouring_mt_destroy(ctx);
+        return NULL;
+    }
+
+    for (int i = 0; i < ctx->num_workers; i++) {
+        if (block_size) {
+            ctx->caches[i] = block_cache_create(block_size, cache_blocks);
+            if (!ctx->caches[i]) {
+                iouring_mt_destroy(ctx);
+                return NULL;
+            }
+        }
+        ctx->rings[i] = iouring_ctx_create(opts, block_size ? ctx->caches[i] : NULL, lower_bound, direct_fd);
+        if (!ctx->rings[i]) {
+            iouring_mt_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    ctx->pool = bss_pool_create(ctx->num_workers, opts->pin_threads);
+    if (!ctx->pool) {
+        iouring_mt_destroy(ctx);
+        return NULL;
+    }
+
+    // The serving job runs until iouring_mt_destroy() stops it
+    bss_pool_run_any(ctx->pool, mt_worker, ctx);
+    return ctx;
+}
+
+// Stop the workers and release the rings
+void iouring_mt_destroy(bss_iouring_mt_ctx *ctx) {
+    if (ctx->pool) {
+        atomic_store(&ctx->stop, 1);
+        atomic_fetch_add(&ctx->work_seq, 1);
+        bss_futex_wake(&ctx->work_seq, INT_MAX);
+        bss_pool_quiesce(ctx->pool);
+        bss_pool_destroy(ctx->pool);
+    }
+    for (int i = 0; ctx->rings && i < ctx->num_workers; i++) {
+        if (ctx->rings[i]) {
+            iouring_ctx_destroy(ctx->rings[i]);
+        }
+    }
+    for (int i = 0; ctx->caches && i < ctx->num_workers; i++) {
+        block_cache_destroy(ctx->caches[i]);
+    }
+    free(ctx->rings);
+    free(ctx->caches);
+    free(ctx);
+}
+
+// Add the reads and block cache outcomes of every worker's ring to *counters.
+// Workers keep counting meanwhile, so the sum is a snapshot.
+void iouring_mt_add_counters(const bss_iouring_mt_ctx *ctx, bss_counters_t *counters) {
+    for (int i = 0; i < ctx->num_workers; i++) {
+        iouring_add_counters(ctx->rings[i], counters);
+    }
+}
+
+// Queue a request, waking a parked worker
+static void submit_request(bss_iouring_mt_ctx *ctx, mt_request *req) {
+    while (!queue_push(ctx, req)) {
+        sched_yield();   // Queue full: let the workers catch up
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ctx->sleepers) > 0) {
+        atomic_fetch_add(&ctx->work_seq, 1);
+        bss_futex_wake(&ctx->work_seq, 1);
+    }
+}
+
+// Wait until every request of the group is answered
+static void wait_group(mt_group *group) {
+    for (int spins = 0; ; spins++) {
+        int remaining = atomic_load_explicit(&group->remaining, memory_order_acquire);
+        if (remaining == 0) {
+            return;
+        }
+        if (spins >= MT_SPINS) {
+            bss_futex_wait(&group->remaining, remaining);
+        }
+    }
+}
+
+// Look up num_targets values; safe to call from several threads at once.
+// indices[i] receives the element index of targets[i], or -1 if absent.
+// Returns the number of values found, -1 on error.
+int iouring_mt_lookup_batch(bss_iouring_mt_ctx *ctx, const uint64_t *targets, size_t num_targets, int64_t *indices) {
+    mt_request *reqs = (mt_request *)malloc(num_targets * sizeof(mt_request));
+    if (!reqs) {
+        perror("malloc");
+        return -1;
+    }
+
+    mt_group group;
+    atomic_init(&group.remaining, (int)num_targets);
+    atomic_init(&group.found, 0);
+    atomic_init(&group.failed, 0);
+    for (size_t i = 0; i < num_targets; i++) {
+        reqs[i].target = targets[i];
+        reqs[i].index = &indices[i];
+        reqs[i].pos = NULL;
+        reqs[i].group = &group;
+        submit_request(ctx, &reqs[i]);
+    }
+
+    wait_group(&group);
+    free(reqs);
+    return atomic_load(&group.failed) ? -1 : atomic_load(&group.found);
+}
+
+// Look up a single value; safe to call from several threads at once
+int iouring_mt_lookup(bss_iouring_mt_ctx *ctx, uint64_t target, int64_t *index) {
+    mt_request req;
+    mt_group group;
+    atomic_init(&group.remaining, 1);
+    atomic_init(&group.found, 0);
+    atomic_init(&group.failed, 0);
+    req.target = target;
+    req.index = index;
+    req.pos = NULL;
+    req.group = &group;
+
+    submit_request(ctx, &req);
+    wait_group(&group);
+    return atomic_load(&group.failed) ? -1 : atomic_load(&group.found);
+}
+
+// Lower bound of a single value; safe to call from several threads at once
+int iouring_mt_lower_bound(bss_iouring_mt_ctx *ctx, uint64_t target, size_t *pos) {
+    mt_request req;
+    mt_group group;
+    atomic_init(&group.remaining, 1);
+    atomic_init(&group.found, 0);
+    atomic_init(&group.failed, 0);
+    req.target = target;
+    req.index = NULL;
+    req.pos = pos;
+    req.group = &group;
+
+    submit_request(ctx, &req);
+    wait_group(&group);
+    return atomic_load(&group.failed) ? -1 : 0;
+}
@@ -1,4 +1,4 @@
-#include "bssearch_lib.h"
+#include "bssearch_internal.h"
 #include <liburing.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,371 +11,1495 @@
 #include <inttypes.h>
 #include <sys/uio.h>         // For struct iovec
 #include <linux/fs.h>        // For RWF_* flags
+#include <pthread.h>
 
-#define QUEUE_DEPTH 64       // How many operations we can queue at once
+#define QUEUE_DEPTH 64       // How many reads a single lookup may queue at once
 #define PARALLEL_READS 4     // Number of speculative reads to perform
-#define BATCH_SIZE PARALLEL_READS  // Process this many completions at once
 #define BUFFER_SIZE (sizeof(uint64_t))
-#define READAHEAD_THRESHOLD 512  // When range is smaller than this many elements, use readahead
-#define READAHEAD_SIZE (READAHEAD_THRESHOLD * sizeof(uint64_t)) // Size in bytes to readahead
-
-// When range is smaller than this, use linear search instead of continuing binary search
-// This threshold is chosen based on the tradeoff between:
-// - Cost of I/O operations (higher cost = higher threshold is better)
-// - Cost of in-memory scanning (higher cost = lower threshold is better)
-// - Cache line size considerations (typically 64 bytes)
-// For uint64_t values (8 bytes each), 32 elements = 256 bytes = 4 cache lines
-// Linear search is faster for small ranges because it:
-// 1. Reduces the number of I/O operations by reading all data at once
-// 2. Takes advantage of sequential memory access patterns
-// 3. Avoids the binary search overhead when the range is small
-#define LINEAR_SEARCH_THRESHOLD 0
-
 typedef struct {
     off_t offset;           // File offset for this read
     uint64_t value;         // The uint64_t value read
     int index;              // Which search position this represents
     int valid;              // Whether a valid value was read
+    void *owner;            // Lookup this read belongs to (batched mode only)
+    unsigned round;         // Round that issued this read (single-target mode only)
+    int slot;               // Block cache slot read into, or -1 for a single value
+    size_t count;           // Values covered by the read
 } read_data;
 
-// Binary search for a target uint64_t in a file of sorted uint64_t values
-int binary_search_uint64(const char *filepath, uint64_t target, int use_sqpoll, int use_buffers, int use_readahead) {
+#define BATCH_QUEUE_DEPTH 256    // Ring size (shared by single and batched searches)
+#define BATCH_MAX_ACTIVE (BATCH_QUEUE_DEPTH / PARALLEL_READS)  // Lookups in flight at once
+#define SINGLE_BUF_INDEX 0       // Registered buffer holding the single-target reads
+#define BATCH_BUF_INDEX 1        // Registered buffer holding the batch lookup table
+#define CACHE_BUF_INDEX 2        // Registered buffer holding the block cache
+#define SQPOLL_IDLE_MS 2000      // Default idle time before the SQPOLL thread sleeps
+#define SCAN_READ_BYTES (256 * 1024)  // Bytes per read of a range scan (a multiple of BSS_DIRECT_ALIGNMENT)
+#define SCAN_CHAIN_READS 4       // Linked reads per chain of a range scan
+#define SCAN_CHAINS 2            // Chains of a range scan in flight at once
+#define BLOCK_BATCH_READS QUEUE_DEPTH  // Index block reads of a batched search in flight at once
+
+// State of one target in a batched search
+typedef struct {
+    read_data reads[PARALLEL_READS];  // Reads of the current round
+    uint64_t target;        // Value being searched
+    size_t target_idx;      // Position of this target in the caller's array
+    off_t lo;               // Current search boundaries (element indices)
+    off_t hi;
+    int pending;            // Reads of the current round still in flight
+    int active_reads;       // Reads issued in the current round
+} batch_lookup;
+
+// Spread up to count probe positions evenly over [lo, hi], in increasing
+// order. A range of at most count elements is probed in full.
+static int spread_probes(off_t lo, off_t hi, int count, off_t *pos) {
+    off_t n = hi - lo + 1;
+    if (n <= 0) {
+        return 0;
+    }
+    if (n <= count) {
+        for (int i = 0; i < n; i++) {
+            pos[i] = lo + i;
+        }
+        return n;
+    }
+    for (int i = 0; i < count; i++) {
+        pos[i] = lo + n * (i + 1) / (count + 1);
+    }
+    return count;
+}
+
+// Choose the probe positions of one round over [lo, hi], in increasing order.
+// fanout 0 keeps the classic heuristic: PARALLEL_READS probes while the
+// range is wide, a single one once it is small. With speculate set, the probes
+// of the next round are issued along with them for every possible outcome:
+// fanout more probes inside each of the gaps the first level leaves.
+static int plan_probes(off_t lo, off_t hi, int fanout, int speculate, off_t *pos) {
+    int width = fanout;
+    if (width == 0) {
+        width = (hi - lo > PARALLEL_READS * 100) ? PARALLEL_READS : 1;
+    }
+    if (!speculate) {
+        return spread_probes(lo, hi, width, pos);
+    }
+
+    off_t level1[QUEUE_DEPTH];
+    int num_level1 = spread_probes(lo, hi, width, level1);
+    int count = 0;
+    off_t gap_lo = lo;
+    for (int g = 0; g <= num_level1; g++) {
+        off_t gap_hi = g < num_level1 ? level1[g] - 1 : hi;
+        count += spread_probes(gap_lo, gap_hi, width, pos + count);
+        if (g < num_level1) {
+            pos[count++] = level1[g];
+            gap_lo = level1[g] + 1;
+        }
+    }
+    return count;
+}
+
+// Choose the probe positions for the next round of batched reads over [lo, hi].
+// Returns the number of reads to issue.
+static int plan_reads(off_t lo, off_t hi, read_data *reads) {
+    off_t pos[PARALLEL_READS];
+    int active_reads = plan_probes(lo, hi, 0, 0, pos);
+
+    for (int i = 0; i < active_reads; i++) {
+        reads[i].offset = pos[i] * sizeof(uint64_t);
+        reads[i].index = i;
+        reads[i].valid = 0;
+    }
+
+    return active_reads;
+}
+
+// Narrow [lo, hi] using the values returned by a round of reads.
+// Returns 1 and sets *found_offset if one of the reads hit the target.
+static int narrow_range(const read_data *reads, int active_reads, uint64_t target,
+                        off_t *lo, off_t *hi, off_t *found_offset) {
+    off_t new_lo = *lo;
+    off_t new_hi = *hi;
+
+    for (int i = 0; i < active_reads; i++) {
+        if (!reads[i].valid) continue;
+
+        off_t elem_idx = reads[i].offset / sizeof(uint64_t);
+
+        if (reads[i].value == target) {
+            // Found it!
+            *found_offset = reads[i].offset;
+            return 1;
+        }
+
+        if (reads[i].value < target) {
+            // Target is in the upper half
+            if (elem_idx + 1 > new_lo) {
+                new_lo = elem_idx + 1;
+            }
+        } else {
+            // Target is in the lower half
+            if (elem_idx - 1 < new_hi) {
+                new_hi = elem_idx - 1;
+            }
+        }
+    }
+
+    *lo = new_lo;
+    *hi = new_hi;
+    return 0;
+}
+
+// io_uring engine state kept alive by a search handle
+struct bss_iouring_ctx {
     struct io_uring ring;
-    struct io_uring_sqe *sqe;
-    struct io_uring_cqe *cqe;
-    read_data reads[PARALLEL_READS];
-    int ret, found = 0;
-    off_t target_offset = -1;
-    struct stat st;
-    uint64_t start_time, end_time;
-    int total_reads = 0;
-    int buffers_registered = 0;  // Track if buffers are registered
-    
-    // Open the file
-    int fd = open(filepath, O_RDONLY);
-    if (fd < 0) {
-        perror("open");
-        return -1;
+    read_data reads[2 * QUEUE_DEPTH];         // Read buffers of the single-target search, one half per round
+    batch_lookup lookups[BATCH_MAX_ACTIVE];   // Lookup slots of the batched search
+    int fanout;                               // Probes per single-target round (0 = adaptive)
+    int speculate;                            // Issue the next round's probes along with the current ones
+    unsigned round;                           // Single-target rounds issued so far
+    int stale[2];                             // Reads of finished rounds still in flight, per half of reads
+    int stale_other;                          // Reads of failed record, block and batch searches still in flight
+    bss_block_cache *cache;                   // Block cache of the handle, or NULL for single-value reads
+    bss_lower_bound_fn lower_bound;           // Kernel searching cached blocks
+    uint64_t bytes_read;                      // Bytes requested by single-target lookups
+    uint64_t io_requests;                     // Reads prepared on the ring, by every kind of search
+    uint64_t io_bytes;                        // Bytes those reads asked for
+    uint64_t cache_hits;                      // Probes whose block was already cached (or on its way)
+    uint64_t cache_misses;                    // Probes that claimed a slot and read their block
+    int direct_fd;                            // O_DIRECT descriptor the reads go to, or -1
+    int sqpoll_enabled;
+    int buffers_registered;
+    int files_registered;                     // direct_fd is registered as fixed file 0
+    uint64_t *scan_buf;                       // Read buffers of range scans, allocated on first use
+    uint8_t *record_buf;                      // QUEUE_DEPTH records of a record search, allocated on first use
+    size_t record_size;                       // Bytes per record in record_buf
+    uint64_t *block_bufs;                     // Index blocks of a batched search, allocated on first use
+    size_t block_buf_bytes;                   // Bytes per buffer in block_bufs
+};
+
+// Prepare a read of len bytes at offset into buf. The registered buffer
+// buf_index (-1 for none) and the registered O_DIRECT file are used when
+// available; fd is the caller's descriptor otherwise.
+static void prep_read(bss_iouring_ctx *ctx, struct io_uring_sqe *sqe, int fd, void *buf, unsigned len,
+                      off_t offset, int buf_index) {
+    if (ctx->files_registered) {
+        fd = 0;
+    } else if (ctx->direct_fd >= 0) {
+        fd = ctx->direct_fd;
     }
-    
-    // Get file size
-    if (fstat(fd, &st) < 0) {
-        perror("fstat");
-        close(fd);
-        return -1;
+
+    if (buf_index >= 0 && ctx->buffers_registered) {
+        // Use fixed buffers for zero-copy I/O
+        io_uring_prep_read_fixed(sqe, fd, buf, len, offset, buf_index);
+    } else {
+        io_uring_prep_read(sqe, fd, buf, len, offset);
     }
-    
-    // Check if file size is valid for uint64_t array
-    if (st.st_size % sizeof(uint64_t) != 0) {
-        fprintf(stderr, "File size is not aligned with uint64_t size\n");
-        close(fd);
-        return -1;
+    if (ctx->files_registered) {
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
     }
+    ctx->io_requests++;
+    ctx->io_bytes += len;
+}
 
-   if (posix_fadvise(fd, 0, st.st_size, POSIX_FADV_RANDOM) < 0) {
-        fprintf(stderr, "Could not fadvise\n");
-        close(fd);
-        return -1;
+// Ring that owns the process's SQPOLL thread. Every SQPOLL ring attaches to
+// it (IORING_SETUP_ATTACH_WQ), so one poller serves all handles and workers
+// and outlives any single search; it is torn down at exit. The thread keeps
+// the idle time of the first ring that asked for it.
+static pthread_mutex_t sqpoll_anchor_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct io_uring sqpoll_anchor;
+static int sqpoll_anchor_state;   // 0 = not set up yet, 1 = running, -1 = SQPOLL unavailable
+static unsigned sqpoll_anchor_idle_ms;
+
+static void sqpoll_anchor_exit(void) {
+    io_uring_queue_exit(&sqpoll_anchor);
+}
+
+// Ring fd of the shared SQPOLL thread, started on first use; -1 if it cannot run
+static int sqpoll_anchor_fd(unsigned idle_ms) {
+    pthread_mutex_lock(&sqpoll_anchor_lock);
+    if (sqpoll_anchor_state == 0) {
+        struct io_uring_params params = {0};
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = idle_ms;
+        int ret = io_uring_queue_init_params(1, &sqpoll_anchor, &params);
+        if (ret < 0) {
+            // Not retried: every SQPOLL ring of the process starts a poller of its own instead
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: no shared SQPOLL thread (error %d: %s); each ring polls on its own\n",
+                    -ret, strerror(-ret));
+            sqpoll_anchor_state = -1;
+        } else {
+            sqpoll_anchor_state = 1;
+            sqpoll_anchor_idle_ms = idle_ms;
+            atexit(sqpoll_anchor_exit);
+        }
+    } else if (sqpoll_anchor_state > 0 && idle_ms != sqpoll_anchor_idle_ms) {
+        bss_log(BSS_VERBOSITY_NORMAL, "Note: the shared SQPOLL thread already idles after %u ms; "
+                "ignoring the %u ms asked for\n", sqpoll_anchor_idle_ms, idle_ms);
     }
-    
-    // Calculate number of elements
-    size_t num_elements = st.st_size / sizeof(uint64_t);
-    if (num_elements == 0) {
-        fprintf(stderr, "File is empty\n");
-        close(fd);
-        return -1;
+    int fd = sqpoll_anchor_state > 0 ? sqpoll_anchor.ring_fd : -1;
+    pthread_mutex_unlock(&sqpoll_anchor_lock);
+    return fd;
+}
+
+// Set up a ring (optionally with SQPOLL) and register the read buffers.
+// opts->io_fanout is the number of probes per round of a single-target
+// lookup; with a cache those probes read whole blocks through it. With a
+// direct_fd (opened with O_DIRECT, -1 for none) every read goes to that file,
+// registered along with the cache so no I/O maps buffers or looks up files.
+bss_iouring_ctx *iouring_ctx_create(const bss_options_t *opts, bss_block_cache *cache,
+                                    bss_lower_bound_fn lower_bound, int direct_fd) {
+    int ret;
+    int fanout = opts->io_fanout;
+    int speculate = opts->io_speculate;
+    int use_sqpoll = opts->use_sqpoll;
+    int use_buffers = opts->use_buffers || direct_fd >= 0;
+    unsigned setup_flags = opts->use_iopoll ? IORING_SETUP_IOPOLL : 0;
+    unsigned idle_ms = opts->sqpoll_idle_ms > 0 ? (unsigned)opts->sqpoll_idle_ms : SQPOLL_IDLE_MS;
+
+    if (opts->use_iopoll && direct_fd < 0) {
+        fprintf(stderr, "Polled completions (IOPOLL) need O_DIRECT reads\n");
+        return NULL;
     }
-    
-    printf("Searching for value %" PRIu64 " in file with %zu elements\n", target, num_elements);
 
-    // Start timing
-    start_time = get_microseconds();
-    
-    // Initialize search boundaries
-    off_t lo = 0;
-    off_t hi = num_elements - 1;
-    
-    // Initialize io_uring - optionally with SQPOLL flag for kernel thread polling
-    int sqpoll_enabled = 0;
+    if (fanout < 0 || fanout > QUEUE_DEPTH) {
+        fprintf(stderr, "io_uring fan-out must be between 1 and %d\n", QUEUE_DEPTH);
+        return NULL;
+    }
+    int width = fanout ? fanout : PARALLEL_READS;
+    int reads_per_round = speculate ? width * (width + 2) : width;
+    if (reads_per_round > QUEUE_DEPTH) {
+        fprintf(stderr, "io_uring fan-out %d is too wide for two-level speculation (at most %d reads per round)\n",
+                width, QUEUE_DEPTH);
+        return NULL;
+    }
+    if (cache) {
+        // Two rounds of reads may be in flight at once, each pinning its blocks
+        size_t cache_size;
+        block_cache_memory(cache, &cache_size);
+        if (cache_size / block_cache_block_size(cache) < (size_t)(2 * reads_per_round)) {
+            fprintf(stderr, "The block cache needs at least %d blocks for %d reads per round\n",
+                    2 * reads_per_round, reads_per_round);
+            return NULL;
+        }
+    }
 
+    bss_iouring_ctx *ctx = (bss_iouring_ctx *)calloc(1, sizeof(bss_iouring_ctx));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+    ctx->fanout = fanout;
+    ctx->speculate = speculate;
+    ctx->cache = cache;
+    ctx->lower_bound = lower_bound;
+    ctx->direct_fd = direct_fd;
+
+    // Initialize io_uring - optionally with SQPOLL flag for kernel thread polling
     if (use_sqpoll) {
         // Try to initialize with SQPOLL
         struct io_uring_params params = {0};
-        params.flags = IORING_SETUP_SQPOLL;  // Use kernel polling thread to avoid syscalls
-        params.sq_thread_idle = 2000;        // Thread idles for 2 seconds before going to sleep
+        params.flags = IORING_SETUP_SQPOLL | setup_flags;  // Use kernel polling thread to avoid syscalls
+        params.sq_thread_idle = idle_ms;     // Thread idles this long before going to sleep
 
-        ret = io_uring_queue_init_params(QUEUE_DEPTH, &ring, &params);
+        // Share the process-wide poller instead of starting one per ring
+        int wq_fd = sqpoll_anchor_fd(idle_ms);
+        if (wq_fd >= 0) {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = wq_fd;
+        }
+
+        ret = io_uring_queue_init_params(BATCH_QUEUE_DEPTH, &ctx->ring, &params);
         if (ret < 0) {
-            int saved_errno = errno;
-            printf("Note: SQPOLL io_uring mode requires root privileges (error %d: %s)\n",
-                  saved_errno, strerror(saved_errno));
-            printf("Falling back to standard IO_uring mode...\n");
-
-            // Fall back to standard mode
-            ret = io_uring_queue_init(QUEUE_DEPTH, &ring, 0);
-            if (ret < 0) {
-                perror("io_uring_queue_init");
-                close(fd);
-                return -1;
-            }
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: SQPOLL io_uring mode requires root privileges (error %d: %s)\n",
+                    -ret, strerror(-ret));
+            bss_log(BSS_VERBOSITY_NORMAL, "Falling back to standard IO_uring mode...\n");
         } else {
-            sqpoll_enabled = 1;
-            printf("SQPOLL io_uring mode enabled (kernel polling)\n");
+            ctx->sqpoll_enabled = 1;
+            bss_log(BSS_VERBOSITY_NORMAL, "SQPOLL io_uring mode enabled (kernel polling%s)\n",
+                    wq_fd >= 0 ? ", shared thread" : "");
         }
-    } else {
-        // Standard mode requested
-        ret = io_uring_queue_init(QUEUE_DEPTH, &ring, 0);
+    }
+    if (!ctx->sqpoll_enabled) {
+        // Standard mode, optionally polling the device for completions
+        ret = io_uring_queue_init(BATCH_QUEUE_DEPTH, &ctx->ring, setup_flags);
         if (ret < 0) {
-            perror("io_uring_queue_init");
-            close(fd);
-            return -1;
+            fprintf(stderr, "io_uring_queue_init: %s\n", strerror(-ret));
+            free(ctx);
+            return NULL;
         }
     }
-    
-    // Allocate memory for read buffers
-    for (int i = 0; i < PARALLEL_READS; i++) {
-        reads[i].valid = 0;
-    }
 
     // Register buffers if requested
     if (use_buffers) {
-        // Prepare an array of iovec structures for buffer registration
-        struct iovec iov[PARALLEL_READS];
-
-        // Initialize each iovec to point to our read buffers
-        for (int i = 0; i < PARALLEL_READS; i++) {
-            iov[i].iov_base = &reads[i].value;
-            iov[i].iov_len = sizeof(uint64_t);
+        // One iovec for the single-search read slots, one for the whole batch
+        // lookup table and one for the block cache
+        struct iovec iov[3];
+        int num_iov = 2;
+        iov[SINGLE_BUF_INDEX].iov_base = ctx->reads;
+        iov[SINGLE_BUF_INDEX].iov_len = sizeof(ctx->reads);
+        iov[BATCH_BUF_INDEX].iov_base = ctx->lookups;
+        iov[BATCH_BUF_INDEX].iov_len = sizeof(ctx->lookups);
+        if (cache) {
+            iov[CACHE_BUF_INDEX].iov_base = block_cache_memory(cache, &iov[CACHE_BUF_INDEX].iov_len);
+            num_iov++;
         }
 
         // Register the buffers with io_uring
-        ret = io_uring_register_buffers(&ring, iov, PARALLEL_READS);
+        ret = io_uring_register_buffers(&ctx->ring, iov, num_iov);
         if (ret < 0) {
-            printf("Note: Failed to register buffers with io_uring (error %d: %s)\n",
-                   errno, strerror(errno));
-            printf("Falling back to standard buffer mode...\n");
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: Failed to register buffers with io_uring (error %d: %s)\n",
+                    -ret, strerror(-ret));
+            bss_log(BSS_VERBOSITY_NORMAL, "Falling back to standard buffer mode...\n");
         } else {
-            buffers_registered = 1;
-            printf("Buffer registration enabled (memory-to-kernel zero-copy)\n");
+            ctx->buffers_registered = 1;
+            bss_log(BSS_VERBOSITY_NORMAL, "Buffer registration enabled (memory-to-kernel zero-copy)\n");
         }
     }
-    
-    // Main search loop
-    while (lo <= hi) {
-        // Calculate positions for parallel reads
-        off_t range = hi - lo;
-
-        // Check if the range is small enough for linear search and optimizations are enabled
-        if (use_readahead && range <= LINEAR_SEARCH_THRESHOLD) {
-            printf("Switching to linear search for range [%lld-%lld] (%lld elements)\n",
-                  (long long)lo, (long long)hi, (long long)(range + 1));
-
-            // Allocate buffer for the whole range
-            uint64_t *buffer = malloc((range + 1) * sizeof(uint64_t));
-            if (!buffer) {
-                perror("malloc for linear search buffer");
-                goto cleanup;
+
+    // Register the O_DIRECT file so reads skip the file table lookup
+    if (direct_fd >= 0) {
+        ret = io_uring_register_files(&ctx->ring, &direct_fd, 1);
+        if (ret < 0) {
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: Failed to register the file with io_uring (error %d: %s)\n",
+                    -ret, strerror(-ret));
+        } else {
+            ctx->files_registered = 1;
+        }
+    }
+
+    return ctx;
+}
+
+// Account for a completed single-target read. Block reads fill (or, on
+// failure, drop) their cache slot. Returns 0 if the read succeeded.
+static int complete_read(bss_iouring_ctx *ctx, read_data *rd, int res) {
+    int ok = res == (int)(rd->count * sizeof(uint64_t));
+    if (rd->slot >= 0) {
+        if (ok) {
+            block_cache_fill(ctx->cache, rd->slot, rd->count);
+        } else {
+            block_cache_drop(ctx->cache, rd->slot);
+        }
+    }
+    rd->valid = 1;
+    return ok ? 0 : -1;
+}
+
+// Whether a completion belongs to a read of the single-target rounds. The
+// other searches tag their reads with their own state (or NULL), which may
+// be gone by the time a stale completion turns up, so only its address is
+// looked at.
+static int is_round_read(const bss_iouring_ctx *ctx, const void *data) {
+    uintptr_t addr = (uintptr_t)data;
+    return addr >= (uintptr_t)ctx->reads && addr < (uintptr_t)(ctx->reads + 2 * QUEUE_DEPTH);
+}
+
+// Whether a submit failed for good. EINTR, and EAGAIN or EBUSY while
+// completions are being reaped, clear by themselves.
+static int submit_failed(int ret) {
+    return ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY;
+}
+
+// Wait for one read a finished or failed search left in flight
+static int reap_stale(bss_iouring_ctx *ctx) {
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    // Reads a failed submit left queued only complete once they go out
+    if (io_uring_sq_ready(&ctx->ring) > 0) {
+        do {
+            ret = io_uring_submit(&ctx->ring);
+        } while (ret == -EINTR);
+        if (ret < 0) {
+            fprintf(stderr, "io_uring_submit: %s\n", strerror(-ret));
+            return -1;
+        }
+    }
+    do {
+        ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+        return -1;
+    }
+    read_data *rd = io_uring_cqe_get_data(cqe);
+    int res = cqe->res;
+    io_uring_cqe_seen(&ctx->ring, cqe);
+    if (!is_round_read(ctx, rd)) {
+        ctx->stale_other--;
+        return 0;
+    }
+    ctx->stale[(rd - ctx->reads) / QUEUE_DEPTH]--;
+    complete_read(ctx, rd, res);
+    return 0;
+}
+
+// Give up on the in_flight reads of a search whose submit failed for good:
+// wait for those the kernel took, ignoring their results, and leave those
+// still queued on the ring to later searches to retire as stale. Their
+// buffers must outlive the call.
+static void abandon_reads(bss_iouring_ctx *ctx, int in_flight) {
+    int queued = (int)io_uring_sq_ready(&ctx->ring);
+    while (in_flight > queued) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        io_uring_cqe_seen(&ctx->ring, cqe);
+        in_flight--;
+    }
+    ctx->stale_other += in_flight;
+}
+
+// Wait for every read the single-target search left in flight, so the ring
+// only carries completions of the caller
+static int drain_stale(bss_iouring_ctx *ctx) {
+    while (ctx->stale[0] + ctx->stale[1] + ctx->stale_other > 0) {
+        if (reap_stale(ctx) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Whether a read of the current round is still outstanding over [lo, hi]
+static int probe_pending_in(const read_data *reads, int count, off_t lo, off_t hi) {
+    for (int i = 0; i < count; i++) {
+        off_t first = reads[i].offset / sizeof(uint64_t);
+        off_t last = first + reads[i].count - 1;
+        if (!reads[i].valid && last >= lo && first <= hi) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Narrow [*lo, *hi] with the values [first, first + count) of the file. If
+// the target falls inside them it is resolved in memory: returns 1 and sets
+// *found_offset on a hit, or empties the range if the target is absent.
+// A bound search never hits: it narrows until the range is empty, with *lo
+// left on the first value >= target.
+static int narrow_values(bss_iouring_ctx *ctx, const uint64_t *values, off_t first, size_t count,
+                         uint64_t target, int bound, off_t *lo, off_t *hi, off_t *found_offset) {
+    if (target < values[0] || (bound && target == values[0])) {
+        if (first - 1 < *hi) {
+            *hi = first - 1;
+        }
+        return 0;
+    }
+    if (target > values[count - 1]) {
+        if (first + (off_t)count > *lo) {
+            *lo = first + count;
+        }
+        return 0;
+    }
+
+    size_t pos = count == 1 ? 0 : ctx->lower_bound(values, count, target);
+    if (bound) {
+        *lo = first + pos;
+        *hi = *lo - 1;
+        return 0;
+    }
+    if (values[pos] == target) {
+        *found_offset = (first + pos) * sizeof(uint64_t);
+        return 1;
+    }
+    *lo = *hi + 1;
+    return 0;
+}
+
+// Narrow the range with a completed read of the current round
+static int narrow_read(bss_iouring_ctx *ctx, const read_data *rd, uint64_t target, int bound,
+                       off_t *lo, off_t *hi, off_t *found_offset) {
+    const uint64_t *values = rd->slot >= 0 ? block_cache_data(ctx->cache, rd->slot) : &rd->value;
+    return narrow_values(ctx, values, rd->offset / sizeof(uint64_t), rd->count, target, bound, lo, hi,
+                         found_offset);
+}
+
+// Queue a read for the current round: the single value at elem_idx, or with
+// a cache the whole block containing it
+static int queue_read(bss_iouring_ctx *ctx, int fd, size_t num_elements, read_data *rd, off_t elem_idx,
+                      int slot) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+    if (!sqe) {
+        fprintf(stderr, "Could not get SQE\n");
+        return -1;
+    }
+
+    rd->valid = 0;
+    rd->round = ctx->round;
+    rd->slot = slot;
+    if (slot >= 0) {
+        size_t block_elems = block_cache_block_size(ctx->cache) / sizeof(uint64_t);
+        size_t first = elem_idx / block_elems * block_elems;
+        rd->count = num_elements - first < block_elems ? num_elements - first : block_elems;
+        rd->offset = first * sizeof(uint64_t);
+
+        // Always ask for the whole block, as O_DIRECT needs; the last one comes back short
+        prep_read(ctx, sqe, fd, block_cache_data(ctx->cache, slot), block_cache_block_size(ctx->cache),
+                  rd->offset, CACHE_BUF_INDEX);
+    } else {
+        rd->count = 1;
+        rd->offset = elem_idx * sizeof(uint64_t);
+        prep_read(ctx, sqe, fd, &rd->value, sizeof(uint64_t), rd->offset, SINGLE_BUF_INDEX);
+    }
+    io_uring_sqe_set_data(sqe, rd);
+    ctx->bytes_read += rd->count * sizeof(uint64_t);
+    return 0;
+}
+
+// Release the cache slots a round claimed but never read into
+static void drop_slots(bss_iouring_ctx *ctx, const int *slots, int count) {
+    for (int i = 0; i < count; i++) {
+        block_cache_drop(ctx->cache, slots[i]);
+    }
+}
+
+// Resolve the blocks of a round's probes that are already cached, and claim
+// cache slots for the others. pos[] receives the probes that still need a
+// read (one per block) and slots[] their slots. Returns the number of reads
+// to queue, or -1 on error (with no slots claimed); a hit stops the planning
+// early.
+static int plan_block_reads(bss_iouring_ctx *ctx, uint64_t target, int bound, off_t *pos, int num_probes,
+                            int *slots, off_t *lo, off_t *hi, off_t *found_offset, int *found) {
+    size_t block_elems = block_cache_block_size(ctx->cache) / sizeof(uint64_t);
+    int num_reads = 0;
+    uint64_t last_block = UINT64_MAX;
+
+    for (int i = 0; i < num_probes && *lo <= *hi; i++) {
+        uint64_t block_no = pos[i] / block_elems;
+        if (block_no == last_block || pos[i] < *lo || pos[i] > *hi) {
+            continue;
+        }
+        last_block = block_no;
+
+        int ready;
+        int slot = block_cache_find(ctx->cache, block_no, &ready);
+
+        // A speculative read of an earlier round is already bringing it in
+        while (slot >= 0 && !ready) {
+            if (reap_stale(ctx) < 0) {
+                drop_slots(ctx, slots, num_reads);
+                return -1;
             }
+            slot = block_cache_find(ctx->cache, block_no, &ready);
+        }
 
-            // Read the entire range at once
-            ssize_t bytes_read = pread(fd, buffer, (range + 1) * sizeof(uint64_t), lo * sizeof(uint64_t));
-            if (bytes_read < 0) {
-                perror("pread for linear search");
-                free(buffer);
-                goto cleanup;
+        if (slot >= 0) {
+            ctx->cache_hits++;
+            off_t first = block_no * block_elems;
+            if (narrow_values(ctx, block_cache_data(ctx->cache, slot), first, block_cache_count(ctx->cache, slot),
+                              target, bound, lo, hi, found_offset)) {
+                *found = 1;
+                break;
             }
+            continue;
+        }
 
-            // Linear scan through the buffer
-            for (off_t i = 0; i <= range; i++) {
-                if (buffer[i] == target) {
-                    found = 1;
-                    target_offset = (lo + i) * sizeof(uint64_t);
-                    printf("Linear search found target at index %lld\n", (long long)(lo + i));
-                    break;
-                }
+        // Only blocks whose earlier reads have all completed can be evicted
+        while ((slot = block_cache_reserve(ctx->cache, block_no)) < 0) {
+            if (ctx->stale[0] + ctx->stale[1] == 0) {
+                fprintf(stderr, "Block cache is too small for the reads of one round\n");
+                drop_slots(ctx, slots, num_reads);
+                return -1;
+            }
+            if (reap_stale(ctx) < 0) {
+                drop_slots(ctx, slots, num_reads);
+                return -1;
+            }
+        }
+        ctx->cache_misses++;
+        pos[num_reads] = pos[i];
+        slots[num_reads] = slot;
+        num_reads++;
+    }
+
+    // Claimed blocks the in-memory hits made redundant are read anyway and
+    // stay cached; only those still overlapping the range are waited for
+    return num_reads;
+}
+
+// Run one round of probes over [*lo, *hi] and narrow the range. The round ends
+// as soon as no probe still in flight lies inside the narrowed range; the rest
+// of its reads complete in the background and are retired by later rounds.
+// Returns 1 and sets *found_offset on a hit, 0 otherwise and -1 on error.
+// With bound set the round narrows towards the lower bound instead.
+static int lookup_round(bss_iouring_ctx *ctx, int fd, size_t num_elements, uint64_t target, int bound,
+                        off_t *lo, off_t *hi, off_t *found_offset, int *total_reads) {
+    struct io_uring *ring = &ctx->ring;
+    int half = ++ctx->round & 1;
+    read_data *reads = &ctx->reads[half * QUEUE_DEPTH];
+    off_t pos[QUEUE_DEPTH];
+    int slots[QUEUE_DEPTH];
+    int ret;
+
+    // Reads of the round before last may still land in this half
+    while (ctx->stale[half] > 0) {
+        if (reap_stale(ctx) < 0) {
+            return -1;
+        }
+    }
+
+    int result = 0;
+    off_t new_lo = *lo;
+    off_t new_hi = *hi;
+    int active_reads = plan_probes(*lo, *hi, ctx->fanout, ctx->speculate, pos);
+    if (ctx->cache) {
+        active_reads = plan_block_reads(ctx, target, bound, pos, active_reads, slots, &new_lo, &new_hi,
+                                        found_offset, &result);
+        if (active_reads < 0) {
+            return -1;
+        }
+    }
+
+    // Prepare read requests
+    for (int i = 0; i < active_reads; i++) {
+        reads[i].index = i;
+        if (queue_read(ctx, fd, num_elements, &reads[i], pos[i], ctx->cache ? slots[i] : -1) < 0) {
+            // The queued reads go out with the next submit and fill their slots
+            if (ctx->cache) {
+                drop_slots(ctx, slots + i, active_reads - i);
             }
+            ctx->stale[half] += i;
+            return -1;
+        }
+    }
+    *total_reads += active_reads;
 
-            // Clean up and break from the main loop
-            free(buffer);
+    if (active_reads > 0) {
+        do {
+            ret = io_uring_submit(ring);
+        } while (ret == -EINTR);
+        if (ret < 0) {
+            // The reads stay queued, loading their slots: whoever waits for them submits them
+            fprintf(stderr, "io_uring_submit: %s\n", strerror(-ret));
+            ctx->stale[half] += active_reads;
+            return -1;
+        }
+    }
+
+    // Narrow the range completion by completion
+    int pending = active_reads;
+    while (pending > 0 && result == 0 && probe_pending_in(reads, active_reads, new_lo, new_hi)) {
+        struct io_uring_cqe *cqe;
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            // The reads stay in flight on the persistent ring: later rounds wait for them
+            fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+            ctx->stale[half] += pending;
+            return -1;
+        }
+        read_data *rd = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+
+        // A leftover of an earlier round, or of another search
+        if (!is_round_read(ctx, rd)) {
+            ctx->stale_other--;
+            continue;
+        }
+        if (rd->round != ctx->round) {
+            ctx->stale[(rd - ctx->reads) / QUEUE_DEPTH]--;
+            complete_read(ctx, rd, res);
+            continue;
+        }
+        pending--;
+
+        if (complete_read(ctx, rd, res) < 0) {
+            fprintf(stderr, "Read failed: %s\n", res < 0 ? strerror(-res) : "short read");
+            result = -1;
             break;
         }
+        result = narrow_read(ctx, rd, target, bound, &new_lo, &new_hi, found_offset);
+    }
 
-        // Check if the range is small enough for readahead and readahead is enabled
-        if (use_readahead && range <= READAHEAD_THRESHOLD) {
-            // Small range - use posix_fadvise to prefetch the entire range
-            off_t readahead_offset = lo * sizeof(uint64_t);
-            size_t readahead_size = (range + 1) * sizeof(uint64_t);  // +1 to include both ends
+    // The remaining reads can no longer narrow the range
+    ctx->stale[half] += pending;
+    *lo = new_lo;
+    *hi = new_hi;
+    return result;
+}
 
-            // Use posix_fadvise with POSIX_FADV_WILLNEED to prefetch data
-            ret = posix_fadvise(fd, readahead_offset, readahead_size, POSIX_FADV_WILLNEED);
-            if (ret < 0) {
-                // Readahead failed - just continue with normal reads
-                // This is not critical, so we don't goto cleanup
-                perror("posix_fadvise readahead");
-            } else {
-                // Print diagnostic message
-                printf("Readahead issued for range [%lld-%lld] (%zu bytes)\n",
-                      (long long)lo, (long long)hi, readahead_size);
+// Tear down the ring and release the engine state
+void iouring_ctx_destroy(bss_iouring_ctx *ctx) {
+    // The read buffers must outlive the reads still in flight
+    drain_stale(ctx);
+
+    // Unregister buffers and files if they were registered
+    if (ctx->files_registered) {
+        io_uring_unregister_files(&ctx->ring);
+    }
+    if (ctx->buffers_registered) {
+        io_uring_unregister_buffers(&ctx->ring);
+    }
+
+    // Clean up io_uring
+    io_uring_queue_exit(&ctx->ring);
+    free(ctx->scan_buf);
+    free(ctx->record_buf);
+    free(ctx->block_bufs);
+    free(ctx);
+}
+
+// Add the reads, bytes and block cache outcomes of the ring to *counters
+void iouring_add_counters(const bss_iouring_ctx *ctx, bss_counters_t *counters) {
+    counters->io_requests += ctx->io_requests;
+    counters->io_bytes += ctx->io_bytes;
+    counters->cache_hits += ctx->cache_hits;
+    counters->cache_misses += ctx->cache_misses;
+}
+
+// Single-target rounds issued so far: one per level of the search, however
+// many reads each round speculates with
+unsigned iouring_rounds(const bss_iouring_ctx *ctx) {
+    return ctx->round;
+}
+
+// Binary search for a target uint64_t over an already set up ring
+int iouring_lookup(bss_iouring_ctx *ctx, int fd, size_t num_elements, uint64_t target,
+                   int64_t *index, int *total_reads) {
+    int ret, found = 0;
+    off_t target_offset = -1;
+
+    *total_reads = 0;
+
+    // Initialize search boundaries
+    off_t lo = 0;
+    off_t hi = num_elements - 1;
+    
+    // Main search loop: with a block cache the last rounds resolve in memory
+    while (lo <= hi) {
+        // Probe the range and narrow it
+        ret = lookup_round(ctx, fd, num_elements, target, 0, &lo, &hi, &target_offset, total_reads);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret) {
+            found = 1;
+            break;
+        }
+    }
+
+    if (found) {
+        *index = target_offset / sizeof(uint64_t);
+    }
+    return found;
+}
+
+// Lower bound search over an already set up ring: *pos receives the first
+// element index whose value is >= target, or num_elements if there is none
+int iouring_lower_bound(bss_iouring_ctx *ctx, int fd, size_t num_elements, uint64_t target,
+                        size_t *pos, int *total_reads) {
+    off_t lo = 0;
+    off_t hi = num_elements - 1;
+    off_t unused;
+
+    *total_reads = 0;
+    while (lo <= hi) {
+        if (lookup_round(ctx, fd, num_elements, target, 1, &lo, &hi, &unused, total_reads) < 0) {
+            return -1;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+// Read the records at positions pos[0..count) into ctx->record_buf and wait
+// for all of them: the buffer is reused by the next round
+static int read_records(bss_iouring_ctx *ctx, int fd, const off_t *pos, int count) {
+    struct io_uring_cqe *cqe;
+    int failed = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+        if (!sqe) {
+            fprintf(stderr, "Could not get SQE\n");
+            ctx->stale_other += i;    // Those queued go out with the next submit
+            return -1;
+        }
+        prep_read(ctx, sqe, fd, ctx->record_buf + i * ctx->record_size, ctx->record_size,
+                  pos[i] * ctx->record_size, -1);
+        io_uring_sqe_set_data(sqe, NULL);
+    }
+
+    int ret = io_uring_submit_and_wait(&ctx->ring, count);
+    if (ret < 0 && ret != -EINTR) {
+        fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+        ctx->stale_other += count;
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+        if (ret == -EINTR) {
+            i--;
+            continue;
+        }
+        if (ret < 0) {
+            // The rest stay in flight into record_buf: the next search drains them first
+            fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+            ctx->stale_other += count - i;
+            return -1;
+        }
+        int res = cqe->res;
+        io_uring_cqe_seen(&ctx->ring, cqe);
+        if (res != (int)ctx->record_size && !failed) {
+            fprintf(stderr, "Read failed: %s\n", res < 0 ? strerror(-res) : "short read");
+            failed = 1;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+// Search a file of fixed-size records over an already set up ring. Every
+// round reads whole records at the fan-out probe positions, so the payload
+// of a hit arrives in the same read as its key. With bound set, *pos
+// receives the first record index whose key is >= *key (or num_elements)
+// and 0 is returned. Otherwise a hit stores its index in *pos, copies the
+// record to record (unless NULL) and returns 1; a miss returns 0.
+int iouring_lookup_record(bss_iouring_ctx *ctx, int fd, size_t num_elements, size_t record_size, size_t key_size,
+                          const void *key, int bound, size_t *pos, void *record, int *total_reads) {
+    off_t probes[QUEUE_DEPTH];
+
+    // Reads left in flight by a failed search may still land in record_buf
+    if (drain_stale(ctx) < 0) {
+        return -1;
+    }
+
+    if (!ctx->record_buf || ctx->record_size != record_size) {
+        free(ctx->record_buf);
+        ctx->record_buf = (uint8_t *)malloc(QUEUE_DEPTH * record_size);
+        if (!ctx->record_buf) {
+            perror("malloc");
+            return -1;
+        }
+        ctx->record_size = record_size;
+    }
+
+    off_t lo = 0;
+    off_t hi = num_elements - 1;
+    *total_reads = 0;
+    while (lo <= hi) {
+        int count = plan_probes(lo, hi, ctx->fanout, 0, probes);
+        if (read_records(ctx, fd, probes, count) < 0) {
+            return -1;
+        }
+        *total_reads += count;
+
+        // Probes are in increasing order: the first key >= *key ends the range
+        for (int i = 0; i < count; i++) {
+            const uint8_t *rec = ctx->record_buf + i * record_size;
+            int cmp = record_key_compare(rec, key, key_size);
+            if (cmp < 0) {
+                lo = probes[i] + 1;
+                continue;
+            }
+            if (cmp == 0 && !bound) {
+                *pos = probes[i];
+                if (record) {
+                    memcpy(record, rec, record_size);
+                }
+                return 1;
             }
+            hi = probes[i] - 1;
+            break;
         }
+    }
+    *pos = lo;
+    return 0;
+}
 
-        // If range is small, reduce number of reads
-        int active_reads;
-        if (range > PARALLEL_READS * 100) {
-            active_reads = PARALLEL_READS;
-        } else {
-            active_reads = 1;
-        }
-
-        off_t step = range / (active_reads + 1);
-        step = (step == 0) ? 1 : step;  // Ensure minimum step size
-        
-        // Prepare read requests
-        for (int i = 0; i < active_reads; i++) {
-            // Calculate the position to read
-            off_t index_pos = lo + step * (i + 1);
-            if (index_pos > hi) index_pos = hi;
-            
-            reads[i].offset = index_pos * sizeof(uint64_t);
-            reads[i].index = i;
-            reads[i].valid = 0;
-            
-            // Get an SQE
-            sqe = io_uring_get_sqe(&ring);
+// Read the block [lo, lo + count) into buf with a single read. Over
+// O_DIRECT, buf and lo must be aligned and buf must hold the length rounded
+// up to BSS_DIRECT_ALIGNMENT.
+static int read_block(bss_iouring_ctx *ctx, int fd, uint64_t *buf, size_t lo, size_t count) {
+    struct io_uring_cqe *cqe;
+
+    if (drain_stale(ctx) < 0) {
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+    if (!sqe) {
+        fprintf(stderr, "Could not get SQE\n");
+        return -1;
+    }
+    size_t len = count * sizeof(uint64_t);
+    if (ctx->direct_fd >= 0) {
+        len = (len + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+    }
+    prep_read(ctx, sqe, fd, buf, len, lo * sizeof(uint64_t), -1);
+    io_uring_sqe_set_data(sqe, NULL);
+
+    // On failure the read stays queued or in flight into buf: the next search drains it first
+    int ret;
+    do {
+        ret = io_uring_submit_and_wait(&ctx->ring, 1);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+        ctx->stale_other++;
+        return -1;
+    }
+    do {
+        ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+        ctx->stale_other++;
+        return -1;
+    }
+    int res = cqe->res;
+    io_uring_cqe_seen(&ctx->ring, cqe);
+    if (res < (int)(count * sizeof(uint64_t))) {
+        fprintf(stderr, "Read failed: %s\n", res < 0 ? strerror(-res) : "short read");
+        return -1;
+    }
+    return 0;
+}
+
+// Search one block [lo, lo + count) that the sparse index narrowed the lookup
+// to: a single read brings in the whole block, the rest happens in memory
+int iouring_lookup_block(bss_iouring_ctx *ctx, int fd, uint64_t *buf, size_t lo, size_t count, uint64_t target,
+                         bss_lower_bound_fn lower_bound, int64_t *index) {
+    if (read_block(ctx, fd, buf, lo, count) < 0) {
+        return -1;
+    }
+
+    int found = kernel_lookup(lower_bound, buf, count, target, index);
+    if (found > 0) {
+        *index += lo;
+    }
+    return found;
+}
+
+// Lower bound within the block [lo, lo + count) the sparse index narrowed the
+// search to; *pos may be lo + count, the first element of the next block
+int iouring_lower_bound_block(bss_iouring_ctx *ctx, int fd, uint64_t *buf, size_t lo, size_t count, uint64_t target,
+                              bss_lower_bound_fn lower_bound, size_t *pos) {
+    if (read_block(ctx, fd, buf, lo, count) < 0) {
+        return -1;
+    }
+    *pos = lo + lower_bound(buf, count, target);
+    return 0;
+}
+
+// One block read of a batched search through the sparse index
+typedef struct {
+    uint64_t *buf;
+    size_t lo;              // First element of the block
+    size_t count;           // Elements in the block
+    uint64_t target;
+    size_t target_idx;      // Position of the target in the caller's array
+} block_read;
+
+// Batched lookups through the sparse index: the index narrows every target
+// to one block in RAM, then a single read per target fetches its block and
+// the kernel finishes the search in memory. Up to BLOCK_BATCH_READS reads
+// are in flight at once, so the lookups overlap and the batch costs about
+// one device round trip per BLOCK_BATCH_READS targets. indices[i] receives
+// the element index of targets[i], or -1 if absent. Returns the number of
+// targets found, or -1 on error.
+int iouring_lookup_blocks(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                          const uint64_t *targets, size_t num_targets, int64_t *indices) {
+    block_read reads[BLOCK_BATCH_READS];
+    int free_reads[BLOCK_BATCH_READS];
+    int num_free = BLOCK_BATCH_READS;
+    int in_flight = 0;
+    int found = 0, result = 0;
+    size_t next = 0;
+
+    // O_DIRECT reads whole, aligned pages into aligned buffers
+    size_t bytes = sparse_index->stride * sizeof(uint64_t);
+    bytes = (bytes + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+    if (drain_stale(ctx) < 0) {
+        return -1;
+    }
+    if (!ctx->block_bufs || ctx->block_buf_bytes != bytes) {
+        free(ctx->block_bufs);
+        ctx->block_bufs = (uint64_t *)aligned_alloc(BSS_DIRECT_ALIGNMENT, BLOCK_BATCH_READS * bytes);
+        if (!ctx->block_bufs) {
+            perror("malloc");
+            return -1;
+        }
+        ctx->block_buf_bytes = bytes;
+    }
+    for (int i = 0; i < BLOCK_BATCH_READS; i++) {
+        reads[i].buf = ctx->block_bufs + i * (bytes / sizeof(uint64_t));
+        free_reads[i] = BLOCK_BATCH_READS - 1 - i;
+    }
+
+    for (;;) {
+        // Queue a read for every target a free buffer can take
+        while (result == 0 && num_free > 0 && next < num_targets) {
+            size_t target_idx = next++;
+            size_t lo, hi;
+            if (sparse_index_lookup(sparse_index, num_elements, targets[target_idx], &lo, &hi) < 0) {
+                indices[target_idx] = -1;    // Below the first key
+                continue;
+            }
+
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
             if (!sqe) {
                 fprintf(stderr, "Could not get SQE\n");
-                goto cleanup;
+                result = -1;
+                break;
+            }
+            block_read *rd = &reads[free_reads[--num_free]];
+            rd->lo = lo;
+            rd->count = hi - lo + 1;
+            rd->target = targets[target_idx];
+            rd->target_idx = target_idx;
+            size_t len = rd->count * sizeof(uint64_t);
+            if (ctx->direct_fd >= 0) {
+                len = (len + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
             }
+            prep_read(ctx, sqe, fd, rd->buf, len, lo * sizeof(uint64_t), -1);
+            io_uring_sqe_set_data(sqe, rd);
+            in_flight++;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+
+        int ret = io_uring_submit_and_wait(&ctx->ring, 1);
+        if (submit_failed(ret)) {
+            // The reads land in block_bufs, which stays with the ring
+            fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+            abandon_reads(ctx, in_flight);
+            return -1;
+        }
 
-            // Prepare read operation using registered buffers if available
-            if (buffers_registered) {
-                // Use fixed buffers for zero-copy I/O
-                io_uring_prep_read_fixed(sqe, fd, &reads[i].value, sizeof(uint64_t),
-                                        reads[i].offset, i);  // i is the buffer index
+        struct io_uring_cqe *cqes[BLOCK_BATCH_READS];
+        int count = io_uring_peek_batch_cqe(&ctx->ring, cqes, BLOCK_BATCH_READS);
+        for (int i = 0; i < count; i++) {
+            block_read *rd = io_uring_cqe_get_data(cqes[i]);
+            int res = cqes[i]->res;
+            if (res < (int)(rd->count * sizeof(uint64_t))) {
+                fprintf(stderr, "Read failed: %s\n", res < 0 ? strerror(-res) : "short read");
+                result = -1;
             } else {
-                // Standard read
-                io_uring_prep_read(sqe, fd, &reads[i].value, sizeof(uint64_t), reads[i].offset);
+                int64_t index;
+                int hit = kernel_lookup(ctx->lower_bound, rd->buf, rd->count, rd->target, &index);
+                indices[rd->target_idx] = hit ? (int64_t)(rd->lo + index) : -1;
+                found += hit;
             }
+            free_reads[num_free++] = rd - reads;
+            in_flight--;
+        }
+        io_uring_cq_advance(&ctx->ring, count);
+    }
+
+    return result < 0 ? -1 : found;
+}
+
+// One read of a range scan
+typedef struct {
+    size_t first;           // First element read
+    size_t count;           // Elements the read must return
+    uint64_t *buf;
+    int res;                // Completion result, once done
+    int done;
+} scan_read;
+
+// Queue the next chain of reads of a range scan, starting at element *next.
+// The reads of a chain are linked, so the kernel issues them back to back in
+// file order and the device sees one sequential stream. Returns the number
+// of reads queued, or -1 on error.
+static int scan_queue_chain(bss_iouring_ctx *ctx, int fd, scan_read *reads, uint64_t *buf, size_t *next,
+                            size_t end) {
+    size_t piece = SCAN_READ_BYTES / sizeof(uint64_t);
+    int num_reads = 0;
 
-            // Set user data to identify this request later
-            io_uring_sqe_set_data(sqe, &reads[i]);
+    while (num_reads < SCAN_CHAIN_READS && *next < end) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+        if (!sqe) {
+            fprintf(stderr, "Could not get SQE\n");
+            return -1;
+        }
+        scan_read *sr = &reads[num_reads];
+        sr->first = *next;
+        sr->count = end - *next < piece ? end - *next : piece;
+        sr->buf = buf + num_reads * piece;
+        sr->done = 0;
+
+        size_t len = sr->count * sizeof(uint64_t);
+        if (ctx->direct_fd >= 0) {
+            len = (len + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
         }
-        
-        // Count the reads we're performing
-        total_reads += active_reads;
-        
-        // Submit and wait for all operations at once
-        ret = io_uring_submit_and_wait(&ring, active_reads);
+        prep_read(ctx, sqe, fd, sr->buf, len, sr->first * sizeof(uint64_t), -1);
+        io_uring_sqe_set_data(sqe, sr);
+        *next += sr->count;
+        num_reads++;
+        if (num_reads < SCAN_CHAIN_READS && *next < end) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    }
+    return num_reads;
+}
+
+// Reap scan completions until sr is done
+static int scan_wait(bss_iouring_ctx *ctx, scan_read *sr, int *in_flight) {
+    while (!sr->done) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&ctx->ring, &cqe);
         if (ret < 0) {
-            perror("io_uring_submit_and_wait");
-            goto cleanup;
+            fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+            return -1;
         }
+        scan_read *done = io_uring_cqe_get_data(cqe);
+        done->res = cqe->res;
+        done->done = 1;
+        io_uring_cqe_seen(&ctx->ring, cqe);
+        (*in_flight)--;
+    }
+    return 0;
+}
 
-        // Process all completions in a batch
-        int head;
-        struct io_uring_cqe *cqes[BATCH_SIZE];
-        int count = io_uring_peek_batch_cqe(&ring, cqes, active_reads);
+// Hand the values [start, end) of the file to fn, in order. SCAN_CHAINS
+// chains of large linked reads are kept in flight, so fn works on one chain
+// while the next one streams in and the scan runs at sequential bandwidth
+// rather than at probe latency. Returns the number of values visited, or -1
+// on error.
+int64_t iouring_scan(bss_iouring_ctx *ctx, int fd, size_t start, size_t end, bss_scan_fn fn, void *arg) {
+    size_t piece = SCAN_READ_BYTES / sizeof(uint64_t);
+    scan_read reads[SCAN_CHAINS][SCAN_CHAIN_READS];
+    int num_reads[SCAN_CHAINS] = {0};
+    int in_flight = 0;
+    int64_t visited = 0;
+    int result = 0;
 
-        // Process the batch of completions
-        for (int i = 0; i < count; i++) {
-            cqe = cqes[i];
+    if (start >= end) {
+        return 0;
+    }
+    if (drain_stale(ctx) < 0) {
+        return -1;
+    }
+    if (!ctx->scan_buf) {
+        ctx->scan_buf = (uint64_t *)aligned_alloc(BSS_DIRECT_ALIGNMENT,
+                                                  SCAN_CHAINS * SCAN_CHAIN_READS * SCAN_READ_BYTES);
+        if (!ctx->scan_buf) {
+            perror("malloc");
+            return -1;
+        }
+    }
 
-            // Get the read_data associated with this completion
-            read_data *data = io_uring_cqe_get_data(cqe);
-            if (!data) continue; // Skip if no data (shouldn't happen for these reads)
+    // O_DIRECT reads start on an aligned offset; the values before start are skipped
+    size_t next = start;
+    if (ctx->direct_fd >= 0) {
+        size_t align = BSS_DIRECT_ALIGNMENT / sizeof(uint64_t);
+        next = start / align * align;
+    }
 
-            // Check if operation succeeded
-            if (cqe->res == sizeof(uint64_t)) {
-                data->valid = 1;
+    for (int c = 0; c < SCAN_CHAINS; c++) {
+        num_reads[c] = scan_queue_chain(ctx, fd, reads[c], ctx->scan_buf + c * SCAN_CHAIN_READS * piece,
+                                        &next, end);
+        if (num_reads[c] < 0) {
+            return -1;
+        }
+        in_flight += num_reads[c];
+    }
+
+    for (int c = 0; result == 0 && num_reads[c] > 0; c = (c + 1) % SCAN_CHAINS) {
+        int ret = io_uring_submit(&ctx->ring);
+        if (ret < 0) {
+            fprintf(stderr, "io_uring_submit: %s\n", strerror(-ret));
+            result = -1;
+            break;
+        }
+
+        // Deliver the chain read by read, in file order
+        for (int i = 0; i < num_reads[c] && result == 0; i++) {
+            scan_read *sr = &reads[c][i];
+            if (scan_wait(ctx, sr, &in_flight) < 0) {
+                return -1;
+            }
+            if (sr->res < (int)(sr->count * sizeof(uint64_t))) {
+                fprintf(stderr, "Read failed: %s\n", sr->res < 0 ? strerror(-sr->res) : "short read");
+                result = -1;
+                break;
+            }
+            size_t skip = sr->first < start ? start - sr->first : 0;
+            visited += sr->count - skip;
+            if (fn(sr->buf + skip, sr->count - skip, sr->first + skip, arg)) {
+                result = 1;
+            }
+        }
+        if (result != 0) {
+            break;
+        }
 
-                // Compare with target
-                if (data->value == target) {
-                    // Found it!
-                    found = 1;
-                    target_offset = data->offset;
+        // The chain's buffers are free again: refill them further ahead
+        num_reads[c] = scan_queue_chain(ctx, fd, reads[c], ctx->scan_buf + c * SCAN_CHAIN_READS * piece,
+                                        &next, end);
+        if (num_reads[c] < 0) {
+            result = -1;
+            break;
+        }
+        in_flight += num_reads[c];
+    }
+
+    // A stopped or failed scan still owns the reads in flight
+    if (in_flight > 0 && io_uring_submit(&ctx->ring) < 0) {
+        return -1;
+    }
+    while (in_flight > 0) {
+        scan_read *pending = NULL;
+        for (int c = 0; c < SCAN_CHAINS && !pending; c++) {
+            for (int i = 0; i < num_reads[c]; i++) {
+                if (!reads[c][i].done) {
+                    pending = &reads[c][i];
+                    break;
                 }
-            } else if (cqe->res < 0) {
-                fprintf(stderr, "Read failed: %s\n", strerror(-cqe->res));
             }
         }
+        if (!pending || scan_wait(ctx, pending, &in_flight) < 0) {
+            return -1;
+        }
+    }
+    return result < 0 ? -1 : visited;
+}
 
-        // Mark all CQEs as seen at once
-        io_uring_cq_advance(&ring, count);
-        
-        // If we found the target, we're done
-        if (found) {
+// Binary search for a target uint64_t in a file of sorted uint64_t values.
+// Fills *result (reads performed as probes, bytes read) without printing
+// anything. Returns 0 on success, -1 on error.
+int binary_search_uint64(const char *filepath, uint64_t target, int use_sqpoll, int use_buffers, int use_readahead,
+                         bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open the file and set up the ring
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_IOURING;
+    opts.use_sqpoll = use_sqpoll;
+    opts.use_buffers = use_buffers;
+    opts.use_readahead = use_readahead;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
+    }
+
+    int found = iouring_lookup(handle->uring, handle->fd, handle->num_elements, target, &result->index,
+                               &result->probes);
+    result->bytes_read = handle->uring->bytes_read;
+
+    // Clean up
+    bss_close(handle);
+    if (found < 0) {
+        return -1;
+    }
+    result->found = found;
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
+    return 0;
+}
+
+
+// Issue the reads for the next round of a batched lookup. lk->pending
+// counts the reads actually queued, even when it fails partway.
+static int batch_start_round(bss_iouring_ctx *ctx, int fd, batch_lookup *lk) {
+    lk->active_reads = plan_reads(lk->lo, lk->hi, lk->reads);
+    lk->pending = 0;
+
+    for (int i = 0; i < lk->active_reads; i++) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+        if (!sqe) {
+            fprintf(stderr, "Could not get SQE\n");
+            return -1;
+        }
+
+        // All lookup slots live in one registered buffer
+        lk->reads[i].owner = lk;
+        prep_read(ctx, sqe, fd, &lk->reads[i].value, sizeof(uint64_t), lk->reads[i].offset, BATCH_BUF_INDEX);
+        io_uring_sqe_set_data(sqe, &lk->reads[i]);
+        lk->pending++;
+    }
+
+    return lk->active_reads;
+}
+
+// Start searching for targets[target_idx] in a free lookup slot. Returns 1 if
+// the sparse index already rules the target out, 0 once its reads are queued.
+static int batch_start_lookup(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                              batch_lookup *lk, const uint64_t *targets, size_t target_idx, uint64_t *total_reads) {
+    lk->target = targets[target_idx];
+    lk->target_idx = target_idx;
+    lk->lo = 0;
+    lk->hi = num_elements - 1;
+    if (sparse_index) {
+        size_t lo, hi;
+        if (sparse_index_lookup(sparse_index, num_elements, lk->target, &lo, &hi) < 0) {
+            return 1;
+        }
+        lk->lo = lo;
+        lk->hi = hi;
+    }
+    int ret = batch_start_round(ctx, fd, lk);
+    *total_reads += lk->pending;
+    return ret < 0 ? -1 : 0;
+}
+
+// Fill a free lookup slot with the next target that needs I/O, resolving
+// targets the sparse index rules out on the spot. Returns 1 if the slot was
+// filled, 0 if no targets are left and -1 on error; lk->pending counts the
+// reads queued either way.
+static int batch_admit(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                       batch_lookup *lk, const uint64_t *targets, size_t num_targets, size_t *next_target,
+                       int64_t *indices, uint64_t *total_reads) {
+    lk->pending = 0;
+    while (*next_target < num_targets) {
+        size_t target_idx = (*next_target)++;
+        int ret = batch_start_lookup(ctx, fd, num_elements, sparse_index, lk, targets, target_idx, total_reads);
+        if (ret <= 0) {
+            return ret < 0 ? -1 : 1;
+        }
+        indices[target_idx] = -1;
+    }
+    return 0;
+}
+
+// Batched binary search over an already set up ring. Up to BATCH_MAX_ACTIVE
+// searches run at once and their probe reads are interleaved so the queue
+// stays full. For every target, indices[i] receives the element index it was
+// found at, or -1 if it is absent. Returns the number of targets found.
+int iouring_lookup_batch(bss_iouring_ctx *ctx, int fd, size_t num_elements, const bss_sparse_index *sparse_index,
+                         const uint64_t *targets, size_t num_targets, int64_t *indices, uint64_t *total_reads) {
+    struct io_uring *ring = &ctx->ring;
+    int ret, result = 0;
+    int found_count = 0;
+    size_t next_target = 0;
+    int in_flight = 0;       // Reads queued or in flight, over all lookups
+
+    *total_reads = 0;
+    if (drain_stale(ctx) < 0) {
+        return -1;
+    }
+
+    // Start the first wave of lookups
+    for (size_t i = 0; i < BATCH_MAX_ACTIVE; i++) {
+        ret = batch_admit(ctx, fd, num_elements, sparse_index, &ctx->lookups[i], targets, num_targets,
+                          &next_target, indices, total_reads);
+        in_flight += ctx->lookups[i].pending;
+        if (ret <= 0) {
+            result = ret;
             break;
         }
-        
-        // Otherwise, adjust search boundaries based on read values
-        off_t new_lo = lo;
-        off_t new_hi = hi;
-        
-        for (int i = 0; i < active_reads; i++) {
-            if (!reads[i].valid) continue;
-            
-            off_t elem_idx = reads[i].offset / sizeof(uint64_t);
-            
-            if (reads[i].value == target) {
-                // Found it!
-                found = 1;
-                target_offset = reads[i].offset;
-                break;
+    }
+
+    while (in_flight > 0) {
+        ret = io_uring_submit_and_wait(ring, 1);
+        if (submit_failed(ret)) {
+            // The reads point into the lookup slots, which stay with the ring
+            fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+            abandon_reads(ctx, in_flight);
+            return -1;
+        }
+
+        struct io_uring_cqe *cqes[BATCH_QUEUE_DEPTH];
+        int count = io_uring_peek_batch_cqe(ring, cqes, BATCH_QUEUE_DEPTH);
+
+        for (int i = 0; i < count; i++) {
+            read_data *rd = io_uring_cqe_get_data(cqes[i]);
+            batch_lookup *lk = rd->owner;
+            in_flight--;
+
+            if (cqes[i]->res == sizeof(uint64_t)) {
+                rd->valid = 1;
+            } else {
+                fprintf(stderr, "Read failed: %s\n",
+                        cqes[i]->res < 0 ? strerror(-cqes[i]->res) : "short read");
+                result = -1;
             }
 
-            if (reads[i].value < target) {
-                // Target is in the upper half
-                if (elem_idx + 1 > new_lo) {
-                    new_lo = elem_idx + 1;
+            if (--lk->pending > 0) continue;
+
+            // The round is complete: narrow the range or finish this lookup.
+            // After an error nothing new starts; lookups end once the reads
+            // they queued are back.
+            off_t found_offset;
+            int hit = narrow_range(lk->reads, lk->active_reads, lk->target, &lk->lo, &lk->hi, &found_offset);
+            if (!hit && result == 0 && lk->lo <= lk->hi) {
+                if (batch_start_round(ctx, fd, lk) < 0) {
+                    result = -1;
                 }
-            } else {
-                // Target is in the lower half
-                if (elem_idx - 1 < new_hi) {
-                    new_hi = elem_idx - 1;
+                in_flight += lk->pending;
+                *total_reads += lk->pending;
+                continue;
+            }
+
+            indices[lk->target_idx] = hit ? (int64_t)(found_offset / sizeof(uint64_t)) : -1;
+            found_count += hit;
+
+            // Reuse the slot for the next pending target
+            if (result == 0) {
+                ret = batch_admit(ctx, fd, num_elements, sparse_index, lk, targets, num_targets,
+                                  &next_target, indices, total_reads);
+                in_flight += lk->pending;
+                if (ret < 0) {
+                    result = -1;
                 }
             }
         }
-        
-        if (found) break;
-        
-        // Update boundaries for next iteration
-        lo = new_lo;
-        hi = new_hi;
 
-        // When lo == hi, the next iteration will handle it correctly through the main loop
-        // with active_reads = 1, no special case needed
+        // Mark all CQEs as seen at once
+        io_uring_cq_advance(ring, count);
     }
-    
-cleanup:
-    // Unregister buffers if they were registered
-    if (buffers_registered) {
-        io_uring_unregister_buffers(&ring);
+
+    return result < 0 ? -1 : found_count;
+}
+
+// Batched binary search: looks up num_targets values in a file of sorted
+// uint64_t values over a single io_uring shared by all targets. Fills
+// *result (values found, reads performed) without printing anything.
+// Returns 0 on success, -1 on error.
+int binary_search_uint64_batch(const char *filepath, const uint64_t *targets, size_t num_targets,
+                               int64_t *indices, int use_sqpoll, int use_buffers, bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+    uint64_t total_reads = 0;
+
+    search_result_reset(result);
+    if (num_targets == 0) {
+        return 0;
     }
 
-    // Clean up io_uring
-    io_uring_queue_exit(&ring);
-    close(fd);
-    
-    // End timing
-    end_time = get_microseconds();
-    double elapsed_ms = (end_time - start_time) / 1000.0;
-    
-    if (found) {
-        printf("Found uint64_t value %" PRIu64 " at offset %lld (element index %lld)\n", 
-               target, (long long)target_offset, (long long)(target_offset / sizeof(uint64_t)));
-    } else {
-        printf("uint64_t value %" PRIu64 " not found in file\n", target);
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open the file and set up the ring
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_IOURING;
+    opts.use_sqpoll = use_sqpoll;
+    opts.use_buffers = use_buffers;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
     }
-    
-    // Print timing information
-    printf("Search statistics:\n");
-    printf("  Total time: %.3f ms\n", elapsed_ms);
-    printf("  Total reads performed: %d\n", total_reads);
-    printf("  Average time per read: %.3f ms\n", elapsed_ms / total_reads);
-    printf("  Total bytes read: %zu\n", total_reads * sizeof(uint64_t));
-    printf("  IO_uring mode: %s%s\n",
-           sqpoll_enabled ? "SQPOLL (kernel polling)" : "Standard",
-           buffers_registered ? " with buffer registration" : "");
 
+    int found = iouring_lookup_batch(handle->uring, handle->fd, handle->num_elements, NULL, targets, num_targets,
+                                     indices, &total_reads);
+
+    // Clean up
+    bss_close(handle);
+    if (found < 0) {
+        return -1;
+    }
+    result->found = found;
+    result->probes = (int)total_reads;
+    result->bytes_read = total_reads * sizeof(uint64_t);   // The batched core reads single values
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
     return 0;
-}
\ No newline at end of file
+}
@@ -6,26 +6,89 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <sys/stat.h>
+
+#define ASYNC_IN_FLIGHT 1024     // Asynchronous lookups in flight at once (-V)
 
 // Print usage information
 void print_usage(const char *program_name) {
     fprintf(stderr, "Usage: %s -i <implementation> <filepath> <target_uint64> [options]\n", program_name);
-    fprintf(stderr, "  -i <implementation>: Implementation to use (required)\n");
+    fprintf(stderr, "  -i <implementation>: Implementation to use (required); with -T a comma-separated list\n");
     fprintf(stderr, "      1 = Simple mmap (main_mmap.c)\n");
     fprintf(stderr, "      2 = IO_uring (main_iouring.c)\n");
     fprintf(stderr, "      3 = Parallel mmap (main_parallel_mmap.c)\n");
+    fprintf(stderr, "      4 = Eytzinger layout over mmap (eytzinger_search.c); <filepath> must be in Eytzinger order\n");
+    fprintf(stderr, "      5 = Multi-threaded IO_uring, one ring per worker (iouring_mt_search.c)\n");
+    fprintf(stderr, "      6 = Interpolation search over mmap, or a learned model with -m/-M (interpolation_search.c)\n");
+    fprintf(stderr, "      7 = Frame-of-reference compressed blocks over mmap (compressed_search.c); <filepath> must be compressed\n");
+    fprintf(stderr, "      8 = Auto: per lookup, mmap, parallel mmap or IO_uring by page cache residency and latency (auto_search.c)\n");
     fprintf(stderr, "  <filepath>: Path to the file to search in\n");
     fprintf(stderr, "  <target_uint64>: Value to search for\n");
     fprintf(stderr, "  Options:\n");
-    fprintf(stderr, "    -t <num_threads>: Number of threads (for implementation 3 only, default: 32)\n");
-    fprintf(stderr, "    -c: Create test file\n");
+    fprintf(stderr, "    -t <num_threads>: Number of threads (for implementations 3 and 5, default: 32)\n");
+    fprintf(stderr, "    -g: Pin the worker threads to CPUs (implementations 3 and 5)\n");
+    fprintf(stderr, "    -o: Cooperative k-ary mode: threads probe shared pivots each round (implementation 3 only)\n");
+    fprintf(stderr, "    -c: Create test file (for implementations 4 and 7 it is written to <filepath>.sorted and converted)\n");
+    fprintf(stderr, "    -r <sorted_file>: Re-layout <sorted_file> into <filepath> before running: Eytzinger order for\n");
+    fprintf(stderr, "                      implementation 4, compressed blocks for implementation 7\n");
     fprintf(stderr, "    -s <size>: Number of elements in test file (default: 1000000)\n");
-    fprintf(stderr, "    -p <step>: Step between values in test file (default: 10)\n");
+    fprintf(stderr, "    -p <step>: Step between values in test file (default: 10), the mean gap for -G\n");
+    fprintf(stderr, "    -G <distribution>: Gaps between test file keys: sequential (default), random, clustered,\n");
+    fprintf(stderr, "                       duplicates or skewed (heavy-tailed)\n");
+    fprintf(stderr, "    -j <threads>: Threads generating the test file (default: one per CPU)\n");
+    fprintf(stderr, "    -A: Preallocate the test file with fallocate() before writing it\n");
     fprintf(stderr, "    -d: Drop caches before running (requires sudo permissions)\n");
     fprintf(stderr, "    -n <iterations>: Number of iterations to run (default: 1)\n");
     fprintf(stderr, "    -q: Use SQPOLL mode for IO_uring (requires root privileges, implementation 2 only)\n");
+    fprintf(stderr, "    -Q <ms>: Idle time before the shared SQPOLL thread sleeps, fixed by the first handle (default: 2000)\n");
+    fprintf(stderr, "    -I: Poll the device for completions (IOPOLL, requires -u)\n");
     fprintf(stderr, "    -b: Use buffer registration for IO_uring (zero-copy I/O, implementation 2 only)\n");
-    fprintf(stderr, "    -a: Enable optimizations for small ranges in IO_uring (readahead and linear search, implementation 2 only)\n");
+    fprintf(stderr, "    -a: Read whole 4 KiB pages in IO_uring and finish the search in memory (implementation 2 only)\n");
+    fprintf(stderr, "    -B <block_size>: Bytes per IO_uring block read, a power of two (implies -a)\n");
+    fprintf(stderr, "    -u: Bypass the page cache with O_DIRECT block reads into registered buffers (implementation 2)\n");
+    fprintf(stderr, "    -C <blocks>: Blocks kept in the IO_uring block cache (default: 256)\n");
+    fprintf(stderr, "    -F <fanout>: Speculative reads per IO_uring round, 1-64 (default: 4, dropping to 1 for small ranges)\n");
+    fprintf(stderr, "    -S: Two-level speculation: also issue the next IO_uring round's reads for every outcome\n");
+    fprintf(stderr, "    -k <batch_size>: Look up <batch_size> values per iteration over one shared ring (implementation 2, or any with -P);\n");
+    fprintf(stderr, "                     the batch holds the target plus values drawn uniformly from [0, target]\n");
+    fprintf(stderr, "                     (implementation 1 sorts the batch and searches it as one merge-style pass)\n");
+    fprintf(stderr, "    -P: Open the file once and reuse the handle across iterations (only lookups are timed)\n");
+    fprintf(stderr, "    -V: Run the batch (-k) through the asynchronous API: one block read per probe, up to 1024\n");
+    fprintf(stderr, "        lookups in flight on one thread with completion callbacks (requires -P)\n");
+    fprintf(stderr, "    -K <kernel>: In-memory search kernel for implementation 1 and sparse index blocks:\n");
+    fprintf(stderr, "                 scalar (default), simd (AVX2/AVX-512, picked at runtime) or branchless (cmov + prefetch)\n");
+    fprintf(stderr, "    -x: Build a sparse in-memory index of every page's first key when opening (requires -P)\n");
+    fprintf(stderr, "    -X: Like -x, but load/store the index from/to the <filepath>.idx sidecar file\n");
+    fprintf(stderr, "    -m <error>: Fit a piecewise-linear model predicting positions within <error> elements (implementation 6)\n");
+    fprintf(stderr, "    -M <error>: Like -m, but load/store the model from/to the <filepath>.pla sidecar file\n");
+    fprintf(stderr, "    -L: Find the lower bound of <target_uint64> (first value >= target) instead of an exact match\n");
+    fprintf(stderr, "    -U: Find the upper bound of <target_uint64> (first value > target) instead of an exact match\n");
+    fprintf(stderr, "    -R <end>: Scan every value in [<target_uint64>, <end>) instead of an exact match\n");
+    fprintf(stderr, "    -y: Find the first and last copy of <target_uint64> and count them (files with duplicate keys)\n");
+    fprintf(stderr, "    -J: <filepath> is a set of sorted segment files: a directory, or a manifest with one\n");
+    fprintf(stderr, "        \"<path> [<min_key> <max_key>]\" line per segment; only segments whose key range holds\n");
+    fprintf(stderr, "        the target are searched, on up to -t threads\n");
+    fprintf(stderr, "    -w <key_bytes>: Width of the keys in the file: 4, 8 (default) or 16 bytes (implementations 1 and 2)\n");
+    fprintf(stderr, "    -z <record_bytes>: Bytes per record, the key followed by a payload (default: the key width)\n");
+    fprintf(stderr, "    -H: Ask for transparent huge pages on the mapping (mmap implementations, needs file THP)\n");
+    fprintf(stderr, "    -E: Prefault the whole mapping when opening (MAP_POPULATE, mmap implementations)\n");
+    fprintf(stderr, "    -l <levels>: mlock() the pages of the top <levels> levels of the search tree (mmap implementations)\n");
+    fprintf(stderr, "    -W <levels>: Prewarm the pages of the top <levels> levels with MADV_WILLNEED (mmap implementations)\n");
+    fprintf(stderr, "    -T <lookups>: Benchmark mode (replaces -n and <target_uint64>, which may be omitted): time open,\n");
+    fprintf(stderr, "                  search and close of every -i implementation over <lookups> generated lookups;\n");
+    fprintf(stderr, "                  implementations 4 and 7 search <filepath>.eytzinger / <filepath>.compressed,\n");
+    fprintf(stderr, "                  converted from the sorted <filepath> when missing or stale\n");
+    fprintf(stderr, "    -N <keys>: Distinct keys the benchmark draws from the file (default: 1000000)\n");
+    fprintf(stderr, "    -Z <theta>: Zipfian benchmark keys with skew <theta> in (0, 1), e.g. 0.99 (default: uniform)\n");
+    fprintf(stderr, "    -Y <percent>: Percentage of benchmark keys present in the file (default: 100)\n");
+    fprintf(stderr, "    -D: Cold benchmark runs: evict the file from the page cache before opening (default: warm-up pass)\n");
+    fprintf(stderr, "    -f <format>: Statistics as text (default), csv or json, with p99/p99.9/p99.99 from a constant-memory\n");
+    fprintf(stderr, "                 latency histogram\n");
+    fprintf(stderr, "    -O <file>: Write the csv/json statistics to <file> instead of stdout\n");
+    fprintf(stderr, "    -e: Count page faults, probe depth (vs log2 N), io_uring reads and block cache hits of the\n");
+    fprintf(stderr, "        lookups (requires -P or -T)\n");
+    fprintf(stderr, "    -v <level>: 0 = only results and statistics, 1 = also run parameters, progress and setup notes\n");
+    fprintf(stderr, "                (default), 2 = also the outcome of every iteration\n");
     exit(EXIT_FAILURE);
 }
 
@@ -38,14 +101,248 @@ void print_stats(const search_stats_t *stats, const char *impl_name) {
     printf("  Median time:  %.3f ms\n", stats->median);
     printf("  90th %%tile:   %.3f ms\n", stats->p90);
     printf("  95th %%tile:   %.3f ms\n", stats->p95);
+    printf("  99th %%tile:   %.3f ms\n", stats->p99);
+    printf("  99.9th %%tile: %.3f ms\n", stats->p999);
+    printf("  99.99th %%tile: %.3f ms\n", stats->p9999);
     printf("  Std Dev:      %.3f ms\n", stats->std_dev);
 }
 
-// Function to run a single search iteration and measure time
-int run_iteration(int implementation, const char *filepath, uint64_t target, int num_threads, int drop_caches, int use_sqpoll, int use_buffers, int use_readahead, double *duration) {
+// Format of the statistics report
+typedef enum {
+    OUTPUT_TEXT = 0,   // Human-readable text on stdout
+    OUTPUT_CSV,        // One header line, then one line per implementation
+    OUTPUT_JSON        // An array of one object per implementation
+} output_format_t;
+
+// One named number of a machine-readable report row
+typedef struct {
+    const char *name;
+    double value;
+} report_field;
+
+// Write one report row; row 0 also writes the CSV header or opens the JSON array
+static void report_row(FILE *out, output_format_t format, int row, const char *implementation,
+                       const report_field *fields, int num_fields) {
+    if (format == OUTPUT_CSV) {
+        if (row == 0) {
+            fprintf(out, "implementation");
+            for (int f = 0; f < num_fields; f++) {
+                fprintf(out, ",%s", fields[f].name);
+            }
+            fprintf(out, "\n");
+        }
+        fprintf(out, "\"%s\"", implementation);
+        for (int f = 0; f < num_fields; f++) {
+            fprintf(out, ",%.9g", fields[f].value);
+        }
+        fprintf(out, "\n");
+    } else if (format == OUTPUT_JSON) {
+        fprintf(out, "%s  {\"implementation\": \"%s\"", row == 0 ? "[\n" : ",\n", implementation);
+        for (int f = 0; f < num_fields; f++) {
+            fprintf(out, ", \"%s\": %.9g", fields[f].name, fields[f].value);
+        }
+        fprintf(out, "}");
+    }
+}
+
+// Finish a report of num_rows rows
+static void report_end(FILE *out, output_format_t format, int num_rows) {
+    if (format == OUTPUT_JSON) {
+        fprintf(out, num_rows ? "\n]\n" : "[]\n");
+    }
+}
+
+// Latency distribution fields of a report row, with the unit in their names
+static int latency_fields(report_field *fields, const search_stats_t *stats, int in_us) {
+    report_field latency[] = {
+        { in_us ? "min_us" : "min_ms", stats->min },
+        { in_us ? "avg_us" : "avg_ms", stats->avg },
+        { in_us ? "median_us" : "median_ms", stats->median },
+        { in_us ? "p90_us" : "p90_ms", stats->p90 },
+        { in_us ? "p95_us" : "p95_ms", stats->p95 },
+        { in_us ? "p99_us" : "p99_ms", stats->p99 },
+        { in_us ? "p999_us" : "p999_ms", stats->p999 },
+        { in_us ? "p9999_us" : "p9999_ms", stats->p9999 },
+        { in_us ? "max_us" : "max_ms", stats->max },
+        { in_us ? "std_dev_us" : "std_dev_ms", stats->std_dev },
+    };
+    memcpy(fields, latency, sizeof(latency));
+    return sizeof(latency) / sizeof(latency[0]);
+}
+
+// Per-lookup lookup counters of a report row
+static int counter_fields(report_field *fields, const bss_counters_t *counters) {
+    double lookups = counters->lookups ? (double)counters->lookups : 1;
+    uint64_t cache_probes = counters->cache_hits + counters->cache_misses;
+    uint64_t routed = counters->routed_mmap + counters->routed_parallel + counters->routed_iouring;
+    double routes = routed ? (double)routed : 1;
+    report_field averages[] = {
+        { "minor_faults_per_lookup", counters->minor_faults / lookups },
+        { "major_faults_per_lookup", counters->major_faults / lookups },
+        { "probes_per_lookup", counters->probed_lookups ? (double)counters->probes / counters->probed_lookups : 0 },
+        { "log2_elements", counters->log2_elements },
+        { "io_requests_per_lookup", counters->io_requests / lookups },
+        { "io_bytes_per_lookup", counters->io_bytes / lookups },
+        { "cache_hit_rate", cache_probes ? (double)counters->cache_hits / cache_probes : 0 },
+        { "routed_mmap_share", counters->routed_mmap / routes },
+        { "routed_parallel_share", counters->routed_parallel / routes },
+        { "routed_iouring_share", counters->routed_iouring / routes },
+    };
+    memcpy(fields, averages, sizeof(averages));
+    return sizeof(averages) / sizeof(averages[0]);
+}
+
+// Print lookup counters, leaving out those the engine has no use for
+static void print_counters(const bss_counters_t *counters) {
+    double lookups = counters->lookups ? (double)counters->lookups : 1;
+    printf("  Lookup counters (%" PRIu64 " lookups):\n", counters->lookups);
+    printf("    Minor faults:   %" PRIu64 " (%.3f per lookup)\n", counters->minor_faults,
+           counters->minor_faults / lookups);
+    printf("    Major faults:   %" PRIu64 " (%.3f per lookup)\n", counters->major_faults,
+           counters->major_faults / lookups);
+    if (counters->probed_lookups) {
+        printf("    Probe depth:    %.2f per lookup (log2 N = %.2f)\n",
+               (double)counters->probes / counters->probed_lookups, counters->log2_elements);
+    }
+    if (counters->io_requests) {
+        printf("    io_uring reads: %" PRIu64 " (%.2f per lookup, %.0f bytes per lookup)\n", counters->io_requests,
+               counters->io_requests / lookups, counters->io_bytes / lookups);
+    }
+    if (counters->cache_hits + counters->cache_misses) {
+        printf("    Block cache:    %.1f%% hits (%" PRIu64 " of %" PRIu64 " probes)\n",
+               100.0 * counters->cache_hits / (counters->cache_hits + counters->cache_misses),
+               counters->cache_hits, counters->cache_hits + counters->cache_misses);
+    }
+    if (counters->routed_mmap + counters->routed_parallel + counters->routed_iouring) {
+        printf("    Auto routes:    %" PRIu64 " mmap, %" PRIu64 " parallel mmap, %" PRIu64 " io_uring\n",
+               counters->routed_mmap, counters->routed_parallel, counters->routed_iouring);
+    }
+}
+
+// Kind of query each iteration runs
+typedef enum {
+    QUERY_FIND = 0,       // Exact match
+    QUERY_LOWER_BOUND,    // First value >= target
+    QUERY_UPPER_BOUND,    // First value > target
+    QUERY_SCAN,           // Every value in [target, range_end)
+    QUERY_EQUAL_RANGE     // First and last copy of target
+} query_t;
+
+// Range scan callback: fold the values into a checksum so every one is read
+static int scan_checksum(const uint64_t *values, size_t count, size_t first_pos, void *arg) {
+    uint64_t *sum = (uint64_t *)arg;
+    (void)first_pos;
+    for (size_t i = 0; i < count; i++) {
+        *sum += values[i];
+    }
+    return 0;
+}
+
+// Asynchronous lookup callback: store the outcome in the batch's index slot
+// (-2 marks an error)
+static void async_done(void *arg, uint64_t target, int found, int64_t index) {
+    (void)target;
+    *(int64_t *)arg = found < 0 ? -2 : index;
+}
+
+// Look up the batch through the asynchronous API, keeping as many lookups in
+// flight as the context takes. Returns the number found or -1 on error.
+static int run_async_batch(bss_async_t *async, const uint64_t *batch_keys, int64_t *batch_indices,
+                           size_t batch_size) {
+    size_t submitted = 0;
+    while (submitted < batch_size || bss_async_in_flight(async)) {
+        while (submitted < batch_size) {
+            if (bss_async_submit(async, batch_keys[submitted], async_done, &batch_indices[submitted]) < 0) {
+                if (errno != EAGAIN) {
+                    return -1;
+                }
+                break;
+            }
+            submitted++;
+        }
+        if (bss_async_poll(async, 1) < 0) {
+            return -1;
+        }
+    }
+
+    int found = 0;
+    for (size_t i = 0; i < batch_size; i++) {
+        if (batch_indices[i] == -2) {
+            return -1;
+        }
+        found += batch_indices[i] >= 0;
+    }
+    return found;
+}
+
+// Run a query through a handle. Bounds store the position in result->index,
+// scans the number of values visited, equal ranges the first and last copy
+// and their count. Returns 1 if the query hit, 0 if not, -1 on error.
+static int run_query(bss_handle_t *handle, query_t query, uint64_t target, uint64_t range_end,
+                     const uint64_t *batch_keys, int64_t *batch_indices, size_t batch_size,
+                     bss_search_result_t *result) {
+    size_t pos, last, count = 0;
+    int ret;
+
+    switch (query) {
+        case QUERY_LOWER_BOUND:
+        case QUERY_UPPER_BOUND:
+            ret = query == QUERY_LOWER_BOUND ? bss_lower_bound(handle, target, &pos)
+                                             : bss_upper_bound(handle, target, &pos);
+            if (ret < 0) {
+                return -1;
+            }
+            result->index = pos;
+            return pos < bss_num_elements(handle);
+        case QUERY_SCAN: {
+            uint64_t sum = 0;
+            int64_t visited = bss_scan(handle, target, range_end, scan_checksum, &sum);
+            if (visited < 0) {
+                return -1;
+            }
+            result->index = visited;
+            return visited > 0;
+        }
+        case QUERY_EQUAL_RANGE:
+            ret = bss_equal_range(handle, target, &pos, &last, &count);
+            if (ret > 0) {
+                result->index = pos;
+                result->last = last;
+            }
+            result->count = count;
+            return ret;
+        default:
+            if (batch_size > 1) {
+                return bss_find_batch(handle, batch_keys, batch_size, batch_indices);
+            }
+            return bss_find(handle, target, &result->index);
+    }
+}
+
+// Whether the options need features only the handle API offers
+static int needs_handle(const bss_options_t *opts) {
+    return opts->engine == BSS_ENGINE_IOURING_MT || opts->kernel != BSS_KERNEL_SCALAR || opts->parallel_mode != BSS_PARALLEL_SLICES || opts->pin_threads ||
+           opts->io_fanout || opts->io_speculate || opts->io_block_size || opts->io_cache_blocks ||
+           opts->use_direct || opts->use_iopoll || opts->sqpoll_idle_ms || opts->model_error ||
+           opts->key_size != sizeof(uint64_t) || opts->record_size || opts->map_hugepage || opts->map_populate ||
+           opts->lock_levels || opts->prewarm_levels || opts->collect_counters || opts->engine == BSS_ENGINE_AUTO;
+}
+
+// Function to run a single search iteration and measure time.
+// With a persistent handle only the lookup itself is timed; otherwise the
+// whole open/search/close cycle of the selected implementation is. The
+// outcome goes to *result (probes and bytes read only come from the
+// implementations' own entry points). Returns the number found (for bounds
+// and scans whether they hit) or -1 on error.
+int run_iteration(const bss_options_t *opts, bss_handle_t *handle, bss_async_t *async, const char *filepath,
+                  uint64_t target, int drop_caches, query_t query, uint64_t range_end,
+                  const uint64_t *batch_keys, int64_t *batch_indices, size_t batch_size,
+                  bss_search_result_t *result, uint64_t *duration_ns) {
     int ret = 0;
     uint64_t start_time, end_time;
 
+    *result = (bss_search_result_t){ .index = -1, .last = -1 };
+
     // Drop caches if requested (before timing starts)
     if (drop_caches) {
         int status = system("sudo ./drop_caches.sh > /dev/null 2>&1");
@@ -56,35 +353,256 @@ int run_iteration(int implementation, const char *filepath, uint64_t target, int
     }
 
     // Start timing
-    start_time = get_microseconds();
+    start_time = get_nanoseconds();
 
-    // Run the selected implementation
-    switch (implementation) {
-        case 1:
-            ret = binary_search_uint64_mmap(filepath, target);
-            break;
-        case 2:
-            ret = binary_search_uint64(filepath, target, use_sqpoll, use_buffers, use_readahead);
-            break;
-        case 3:
-            ret = parallel_binary_search_uint64_mmap(filepath, target, num_threads);
-            break;
-        default:
-            fprintf(stderr, "Invalid implementation\n");
+    if (handle) {
+        // Search through the already opened handle
+        ret = async ? run_async_batch(async, batch_keys, batch_indices, batch_size)
+                    : run_query(handle, query, target, range_end, batch_keys, batch_indices, batch_size, result);
+    } else if (needs_handle(opts) || query != QUERY_FIND) {
+        // One-shot open/search/close through the handle API
+        bss_handle_t *oneshot = bss_open(filepath, opts);
+        if (!oneshot) {
             return -1;
+        }
+        ret = run_query(oneshot, query, target, range_end, batch_keys, batch_indices, batch_size, result);
+        bss_close(oneshot);
+    } else {
+        // Run the selected implementation
+        switch (opts->engine) {
+            case BSS_ENGINE_MMAP:
+                ret = binary_search_uint64_mmap(filepath, target, result);
+                break;
+            case BSS_ENGINE_IOURING:
+                if (batch_size > 1) {
+                    ret = binary_search_uint64_batch(filepath, batch_keys, batch_size, batch_indices,
+                                                     opts->use_sqpoll, opts->use_buffers, result);
+                } else {
+                    ret = binary_search_uint64(filepath, target, opts->use_sqpoll, opts->use_buffers,
+                                               opts->use_readahead, result);
+                }
+                break;
+            case BSS_ENGINE_PARALLEL_MMAP:
+                ret = parallel_binary_search_uint64_mmap(filepath, target, opts->num_threads, result);
+                break;
+            case BSS_ENGINE_EYTZINGER:
+                ret = eytzinger_search_uint64_mmap(filepath, target, result);
+                break;
+            case BSS_ENGINE_INTERPOLATION:
+                ret = interpolation_search_uint64_mmap(filepath, target, result);
+                break;
+            case BSS_ENGINE_COMPRESSED:
+                ret = compressed_search_uint64_mmap(filepath, target, result);
+                break;
+            default:
+                fprintf(stderr, "Invalid implementation\n");
+                return -1;
+        }
+        ret = ret < 0 ? -1 : result->found;
     }
     
     // End timing
-    end_time = get_microseconds();
-    
-    // Calculate duration in milliseconds
-    *duration = (end_time - start_time) / 1000.0;
-    
+    end_time = get_nanoseconds();
+    *duration_ns = end_time - start_time;
+
+    if (ret >= 0) {
+        result->found = ret;
+        if (!result->elapsed_ms) {
+            result->elapsed_ms = *duration_ns / 1e6;
+        }
+    }
+    return ret;
+}
+
+// Name of an implementation in benchmark reports
+static const char *engine_name(int implementation) {
+    switch (implementation) {
+        case 1: return "Simple mmap";
+        case 2: return "IO_uring";
+        case 3: return "Parallel mmap";
+        case 4: return "Eytzinger mmap";
+        case 5: return "Multi-threaded IO_uring";
+        case 6: return "Interpolation mmap";
+        case 7: return "Compressed mmap";
+        case 8: return "Auto";
+        default: return "Unknown implementation";
+    }
+}
+
+// Convert the sorted file for the Eytzinger and compressed engines, unless an
+// up-to-date copy already exists (an Eytzinger copy is one pad element longer)
+static int prepare_layout(const char *sorted_path, const char *path, int implementation) {
+    struct stat src, dst;
+    if (stat(sorted_path, &src) == 0 && stat(path, &dst) == 0 && dst.st_mtime >= src.st_mtime &&
+        (implementation == 7 || dst.st_size == src.st_size + (off_t)sizeof(uint64_t))) {
+        return 0;
+    }
+    return implementation == 7 ? convert_to_compressed(sorted_path, path) : convert_to_eytzinger(sorted_path, path);
+}
+
+// Benchmark every implementation against one generated workload and print
+// the phases, throughput and latency distribution of each
+static int run_benchmark(const char *filepath, const int *engines, int num_engines, const bss_options_t *base_opts,
+                         const bss_bench_config_t *cfg, output_format_t format, FILE *report) {
+    bss_workload_t workload;
+    bss_bench_result_t results[8];
+    char paths[8][4096];
+
+    if (bss_get_verbosity() >= BSS_VERBOSITY_NORMAL) {
+        printf("Generating %" PRIu64 " %s lookups over %zu keys (%.0f%% hits)...\n", cfg->num_lookups,
+               cfg->distribution == BSS_WORKLOAD_ZIPF ? "Zipfian" : "uniform", cfg->num_keys, cfg->hit_ratio * 100);
+    }
+    if (bss_workload_create(filepath, base_opts->key_size, base_opts->record_size, cfg, &workload) < 0) {
+        return -1;
+    }
+
+    for (int e = 0; e < num_engines; e++) {
+        const char *suffix = engines[e] == 4 ? ".eytzinger" : engines[e] == 7 ? ".compressed" : "";
+        snprintf(paths[e], sizeof(paths[e]), "%s%s", filepath, suffix);
+        if (*suffix && prepare_layout(filepath, paths[e], engines[e]) < 0) {
+            bss_workload_free(&workload);
+            return -1;
+        }
+
+        bss_options_t opts = *base_opts;
+        opts.engine = (bss_engine_t)engines[e];
+        if (bss_get_verbosity() >= BSS_VERBOSITY_NORMAL) {
+            printf("\nBenchmarking %s (%s)...\n", engine_name(engines[e]), cfg->cold ? "cold" : "warm");
+        }
+        if (bss_benchmark(paths[e], &opts, &workload, cfg, &results[e]) < 0) {
+            bss_workload_free(&workload);
+            return -1;
+        }
+
+        const bss_bench_result_t *r = &results[e];
+        if (r->found != workload.expected_hits) {
+            fprintf(stderr, "Warning: %s found %" PRIu64 " of %" PRIu64 " expected hits\n",
+                    engine_name(engines[e]), r->found, workload.expected_hits);
+        }
+        if (format != OUTPUT_TEXT) {
+            continue;
+        }
+        printf("  Open:         %.3f ms\n", r->open_ms);
+        if (!cfg->cold) {
+            printf("  Warm-up:      %.3f ms\n", r->warmup_ms);
+        }
+        printf("  Search:       %.3f ms (%" PRIu64 " lookups, %" PRIu64 " found, %" PRIu64 " expected)\n",
+               r->search_ms, r->lookups, r->found, workload.expected_hits);
+        printf("  Close:        %.3f ms\n", r->close_ms);
+        printf("  Throughput:   %.0f lookups/s\n", r->throughput);
+        printf("  Latency per %s (us): min %.3f, median %.3f, avg %.3f, p90 %.3f, p95 %.3f\n",
+               cfg->batch_size > 1 ? "batch" : "lookup", r->latency.min, r->latency.median, r->latency.avg,
+               r->latency.p90, r->latency.p95);
+        printf("                       p99 %.3f, p99.9 %.3f, p99.99 %.3f, max %.3f\n",
+               r->latency.p99, r->latency.p999, r->latency.p9999, r->latency.max);
+        if (base_opts->collect_counters) {
+            print_counters(&r->counters);
+        }
+    }
+
+    if (format != OUTPUT_TEXT) {
+        for (int e = 0; e < num_engines; e++) {
+            const bss_bench_result_t *r = &results[e];
+            report_field fields[40] = {
+                { "keys", (double)cfg->num_keys },
+                { "zipf_theta", cfg->distribution == BSS_WORKLOAD_ZIPF ? cfg->zipf_theta : 0 },
+                { "hit_ratio", cfg->hit_ratio },
+                { "batch_size", (double)(cfg->batch_size ? cfg->batch_size : 1) },
+                { "cold", (double)cfg->cold },
+                { "lookups", (double)r->lookups },
+                { "found", (double)r->found },
+                { "expected", (double)workload.expected_hits },
+                { "open_ms", r->open_ms },
+                { "warmup_ms", r->warmup_ms },
+                { "search_ms", r->search_ms },
+                { "close_ms", r->close_ms },
+                { "lookups_per_s", r->throughput },
+            };
+            int num_fields = 13 + latency_fields(fields + 13, &r->latency, 1);
+            if (base_opts->collect_counters) {
+                num_fields += counter_fields(fields + num_fields, &r->counters);
+            }
+            report_row(report, format, e, engine_name(engines[e]), fields, num_fields);
+        }
+        report_end(report, format, num_engines);
+        bss_workload_free(&workload);
+        return 0;
+    }
+
+    printf("\n%-24s %10s %10s %14s %10s %10s\n", "Implementation", "Open ms", "Search ms", "Lookups/s",
+           "p50 us", "p95 us");
+    for (int e = 0; e < num_engines; e++) {
+        const bss_bench_result_t *r = &results[e];
+        printf("%-24s %10.3f %10.3f %14.0f %10.3f %10.3f\n", engine_name(engines[e]), r->open_ms, r->search_ms,
+               r->throughput, r->latency.median, r->latency.p95);
+    }
+
+    bss_workload_free(&workload);
+    return 0;
+}
+
+// Look up target in every segment of a directory or manifest, opened once,
+// and print which segment and element held it with the lookup latencies
+static int run_segments(const char *path, const bss_options_t *opts, uint64_t target, uint64_t iterations,
+                        output_format_t format, FILE *report) {
+    bss_segments_t *set = bss_segments_open(path, opts);
+    if (!set) {
+        return -1;
+    }
+    bss_histogram_t *durations = (bss_histogram_t *)malloc(sizeof(bss_histogram_t));
+    if (!durations) {
+        perror("malloc");
+        bss_segments_close(set);
+        return -1;
+    }
+    bss_histogram_init(durations);
+
+    int ret = 0, segment = -1;
+    int64_t index = -1;
+    for (uint64_t i = 0; i < iterations && ret >= 0; i++) {
+        uint64_t start_time = get_nanoseconds();
+        ret = bss_segments_find(set, target, &segment, &index);
+        bss_histogram_record(durations, get_nanoseconds() - start_time);
+    }
+
+    if (ret > 0) {
+        printf("Found uint64_t value %" PRIu64 " in segment %d (%s) at element index %lld\n", target, segment,
+               bss_segments_path(set, segment), (long long)index);
+    } else if (ret == 0) {
+        printf("uint64_t value %" PRIu64 " not found in any of %zu segments\n", target, bss_segments_count(set));
+    }
+
+    if (ret >= 0) {
+        search_stats_t stats;
+        char impl_name[64];
+        bss_histogram_stats(durations, 1e-6, &stats);
+        snprintf(impl_name, sizeof(impl_name), "%s over %zu segments", engine_name(opts->engine),
+                 bss_segments_count(set));
+        if (format == OUTPUT_TEXT) {
+            print_stats(&stats, impl_name);
+        } else {
+            report_field fields[40] = { { "iterations", (double)stats.iterations },
+                                        { "segments", (double)bss_segments_count(set) } };
+            int num_fields = 2 + latency_fields(fields + 2, &stats, 0);
+            report_row(report, format, 0, impl_name, fields, num_fields);
+            report_end(report, format, 1);
+        }
+    }
+
+    free(durations);
+    bss_segments_close(set);
     return ret;
 }
 
 int main(int argc, char *argv[]) {
     int implementation = 0;
+    int engines[8];           // Implementations to benchmark (-i list with -T)
+    int num_engines = 0;
+    bss_bench_config_t bench;
+    bss_default_bench_config(&bench);
+    bench.num_lookups = 0;    // Default to the classic iteration loop
+    output_format_t output_format = OUTPUT_TEXT;  // Default to human-readable statistics
+    const char *report_path = NULL;  // Default to writing csv/json statistics to stdout
     int num_threads = 32;
     int create_test = 0;
     int drop_caches = 0;
@@ -94,17 +612,137 @@ int main(int argc, char *argv[]) {
     size_t test_size = 1000000;
     uint64_t test_step = 10;
     uint64_t iterations = 1;  // Default to 1 iteration
+    size_t batch_size = 1;    // Default to single-value lookups
+    int persistent = 0;       // Default to opening the file on every iteration
+    int use_index = 0;        // Default to searching without a sparse index
+    int index_sidecar = 0;    // Default to building the sparse index in memory only
+    bss_kernel_t kernel = BSS_KERNEL_SCALAR;  // Default to the classic binary search loop
+    int cooperative = 0;      // Default to independent per-thread slices
+    int pin_threads = 0;      // Default to letting the scheduler place workers
+    int io_fanout = 0;        // Default to the adaptive number of reads per round
+    int io_speculate = 0;     // Default to one level of reads per round
+    size_t io_block_size = 0; // Default to the page size when -a is given
+    size_t io_cache_blocks = 0;  // Default to the library's cache size
+    int use_direct = 0;       // Default to reading through the page cache
+    int use_iopoll = 0;       // Default to interrupt-driven completions
+    int sqpoll_idle_ms = 0;   // Default to the library's SQPOLL idle time
+    size_t model_error = 0;   // Default to plain interpolation search for implementation 6
+    int model_sidecar = 0;    // Default to fitting the model in memory only
+    query_t query = QUERY_FIND;  // Default to exact-match lookups
+    uint64_t range_end = 0;   // End of the scanned range (-R)
+    size_t key_size = sizeof(uint64_t);  // Default to files of uint64_t keys
+    size_t record_size = 0;   // Default to records holding only the key
+    int map_hugepage = 0;     // Default to the kernel's page size policy
+    int map_populate = 0;     // Default to faulting pages in on demand
+    int lock_levels = 0;      // Default to leaving every page evictable
+    int prewarm_levels = 0;   // Default to no prewarming
+    int collect_counters = 0; // Default to uninstrumented lookups
+    int segmented = 0;        // Default to <filepath> being a single data file
+    int use_async = 0;        // Default to blocking batch lookups
+    bss_data_distribution_t test_distribution = BSS_DATA_SEQUENTIAL;  // Default to keys i * step
+    int test_threads = 0;     // Default to one generator thread per CPU
+    int test_preallocate = 0; // Default to growing the test file as it is written
+    int verbosity = BSS_VERBOSITY_NORMAL;  // Default to parameters, progress and setup notes
     int opt;
     const char *filepath = NULL;
+    const char *relayout_src = NULL;  // Sorted file to convert to Eytzinger layout or compressed blocks
     uint64_t target = 0;
     
     // Parse command-line options
-    while ((opt = getopt(argc, argv, "i:t:cs:p:dn:qba")) != -1) {
+    while ((opt = getopt(argc, argv, "i:t:ogcs:p:dn:qQ:IbauB:C:F:Sk:PxXr:K:LUR:m:M:w:z:HEl:W:T:N:Z:Y:Df:O:v:eG:j:AyJV")) != -1) {
         switch (opt) {
             case 'i':
-                implementation = atoi(optarg);
-                if (implementation < 1 || implementation > 3) {
-                    fprintf(stderr, "Invalid implementation: %d\n", implementation);
+                num_engines = 0;
+                for (char *item = strtok(optarg, ","); item; item = strtok(NULL, ",")) {
+                    int engine = atoi(item);
+                    if (engine < 1 || engine > 8 || num_engines == 8) {
+                        fprintf(stderr, "Invalid implementation: %s\n", item);
+                        print_usage(argv[0]);
+                    }
+                    engines[num_engines++] = engine;
+                }
+                implementation = num_engines ? engines[0] : 0;
+                break;
+            case 'T':
+                bench.num_lookups = strtoull(optarg, NULL, 10);
+                if (bench.num_lookups == 0) {
+                    fprintf(stderr, "Number of benchmark lookups must be positive\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'N':
+                bench.num_keys = strtoull(optarg, NULL, 10);
+                if (bench.num_keys == 0) {
+                    fprintf(stderr, "Benchmark key set must not be empty\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'Z':
+                bench.distribution = BSS_WORKLOAD_ZIPF;
+                bench.zipf_theta = atof(optarg);
+                if (bench.zipf_theta <= 0 || bench.zipf_theta >= 1) {
+                    fprintf(stderr, "Zipfian skew must be between 0 and 1 (exclusive)\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'Y':
+                bench.hit_ratio = atof(optarg) / 100;
+                if (bench.hit_ratio < 0 || bench.hit_ratio > 1) {
+                    fprintf(stderr, "Hit percentage must be between 0 and 100\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'D':
+                bench.cold = 1; // Evict the file before each benchmark run
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    output_format = OUTPUT_TEXT;
+                } else if (strcmp(optarg, "csv") == 0) {
+                    output_format = OUTPUT_CSV;
+                } else if (strcmp(optarg, "json") == 0) {
+                    output_format = OUTPUT_JSON;
+                } else {
+                    fprintf(stderr, "Invalid output format: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'O':
+                report_path = optarg;
+                break;
+            case 'G':
+                if (strcmp(optarg, "sequential") == 0) {
+                    test_distribution = BSS_DATA_SEQUENTIAL;
+                } else if (strcmp(optarg, "random") == 0) {
+                    test_distribution = BSS_DATA_RANDOM_GAPS;
+                } else if (strcmp(optarg, "clustered") == 0) {
+                    test_distribution = BSS_DATA_CLUSTERED;
+                } else if (strcmp(optarg, "duplicates") == 0) {
+                    test_distribution = BSS_DATA_DUPLICATES;
+                } else if (strcmp(optarg, "skewed") == 0) {
+                    test_distribution = BSS_DATA_SKEWED;
+                } else {
+                    fprintf(stderr, "Invalid key distribution: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'j':
+                test_threads = atoi(optarg);
+                if (test_threads <= 0) {
+                    fprintf(stderr, "Number of generator threads must be positive\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'A':
+                test_preallocate = 1; // fallocate() the test file first
+                break;
+            case 'e':
+                collect_counters = 1; // Instrument every lookup
+                break;
+            case 'v':
+                verbosity = atoi(optarg);
+                if (verbosity < BSS_VERBOSITY_QUIET || verbosity > BSS_VERBOSITY_DEBUG) {
+                    fprintf(stderr, "Verbosity must be 0, 1 or 2\n");
                     print_usage(argv[0]);
                 }
                 break;
@@ -115,6 +753,12 @@ int main(int argc, char *argv[]) {
                     print_usage(argv[0]);
                 }
                 break;
+            case 'o':
+                cooperative = 1; // Threads share one k-ary search instead of slicing the array
+                break;
+            case 'g':
+                pin_threads = 1; // Pin pool workers to CPUs
+                break;
             case 'c':
                 create_test = 1;
                 break;
@@ -141,130 +785,574 @@ int main(int argc, char *argv[]) {
             case 'q':
                 use_sqpoll = 1; // Enable SQPOLL mode for IO_uring
                 break;
+            case 'Q':
+                sqpoll_idle_ms = atoi(optarg);
+                if (sqpoll_idle_ms <= 0) {
+                    fprintf(stderr, "SQPOLL idle time must be positive\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'I':
+                use_iopoll = 1; // Polled completions for IO_uring
+                break;
             case 'b':
                 use_buffers = 1; // Enable buffer registration for IO_uring
                 break;
             case 'a':
-                use_readahead = 1; // Enable readahead for small ranges in IO_uring
+                use_readahead = 1; // Read whole pages through the block cache in IO_uring
+                break;
+            case 'B':
+                io_block_size = strtoull(optarg, NULL, 10);
+                if (io_block_size == 0) {
+                    fprintf(stderr, "Block size must be positive\n");
+                    print_usage(argv[0]);
+                }
+                use_readahead = 1;
+                break;
+            case 'u':
+                use_direct = 1; // O_DIRECT reads for IO_uring
+                break;
+            case 'C':
+                io_cache_blocks = strtoull(optarg, NULL, 10);
+                if (io_cache_blocks == 0) {
+                    fprintf(stderr, "Block cache size must be positive\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'F':
+                io_fanout = atoi(optarg);
+                if (io_fanout < 1 || io_fanout > 64) {
+                    fprintf(stderr, "IO_uring fan-out must be between 1 and 64\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'S':
+                io_speculate = 1; // Issue two levels of IO_uring reads per round
+                break;
+            case 'P':
+                persistent = 1; // Keep one search handle open across iterations
+                break;
+            case 'K':
+                if (strcmp(optarg, "scalar") == 0) {
+                    kernel = BSS_KERNEL_SCALAR;
+                } else if (strcmp(optarg, "simd") == 0) {
+                    kernel = BSS_KERNEL_SIMD;
+                } else if (strcmp(optarg, "branchless") == 0) {
+                    kernel = BSS_KERNEL_BRANCHLESS;
+                } else {
+                    fprintf(stderr, "Invalid search kernel: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'r':
+                relayout_src = optarg;
+                break;
+            case 'x':
+                use_index = 1; // Build a sparse index when opening the handle
+                break;
+            case 'X':
+                use_index = 1;
+                index_sidecar = 1; // Persist the sparse index next to the data file
+                break;
+            case 'm':
+            case 'M':
+                model_error = strtoull(optarg, NULL, 10);
+                if (model_error == 0) {
+                    fprintf(stderr, "Model error bound must be positive\n");
+                    print_usage(argv[0]);
+                }
+                model_sidecar = opt == 'M'; // Persist the model next to the data file
+                break;
+            case 'L':
+                query = QUERY_LOWER_BOUND;
+                break;
+            case 'U':
+                query = QUERY_UPPER_BOUND;
+                break;
+            case 'R':
+                query = QUERY_SCAN;
+                range_end = strtoull(optarg, NULL, 10);
+                break;
+            case 'y':
+                query = QUERY_EQUAL_RANGE;
+                break;
+            case 'J':
+                segmented = 1;
+                break;
+            case 'V':
+                use_async = 1;
+                break;
+            case 'w':
+                key_size = strtoull(optarg, NULL, 10);
+                if (key_size != 4 && key_size != 8 && key_size != 16) {
+                    fprintf(stderr, "Key width must be 4, 8 or 16 bytes\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'z':
+                record_size = strtoull(optarg, NULL, 10);
+                if (record_size == 0) {
+                    fprintf(stderr, "Record size must be positive\n");
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'H':
+                map_hugepage = 1; // Transparent huge pages for the mapping
+                break;
+            case 'E':
+                map_populate = 1; // Prefault the mapping when opening
+                break;
+            case 'l':
+            case 'W':
+                if (atoi(optarg) <= 0 || atoi(optarg) > 63) {
+                    fprintf(stderr, "Number of search levels must be between 1 and 63\n");
+                    print_usage(argv[0]);
+                }
+                if (opt == 'l') {
+                    lock_levels = atoi(optarg);
+                } else {
+                    prewarm_levels = atoi(optarg);
+                }
+                break;
+            case 'k':
+                batch_size = strtoull(optarg, NULL, 10);
+                if (batch_size == 0) {
+                    fprintf(stderr, "Batch size must be positive\n");
+                    print_usage(argv[0]);
+                }
                 break;
             default:
                 print_usage(argv[0]);
         }
     }
     
+    bss_set_verbosity(verbosity);
+
     // Check if we have implementation specified
     if (implementation == 0) {
         fprintf(stderr, "Implementation (-i) is required\n");
         print_usage(argv[0]);
     }
     
-    // Check if we have enough positional arguments
-    if (optind + 1 >= argc) {
+    // Check if we have enough positional arguments (a benchmark draws its own targets)
+    if (optind + (bench.num_lookups ? 0 : 1) >= argc) {
         fprintf(stderr, "Not enough arguments\n");
         print_usage(argv[0]);
     }
+    if (num_engines > 1 && !bench.num_lookups) {
+        fprintf(stderr, "Several implementations (-i) can only be compared in benchmark mode (-T)\n");
+        print_usage(argv[0]);
+    }
     
     // Get filepath and target value
     filepath = argv[optind];
-    target = strtoull(argv[optind + 1], NULL, 10);
+    target = optind + 1 < argc ? strtoull(argv[optind + 1], NULL, 10) : 0;
     
     // Check for conversion errors
     if (errno == ERANGE) {
         perror("strtoull");
         return EXIT_FAILURE;
     }
+
+    FILE *report = stdout;
+    if (report_path) {
+        report = fopen(report_path, "w");
+        if (!report) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (use_index && !persistent && !segmented) {
+        fprintf(stderr, "The sparse index (-x/-X) requires a persistent handle (-P)\n");
+        print_usage(argv[0]);
+    }
+
+    if (collect_counters && !persistent && !bench.num_lookups) {
+        fprintf(stderr, "Lookup counters (-e) require a persistent handle (-P) or benchmark mode (-T)\n");
+        print_usage(argv[0]);
+    }
+
+    if (segmented && (bench.num_lookups || batch_size > 1 || query != QUERY_FIND || create_test || relayout_src ||
+                      drop_caches || collect_counters)) {
+        fprintf(stderr, "Segment sets (-J) only run exact matches, without -T, -k, -L/-U/-R/-y, -c, -r, -d or -e\n");
+        print_usage(argv[0]);
+    }
+
+    if (use_async && (!persistent || batch_size < 2 || bench.num_lookups)) {
+        fprintf(stderr, "Asynchronous lookups (-V) run the batch (-k) on a persistent handle (-P), without -T\n");
+        print_usage(argv[0]);
+    }
+
+    if (batch_size > 1 && query != QUERY_FIND) {
+        fprintf(stderr, "Batched lookups (-k) only run exact matches, not -L/-U/-R/-y\n");
+        print_usage(argv[0]);
+    }
+
+    if (batch_size > 1 && implementation != 2 && implementation != 5 && implementation != 8 && !persistent &&
+        !bench.num_lookups) {
+        fprintf(stderr, "Batched lookups (-k) require implementation 2, 5 or 8, or a persistent handle (-P)\n");
+        print_usage(argv[0]);
+    }
     
+    if (record_size && record_size < key_size) {
+        fprintf(stderr, "Records (-z) must be at least as large as their key (-w)\n");
+        print_usage(argv[0]);
+    }
+    int records = key_size != sizeof(uint64_t) || (record_size && record_size != key_size);
+
     // Create test file if requested
+    char sorted_path[4096];
     if (create_test) {
-        printf("Creating test file with %zu elements...\n", test_size);
-        if (create_test_file(filepath, test_size, test_step) != 0) {
+        if ((implementation == 4 || implementation == 7) && !bench.num_lookups) {
+            // The Eytzinger and compressed engines search a converted copy of the sorted file
+            snprintf(sorted_path, sizeof(sorted_path), "%s.sorted", filepath);
+            relayout_src = sorted_path;
+        }
+        bss_datagen_config_t gen;
+        bss_default_datagen_config(&gen);
+        gen.num_elements = test_size;
+        gen.step = test_step;
+        gen.key_size = key_size;
+        gen.record_size = record_size;
+        gen.distribution = test_distribution;
+        gen.num_threads = test_threads;
+        gen.preallocate = test_preallocate;
+        if (bss_generate_file(relayout_src ? relayout_src : filepath, &gen) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Convert a sorted file to Eytzinger layout or compressed blocks if requested
+    if (relayout_src) {
+        int converted = implementation == 7 ? convert_to_compressed(relayout_src, filepath)
+                                            : convert_to_eytzinger(relayout_src, filepath);
+        if (converted != 0) {
             return EXIT_FAILURE;
         }
     }
     
     // Print information about the run
-    printf("Running search with the following parameters:\n");
-    printf("  Implementation: ");
-    switch (implementation) {
-        case 1:
-            printf("Simple mmap\n");
-            break;
-        case 2:
-            printf("IO_uring%s%s%s\n",
-                  use_sqpoll ? " with SQPOLL" : "",
-                  use_buffers ? " with buffer registration" : "",
-                  use_readahead ? " with readahead/linear search" : "");
-            break;
-        case 3:
-            printf("Parallel mmap with %d threads\n", num_threads);
-            break;
+    if (verbosity >= BSS_VERBOSITY_NORMAL) {
+        printf("Running search with the following parameters:\n");
+        printf("  Implementation: ");
+        switch (implementation) {
+            case 1:
+                printf("Simple mmap\n");
+                break;
+            case 2:
+                printf("IO_uring%s%s%s\n",
+                      use_sqpoll ? " with SQPOLL" : "",
+                      use_buffers ? " with buffer registration" : "",
+                      use_readahead ? " with block reads" : "");
+                if (use_direct) {
+                    printf("  O_DIRECT: Yes%s\n", use_iopoll ? " (polled completions)" : "");
+                }
+                if (io_fanout || io_speculate) {
+                    printf("  Reads per round: %d%s\n", io_fanout ? io_fanout : 4,
+                           io_speculate ? " (two-level speculation)" : "");
+                }
+                if (batch_size > 1) {
+                    printf("  Batch size: %zu\n", batch_size);
+                }
+                break;
+            case 3:
+                printf("Parallel mmap with %d threads%s\n", num_threads, cooperative ? " (cooperative k-ary)" : "");
+                break;
+            case 4:
+                printf("Eytzinger layout over mmap\n");
+                break;
+            case 6:
+                if (model_error) {
+                    printf("Learned model over mmap (error bound %zu%s)\n", model_error, model_sidecar ? ", sidecar" : "");
+                } else {
+                    printf("Interpolation search over mmap\n");
+                }
+                break;
+            case 7:
+                printf("Compressed blocks over mmap\n");
+                break;
+            case 8:
+                printf("Auto (mmap, parallel mmap with %d threads or IO_uring per lookup)\n", num_threads);
+                break;
+            case 5:
+                printf("Multi-threaded IO_uring with %d workers%s%s\n", num_threads,
+                      use_sqpoll ? " with SQPOLL" : "",
+                      use_readahead ? " with block reads" : "");
+                if (batch_size > 1) {
+                    printf("  Batch size: %zu\n", batch_size);
+                }
+                break;
+        }
+        printf("  File: %s\n", filepath);
+        printf("  Target value: %" PRIu64 "\n", target);
+        if (query == QUERY_LOWER_BOUND || query == QUERY_UPPER_BOUND) {
+            printf("  Query: %s bound\n", query == QUERY_LOWER_BOUND ? "lower" : "upper");
+        } else if (query == QUERY_SCAN) {
+            printf("  Query: range scan of [%" PRIu64 ", %" PRIu64 ")\n", target, range_end);
+        } else if (query == QUERY_EQUAL_RANGE) {
+            printf("  Query: equal range\n");
+        }
+        printf("  Iterations: %" PRIu64 "\n", iterations);
+        printf("  Drop caches: %s\n", drop_caches ? "Yes" : "No");
+        printf("  Persistent handle: %s\n", persistent || segmented ? "Yes" : "No");
+        if (segmented) {
+            printf("  Segment set: Yes, searched on up to %d threads\n", num_threads);
+        }
+        if (kernel == BSS_KERNEL_SIMD) {
+            printf("  Search kernel: simd (%s)\n", simd_kernel_isa());
+        } else if (kernel == BSS_KERNEL_BRANCHLESS) {
+            printf("  Search kernel: branchless\n");
+        }
+        printf("  Sparse index: %s\n", use_index ? (index_sidecar ? "Yes (sidecar)" : "Yes") : "No");
+        if (map_hugepage || map_populate || lock_levels || prewarm_levels) {
+            printf("  Mapping:%s%s", map_hugepage ? " huge pages" : "", map_populate ? " populated" : "");
+            if (lock_levels) {
+                printf(" top %d levels locked", lock_levels);
+            }
+            if (prewarm_levels) {
+                printf(" top %d levels prewarmed", prewarm_levels);
+            }
+            printf("\n");
+        }
+        if (records) {
+            printf("  Records: %zu byte keys in %zu byte records\n", key_size, record_size ? record_size : key_size);
+        }
+    }
+
+    // Collect the search options
+    bss_options_t opts;
+    bss_default_options(&opts);
+    opts.engine = (bss_engine_t)implementation;
+    opts.num_threads = num_threads;
+    opts.use_sqpoll = use_sqpoll;
+    opts.use_buffers = use_buffers;
+    opts.use_readahead = use_readahead;
+    opts.io_fanout = io_fanout;
+    opts.io_speculate = io_speculate;
+    opts.io_block_size = io_block_size;
+    opts.io_cache_blocks = io_cache_blocks;
+    opts.use_direct = use_direct;
+    opts.use_iopoll = use_iopoll;
+    opts.sqpoll_idle_ms = sqpoll_idle_ms;
+    opts.use_index = use_index;
+    opts.index_sidecar = index_sidecar;
+    opts.kernel = kernel;
+    opts.parallel_mode = cooperative ? BSS_PARALLEL_COOPERATIVE : BSS_PARALLEL_SLICES;
+    opts.pin_threads = pin_threads;
+    opts.model_error = model_error;
+    opts.model_sidecar = model_sidecar;
+    opts.key_size = key_size;
+    opts.record_size = record_size;
+    opts.map_hugepage = map_hugepage;
+    opts.map_populate = map_populate;
+    opts.lock_levels = lock_levels;
+    opts.prewarm_levels = prewarm_levels;
+    opts.collect_counters = collect_counters;
+
+    // A segment set replaces the single file
+    if (segmented) {
+        int seg_ret = run_segments(filepath, &opts, target, iterations, output_format, report);
+        if (report != stdout) {
+            fclose(report);
+        }
+        return seg_ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // Benchmark mode replaces the iteration loop
+    if (bench.num_lookups) {
+        bench.batch_size = batch_size;
+        int bench_ret = run_benchmark(filepath, engines, num_engines, &opts, &bench, output_format, report);
+        if (report != stdout) {
+            fclose(report);
+        }
+        return bench_ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // Open the handle up front so setup cost stays out of the measurements
+    bss_handle_t *handle = NULL;
+    if (persistent) {
+        handle = bss_open(filepath, &opts);
+        if (!handle) {
+            return EXIT_FAILURE;
+        }
+    }
+    bss_async_t *async = NULL;
+    if (use_async) {
+        async = bss_async_create(handle, NULL, batch_size < ASYNC_IN_FLIGHT ? batch_size : ASYNC_IN_FLIGHT);
+        if (!async) {
+            bss_close(handle);
+            return EXIT_FAILURE;
+        }
     }
-    printf("  File: %s\n", filepath);
-    printf("  Target value: %" PRIu64 "\n", target);
-    printf("  Iterations: %" PRIu64 "\n", iterations);
-    printf("  Drop caches: %s\n", drop_caches ? "Yes" : "No");
     
-    // Allocate memory for storing durations
-    double *durations = (double *)malloc(iterations * sizeof(double));
+    // Durations go into a histogram, whose size does not depend on the iterations
+    bss_histogram_t *durations = (bss_histogram_t *)malloc(sizeof(bss_histogram_t));
     if (!durations) {
         perror("malloc");
+        bss_async_destroy(async);
+        bss_close(handle);
         return EXIT_FAILURE;
     }
+    bss_histogram_init(durations);
     
+    // Build the batch of lookup keys: the target first, then pseudo-random values in [0, target]
+    uint64_t *batch_keys = NULL;
+    int64_t *batch_indices = NULL;
+    if (batch_size > 1) {
+        batch_keys = (uint64_t *)malloc(batch_size * sizeof(uint64_t));
+        batch_indices = (int64_t *)malloc(batch_size * sizeof(int64_t));
+        if (!batch_keys || !batch_indices) {
+            perror("malloc");
+            free(batch_keys);
+            free(batch_indices);
+            free(durations);
+            bss_async_destroy(async);
+            bss_close(handle);
+            return EXIT_FAILURE;
+        }
+
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        batch_keys[0] = target;
+        for (size_t i = 1; i < batch_size; i++) {
+            // xorshift64
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            batch_keys[i] = target == UINT64_MAX ? seed : seed % (target + 1);
+        }
+    }
+
     // Show initial drop cache message if needed
-    if (drop_caches) {
+    if (drop_caches && verbosity >= BSS_VERBOSITY_NORMAL) {
         printf("Dropping caches before each iteration (requires sudo)...\n");
     }
     
     // Run iterations
     int ret = 0;
-    printf("Running %ld iterations...\n", iterations);
+    bss_search_result_t result = { .index = -1 };
+    int last_found = 0;
+    if (verbosity >= BSS_VERBOSITY_NORMAL) {
+        printf("Running %" PRIu64 " iterations...\n", iterations);
+    }
     
     for (uint64_t i = 0; i < iterations; i++) {
         // Show progress every 10% of iterations
-        if (iterations > 10 && i % (iterations / 10) == 0) {
-            printf("  Progress: %ld%%\n", (i * 100) / iterations);
+        if (verbosity == BSS_VERBOSITY_NORMAL && iterations > 10 && i % (iterations / 10) == 0) {
+            printf("  Progress: %" PRIu64 "%%\n", (i * 100) / iterations);
         }
         
         // Run a single iteration
-        double duration;
-        int iter_ret = run_iteration(implementation, filepath, target, num_threads, drop_caches, use_sqpoll, use_buffers, use_readahead, &duration);
+        uint64_t duration_ns = 0;
+        int iter_ret = run_iteration(&opts, handle, async, filepath, target, drop_caches, query, range_end,
+                                     batch_keys, batch_indices, batch_size, &result, &duration_ns);
         
         // Store the duration
-        durations[i] = duration;
+        bss_histogram_record(durations, duration_ns);
         
         // If there's an error, report it and exit
         if (iter_ret < 0) {
             ret = iter_ret;
             break;
         }
+        last_found = iter_ret;
+
+        // Per-iteration outcome only when asked for; printing stays outside the timed region
+        if (verbosity >= BSS_VERBOSITY_DEBUG) {
+            printf("  Iteration %" PRIu64 ": found %d, index %lld, %d probes, %" PRIu64 " bytes read, %.3f ms\n",
+                   i + 1, result.found, (long long)result.index, result.probes, result.bytes_read,
+                   duration_ns / 1e6);
+        }
     }
+    int64_t index = result.index;
     
+    // Report the outcome of the last lookup (the search functions do not print)
+    if (ret >= 0) {
+        if (query == QUERY_LOWER_BOUND || query == QUERY_UPPER_BOUND) {
+            const char *kind = query == QUERY_LOWER_BOUND ? "Lower" : "Upper";
+            if (last_found) {
+                printf("%s bound of %" PRIu64 " is element index %lld\n", kind, target, (long long)index);
+            } else {
+                printf("%s bound of %" PRIu64 " is past the last element\n", kind, target);
+            }
+        } else if (query == QUERY_SCAN) {
+            printf("Scanned %lld values in [%" PRIu64 ", %" PRIu64 ")\n", (long long)index, target, range_end);
+        } else if (query == QUERY_EQUAL_RANGE) {
+            if (last_found) {
+                printf("Key %" PRIu64 " has %llu copies at element indexes %lld..%lld\n", target,
+                       (unsigned long long)result.count, (long long)index, (long long)result.last);
+            } else {
+                printf("Key %" PRIu64 " not found in file\n", target);
+            }
+        } else if (batch_size > 1) {
+            printf("Found %d of %zu values in the last batch\n", last_found, batch_size);
+        } else if (last_found && records) {
+            printf("Found key %" PRIu64 " at offset %lld (record index %lld)\n",
+                   target, (long long)(index * (record_size ? record_size : key_size)), (long long)index);
+        } else if (last_found) {
+            printf("Found uint64_t value %" PRIu64 " at offset %lld (element index %lld)\n",
+                   target, (long long)(index * sizeof(uint64_t)), (long long)index);
+        } else {
+            printf("uint64_t value %" PRIu64 " not found in file\n", target);
+        }
+        if (result.probes) {
+            printf("  Probes: %d, bytes read: %" PRIu64 "\n", result.probes, result.bytes_read);
+        }
+    }
+
     // Calculate and print statistics
     if (ret >= 0) {
         search_stats_t stats;
-        calculate_stats(durations, iterations, &stats);
+        bss_histogram_stats(durations, 1e-6, &stats);
         
         // Get implementation name for stats display
         const char *impl_name;
+        char buffer[50];
         switch (implementation) {
             case 1: impl_name = "Simple mmap"; break;
-            case 2: impl_name = "IO_uring"; break;
+            case 2: impl_name = batch_size > 1 ? "IO_uring (batched)" : "IO_uring"; break;
             case 3: 
-                {
-                    char buffer[50];
-                    snprintf(buffer, sizeof(buffer), "Parallel mmap (%d threads)", num_threads);
-                    impl_name = buffer;
-                }
+                snprintf(buffer, sizeof(buffer), "Parallel mmap (%d threads)", num_threads);
+                impl_name = buffer;
                 break;
+            case 4: impl_name = "Eytzinger mmap"; break;
+            case 5: impl_name = "Multi-threaded IO_uring"; break;
+            case 6: impl_name = model_error ? "Learned model mmap" : "Interpolation mmap"; break;
+            case 7: impl_name = "Compressed mmap"; break;
+            case 8: impl_name = "Auto"; break;
             default: impl_name = "Unknown implementation"; break;
         }
         
-        print_stats(&stats, impl_name);
+        bss_counters_t counters;
+        if (handle && collect_counters) {
+            bss_get_counters(handle, &counters);
+        }
+
+        if (output_format == OUTPUT_TEXT) {
+            print_stats(&stats, impl_name);
+            if (handle && collect_counters) {
+                print_counters(&counters);
+            }
+        } else {
+            report_field fields[40] = { { "iterations", (double)stats.iterations } };
+            int num_fields = 1 + latency_fields(fields + 1, &stats, 0);
+            if (handle && collect_counters) {
+                num_fields += counter_fields(fields + num_fields, &counters);
+            }
+            report_row(report, output_format, 0, impl_name, fields, num_fields);
+            report_end(report, output_format, 1);
+        }
     }
     
     // Clean up
+    bss_async_destroy(async);
+    bss_close(handle);
+    free(batch_keys);
+    free(batch_indices);
     free(durations);
+    if (report != stdout) {
+        fclose(report);
+    }
     
     return ret;
 }
\ No newline at end of file
@@ -1,4 +1,4 @@
-#include "bssearch_lib.h"
+#include "bssearch_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -11,99 +11,324 @@
 #include <errno.h>
 #include <math.h>
 
-// Binary search for a target uint64_t in a file using mmap
-int binary_search_uint64_mmap(const char *filepath, uint64_t target) {
-    int fd;
-    uint64_t *data;
-    struct stat st;
-    size_t num_elements;
+#define SCAN_CHUNK (256 * 1024 / sizeof(uint64_t))   // Values per range scan callback
+
+// Binary search for a target uint64_t in memory-mapped sorted data
+int mmap_lookup(const uint64_t *data, size_t num_elements, uint64_t target,
+                int64_t *index, int *comparisons) {
+    size_t lo = 0;
+    size_t hi = num_elements - 1;
+    *comparisons = 0;
+
+    while (lo <= hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        (*comparisons)++;
+
+        if (data[mid] == target) {
+            *index = mid;
+            return 1;
+        }
+
+        if (data[mid] < target) {
+            lo = mid + 1;
+        } else {
+            if (mid == 0) break;
+            hi = mid - 1;
+        }
+    }
+
+    return 0;
+}
+
+// Exact-match lookup on top of a lower bound kernel
+int kernel_lookup(bss_lower_bound_fn lower_bound, const uint64_t *data, size_t num_elements, uint64_t target,
+                  int64_t *index) {
+    size_t pos = lower_bound(data, num_elements, target);
+    if (pos < num_elements && data[pos] == target) {
+        *index = pos;
+        return 1;
+    }
+    return 0;
+}
+
+// A batch key and its position in the caller's array
+typedef struct {
+    uint64_t key;
+    size_t idx;
+} batch_key;
+
+static int compare_batch_keys(const void *a, const void *b) {
+    uint64_t ka = ((const batch_key *)a)->key;
+    uint64_t kb = ((const batch_key *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// Resolve the sorted keys [0, num_keys) against data[lo, hi). Every node
+// probes the middle of its range once and splits the keys around that value,
+// so the recursion walks the file in order and touches each page at most once.
+static int merge_search(bss_lower_bound_fn lower_bound, const uint64_t *data, size_t lo, size_t hi,
+                        const batch_key *keys, size_t num_keys, int64_t *indices) {
+    if (num_keys == 0) {
+        return 0;
+    }
+
     int found = 0;
-    off_t target_offset = -1;
-    uint64_t start_time, end_time;
-    int total_comparisons = 0;
-    
-    // Start timing
-    start_time = get_microseconds();
-    
-    // Open the file
-    fd = open(filepath, O_RDONLY);
-    if (fd < 0) {
-        perror("open");
+    if (lo >= hi) {
+        for (size_t k = 0; k < num_keys; k++) {
+            indices[keys[k].idx] = -1;
+        }
+        return 0;
+    }
+    if (num_keys == 1) {
+        // A single key finishes with the kernel
+        size_t pos = lo + lower_bound(data + lo, hi - lo, keys[0].key);
+        int hit = pos < hi && data[pos] == keys[0].key;
+        indices[keys[0].idx] = hit ? (int64_t)pos : -1;
+        return hit;
+    }
+    if (hi - lo <= 2 * num_keys) {
+        // As many keys as values: a linear merge beats further splitting
+        size_t pos = lo;
+        for (size_t k = 0; k < num_keys; k++) {
+            while (pos < hi && data[pos] < keys[k].key) {
+                pos++;
+            }
+            int hit = pos < hi && data[pos] == keys[k].key;
+            indices[keys[k].idx] = hit ? (int64_t)pos : -1;
+            found += hit;
+        }
+        return found;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    uint64_t pivot = data[mid];
+
+    // Keys below the pivot go left, keys equal to it hit, the rest go right
+    size_t less = 0, upto = num_keys;
+    while (less < upto) {
+        size_t m = less + (upto - less) / 2;
+        if (keys[m].key < pivot) {
+            less = m + 1;
+        } else {
+            upto = m;
+        }
+    }
+    size_t equal = less;
+    while (equal < num_keys && keys[equal].key == pivot) {
+        indices[keys[equal].idx] = mid;
+        equal++;
+    }
+
+    found += equal - less;
+    found += merge_search(lower_bound, data, lo, mid, keys, less, indices);
+    found += merge_search(lower_bound, data, mid + 1, hi, keys + equal, num_keys - equal, indices);
+    return found;
+}
+
+// Look up a batch of values in memory-mapped sorted data by searching them
+// together: the keys are sorted (unless they already are) and split at every
+// probed pivot, like a parallel merge, so the top levels of the search are
+// shared and large batches read the file near-sequentially. indices[i]
+// receives the element index of targets[i], or -1 if absent. Returns the
+// number of values found, -1 on error.
+int mmap_lookup_batch(bss_lower_bound_fn lower_bound, const uint64_t *data, size_t num_elements,
+                      const uint64_t *targets, size_t num_targets, int64_t *indices) {
+    if (num_targets == 0) {
+        return 0;   // malloc(0) may return NULL
+    }
+    batch_key *keys = (batch_key *)malloc(num_targets * sizeof(batch_key));
+    if (!keys) {
+        perror("malloc");
         return -1;
     }
-    
-    // Get file size
-    if (fstat(fd, &st) < 0) {
-        perror("fstat");
-        close(fd);
+
+    int sorted = 1;
+    for (size_t i = 0; i < num_targets; i++) {
+        keys[i].key = targets[i];
+        keys[i].idx = i;
+        if (i > 0 && targets[i] < targets[i - 1]) {
+            sorted = 0;
+        }
+    }
+    if (!sorted) {
+        qsort(keys, num_targets, sizeof(batch_key), compare_batch_keys);
+    }
+
+    int found = merge_search(lower_bound, data, 0, num_elements, keys, num_targets, indices);
+    free(keys);
+    return found;
+}
+
+// End of the run of copies of data[first] (== target): the first index after
+// it whose value is larger. Gallops forward from the start of the run, so r
+// copies cost O(log r) probes however large the file is.
+size_t mmap_run_end(const uint64_t *data, size_t num_elements, size_t first, uint64_t target) {
+    size_t lo = first + 1;   // Every value before lo equals target
+    size_t step = 1;
+
+    while (step <= num_elements - lo && data[lo + step - 1] == target) {
+        lo += step;
+        step <<= 1;
+    }
+
+    // The end lies in [lo, lo + step - 1]
+    size_t hi = step - 1 < num_elements - lo ? lo + step - 1 : num_elements;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (data[mid] == target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Hand the values [start, end) of a mapping to fn, SCAN_CHUNK at a time. The
+// span is advised MADV_SEQUENTIAL so the kernel reads ahead aggressively and
+// drops pages behind the scan; the mapping returns to advice afterwards.
+// Returns the number of values visited, or -1 on error.
+int64_t mmap_scan(const uint64_t *data, size_t start, size_t end, int advice, bss_scan_fn fn, void *arg) {
+    if (start >= end) {
+        return 0;
+    }
+
+    // madvise() works on whole pages
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t span_start = (uintptr_t)(data + start) & ~(page - 1);
+    size_t span_len = (uintptr_t)(data + end) - span_start;
+    if (madvise((void *)span_start, span_len, MADV_SEQUENTIAL) != 0) {
+        perror("madvise");
         return -1;
     }
-    
-    // Check if file size is valid for uint64_t array
-    if (st.st_size % sizeof(uint64_t) != 0) {
-        fprintf(stderr, "File size is not aligned with uint64_t size\n");
-        close(fd);
+
+    int64_t visited = 0;
+    for (size_t pos = start; pos < end; ) {
+        size_t count = end - pos < SCAN_CHUNK ? end - pos : SCAN_CHUNK;
+        visited += count;
+        if (fn(data + pos, count, pos, arg)) {
+            break;
+        }
+        pos += count;
+    }
+
+    if (madvise((void *)span_start, span_len, advice) != 0) {
+        perror("madvise");
         return -1;
     }
-    
-    // Calculate number of elements
-    num_elements = st.st_size / sizeof(uint64_t);
-    if (num_elements == 0) {
-        fprintf(stderr, "File is empty\n");
-        close(fd);
+    return visited;
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = *(const uintptr_t *)a;
+    uintptr_t y = *(const uintptr_t *)b;
+    return (x > y) - (x < y);
+}
+
+// mlock() a span, or madvise() it with advice
+static int touch_span(uintptr_t start, size_t len, int advice, int lock) {
+    int ret = lock ? mlock((void *)start, len) : madvise((void *)start, len, advice);
+    if (ret != 0) {
+        fprintf(stderr, "%s of the top search levels: %s\n", lock ? "mlock" : "madvise", strerror(errno));
         return -1;
     }
-    
-    printf("Searching for value %" PRIu64 " in file with %zu elements\n", target, num_elements);
-    
-    // Memory map the file
-    data = (uint64_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (data == MAP_FAILED) {
-        perror("mmap");
-        close(fd);
+    return 0;
+}
+
+// Lock (or madvise with advice) the pages holding the top levels of the
+// search tree over count records of stride bytes at data. On a sorted file
+// level l is the 2^l midpoints a binary search may probe at depth l; with
+// eytzinger set it is the next 2^l records of the file, after its pad
+// element. Once the levels cover every page of the span, the whole span is
+// touched at once. Returns the number of pages touched, or -1 if a call
+// failed.
+int64_t mmap_touch_levels(const uint8_t *data, size_t count, size_t stride, int eytzinger, int levels,
+                          int advice, int lock) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t span_start = (uintptr_t)data & ~(page - 1);
+    uintptr_t span_end = ((uintptr_t)(data + count * stride) + page - 1) & ~(page - 1);
+    size_t span_pages = (span_end - span_start) / page;
+
+    if (levels <= 0 || count == 0) {
+        return 0;
+    }
+
+    // The top of an Eytzinger file is its prefix
+    size_t nodes = levels >= 63 ? SIZE_MAX : ((size_t)1 << levels) - 1;
+    if (eytzinger) {
+        size_t prefix = nodes < count - 1 ? nodes + 1 : count;
+        span_end = ((uintptr_t)(data + prefix * stride) + page - 1) & ~(page - 1);
+        if (touch_span(span_start, span_end - span_start, advice, lock) < 0) {
+            return -1;
+        }
+        return (span_end - span_start) / page;
+    }
+    if (nodes >= span_pages) {
+        return touch_span(span_start, span_end - span_start, advice, lock) < 0 ? -1 : (int64_t)span_pages;
+    }
+
+    // Pages of both ends of every probed record, merged into runs
+    uintptr_t *pages = (uintptr_t *)malloc(2 * nodes * sizeof(uintptr_t));
+    if (!pages) {
+        perror("malloc");
         return -1;
     }
-    
-    // Perform binary search on the memory-mapped data
-    size_t lo = 0;
-    size_t hi = num_elements - 1;
-    
-    while (lo <= hi) {
-        size_t mid = lo + (hi - lo) / 2;
-        total_comparisons++;
-        
-        if (data[mid] == target) {
-            found = 1;
-            target_offset = mid * sizeof(uint64_t);
-            break;
+    size_t num_pages = 0;
+    for (int l = 0; l < levels; l++) {
+        for (size_t j = 0; j < ((size_t)1 << l); j++) {
+            size_t pos = (size_t)(((unsigned __int128)(2 * j + 1) * count) >> (l + 1));
+            uintptr_t first = (uintptr_t)(data + pos * stride);
+            pages[num_pages++] = first & ~(page - 1);
+            pages[num_pages++] = (first + stride - 1) & ~(page - 1);
         }
+    }
+    qsort(pages, num_pages, sizeof(uintptr_t), compare_addresses);
 
-        if (data[mid] < target) {
-            lo = mid + 1;
-        } else {
-            hi = mid - 1;
+    int64_t touched = 0;
+    for (size_t i = 0; i < num_pages; ) {
+        uintptr_t run_start = pages[i];
+        uintptr_t run_end = run_start + page;
+        while (i < num_pages && pages[i] <= run_end) {
+            if (pages[i] == run_end) {
+                run_end += page;
+            }
+            i++;
         }
+        if (touch_span(run_start, run_end - run_start, advice, lock) < 0) {
+            free(pages);
+            return -1;
+        }
+        touched += (run_end - run_start) / page;
+    }
+    free(pages);
+    return touched;
+}
+
+// Search for a target uint64_t in a file using mmap. Fills *result without
+// printing anything. Returns 0 on success, -1 on error.
+int binary_search_uint64_mmap(const char *filepath, uint64_t target, bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
+
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open and map the file
+    bss_default_options(&opts);
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
     }
-    
+
+    result->found = mmap_lookup(handle->data, handle->num_elements, target, &result->index, &result->probes);
+    result->bytes_read = (uint64_t)result->probes * sizeof(uint64_t);   // One value per probe
+
     // Clean up
-    munmap(data, st.st_size);
-    close(fd);
-    
-    // End timing
-    end_time = get_microseconds();
-    double elapsed_ms = (end_time - start_time) / 1000.0;
-    
-    if (found) {
-        printf("Found uint64_t value %" PRIu64 " at offset %lld (element index %lld)\n", 
-               target, (long long)target_offset, (long long)(target_offset / sizeof(uint64_t)));
-    } else {
-        printf("uint64_t value %" PRIu64 " not found in file\n", target);
-    }
-    
-    // Print timing information
-    printf("Search statistics (mmap):\n");
-    printf("  Total time: %.3f ms\n", elapsed_ms);
-    printf("  Total comparisons performed: %d\n", total_comparisons);
+    bss_close(handle);
 
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
     return 0;
-}
\ No newline at end of file
+}
@@ -1,4 +1,4 @@
-#include "bssearch_lib.h"
+#include "bssearch_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -11,191 +11,371 @@
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE_SIZE 64
+#define BARRIER_SPINS 1024   // Spin this many times before yielding the CPU
 
 // Structure to pass data to threads
 typedef struct {
-    uint64_t *data;
+    const uint64_t *data;
     size_t start_idx;
     size_t end_idx;
     uint64_t target;
-    int found;
-    size_t found_idx;
-    int num_comparisons;
+    size_t bound;           // Lower bound within the slice (bound searches only)
 } search_thread_data_t;
 
-// Thread function for parallel binary search
-void* binary_search_thread(void *arg) {
-    search_thread_data_t *thread_data = (search_thread_data_t *)arg;
+// Sense-reversing barrier that spins (then yields) instead of sleeping in the kernel
+typedef struct {
+    atomic_int remaining;
+    atomic_int sense;
+    int num_threads;
+} spin_barrier_t;
+
+// Probe outcome of one thread in one round, padded to avoid false sharing
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) int less;   // Pivot value < target
+    int equal;                            // Pivot value == target
+} kary_slot_t;
+
+// State shared by all threads of a cooperative search
+typedef struct {
+    const uint64_t *data;
+    size_t num_elements;
+    uint64_t target;
+    int num_threads;
+    kary_slot_t *slots[2];      // Double-buffered by round parity, one slot per thread
+    spin_barrier_t barrier;
+    int64_t found_idx;          // Written by thread 0 only
+    int *num_comparisons;       // One counter per thread
+} kary_search_t;
+
+// Parallel engine state kept alive by a search handle: the worker pool and
+// per-thread scratch space, so a lookup neither creates threads nor allocates
+struct bss_parallel_ctx {
+    bss_pool_t *pool;
+    int num_threads;
+    search_thread_data_t *thread_data;   // Slice mode, one entry per worker
+    _Alignas(CACHE_LINE_SIZE) atomic_llong found_idx;  // Slice mode result slot, -1 until a worker hits
+    atomic_int total_comparisons;        // Slice mode, summed as workers finish
+    bss_lower_bound_fn lower_bound;      // Kernel of the running bound search
+    kary_search_t kary;                  // Cooperative mode
+};
+
+// Start the worker pool and allocate the per-thread scratch space
+bss_parallel_ctx *parallel_ctx_create(int num_threads, int pin_threads) {
+    bss_parallel_ctx *ctx = (bss_parallel_ctx *)calloc(1, sizeof(bss_parallel_ctx));
+    if (!ctx) {
+        perror("calloc");
+        return NULL;
+    }
+
+    ctx->pool = bss_pool_create(num_threads, pin_threads);
+    if (!ctx->pool) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->num_threads = bss_pool_size(ctx->pool);
+
+    ctx->thread_data = (search_thread_data_t *)malloc(ctx->num_threads * sizeof(search_thread_data_t));
+    ctx->kary.slots[0] = aligned_alloc(CACHE_LINE_SIZE, 2 * ctx->num_threads * sizeof(kary_slot_t));
+    ctx->kary.num_comparisons = (int *)malloc(ctx->num_threads * sizeof(int));
+    if (!ctx->thread_data || !ctx->kary.slots[0] || !ctx->kary.num_comparisons) {
+        perror("malloc");
+        parallel_ctx_destroy(ctx);
+        return NULL;
+    }
+    ctx->kary.slots[1] = ctx->kary.slots[0] + ctx->num_threads;
+    ctx->kary.num_threads = ctx->num_threads;
+    ctx->kary.barrier.num_threads = ctx->num_threads;
+    atomic_init(&ctx->kary.barrier.remaining, ctx->num_threads);
+    atomic_init(&ctx->kary.barrier.sense, 0);
+
+    return ctx;
+}
+
+// Stop the workers and release the scratch space
+void parallel_ctx_destroy(bss_parallel_ctx *ctx) {
+    bss_pool_destroy(ctx->pool);
+    free(ctx->thread_data);
+    free(ctx->kary.slots[0]);
+    free(ctx->kary.num_comparisons);
+    free(ctx);
+}
+
+// Worker job for parallel binary search: each worker searches its own slice.
+// The first worker to hit claims the shared result slot and tells the caller;
+// the others see the slot filled between probes and give up their slice.
+static void binary_search_job(void *arg, int worker_id) {
+    bss_parallel_ctx *ctx = (bss_parallel_ctx *)arg;
+    search_thread_data_t *thread_data = &ctx->thread_data[worker_id];
     
     size_t lo = thread_data->start_idx;
     size_t hi = thread_data->end_idx;
     uint64_t target = thread_data->target;
-    uint64_t *data = thread_data->data;
-    thread_data->found = 0;
-    thread_data->num_comparisons = 0;
+    const uint64_t *data = thread_data->data;
+    int comparisons = 0;
     
-    while (lo <= hi) {
+    // Workers beyond the number of elements get an empty slice
+    if (!data) {
+        return;
+    }
+    
+    while (lo <= hi && atomic_load_explicit(&ctx->found_idx, memory_order_relaxed) < 0) {
         size_t mid = lo + (hi - lo) / 2;
-        thread_data->num_comparisons++;
+        comparisons++;
         
         if (data[mid] == target) {
-            thread_data->found = 1;
-            thread_data->found_idx = mid;
-            break;
+            long long expected = -1;
+            atomic_fetch_add_explicit(&ctx->total_comparisons, comparisons, memory_order_relaxed);
+            if (atomic_compare_exchange_strong(&ctx->found_idx, &expected, (long long)mid)) {
+                bss_pool_signal(ctx->pool);
+            }
+            return;
         } else if (data[mid] < target) {
             lo = mid + 1;
         } else {
+            if (mid == 0) break;
             hi = mid - 1;
         }
     }
     
-    pthread_exit(NULL);
+    atomic_fetch_add_explicit(&ctx->total_comparisons, comparisons, memory_order_relaxed);
 }
 
-// Parallel binary search for a target uint64_t in a file using mmap
-int parallel_binary_search_uint64_mmap(const char *filepath, uint64_t target, int num_threads) {
-    int fd;
-    uint64_t *data;
-    struct stat st;
-    size_t num_elements;
-    int found = 0;
-    off_t target_offset = -1;
-    uint64_t start_time, end_time;
-    int total_comparisons = 0;
-    pthread_t *threads;
-    search_thread_data_t *thread_data;
-    
-    // Start timing
-    start_time = get_microseconds();
-    
-    // Open the file
-    fd = open(filepath, O_RDONLY);
-    if (fd < 0) {
-        perror("open");
-        return -1;
-    }
-    
-    // Get file size
-    if (fstat(fd, &st) < 0) {
-        perror("fstat");
-        close(fd);
-        return -1;
-    }
-    
-    // Check if file size is valid for uint64_t array
-    if (st.st_size % sizeof(uint64_t) != 0) {
-        fprintf(stderr, "File size is not aligned with uint64_t size\n");
-        close(fd);
-        return -1;
-    }
-    
-    // Calculate number of elements
-    num_elements = st.st_size / sizeof(uint64_t);
-    if (num_elements == 0) {
-        fprintf(stderr, "File is empty\n");
-        close(fd);
-        return -1;
-    }
-    
-    printf("Searching for value %" PRIu64 " in file with %zu elements using %d threads\n", 
-           target, num_elements, num_threads);
-    
-    // Memory map the file
-    data = (uint64_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (data == MAP_FAILED) {
-        perror("mmap");
-        close(fd);
-        return -1;
-    }
-    int err = madvise(data, st.st_size, MADV_RANDOM);
-    if (err != 0) {
-        perror("madvise");
-        munmap(data, st.st_size);
-        close(fd);
-        return -1;
-    }
-    
-    // Adjust number of threads if necessary based on data size
+// Divide [0, num_elements) into one slice per worker (fewer if there are
+// fewer elements than workers); workers without a slice get NULL data
+static void split_slices(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target) {
+    int num_threads = ctx->num_threads;
+
+    // Use fewer slices if there are fewer elements than workers
     if (num_elements < (size_t)num_threads) {
         num_threads = num_elements;
-        printf("Adjusted number of threads to %d based on data size\n", num_threads);
-    }
-    
-    // Allocate memory for threads and thread data
-    threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-    thread_data = (search_thread_data_t *)malloc(num_threads * sizeof(search_thread_data_t));
-    
-    if (!threads || !thread_data) {
-        perror("malloc");
-        munmap(data, st.st_size);
-        close(fd);
-        free(threads);
-        free(thread_data);
-        return -1;
     }
     
     // Divide data among threads
     size_t elements_per_thread = num_elements / num_threads;
     size_t remainder = num_elements % num_threads;
     
-    // Create threads
-    for (int i = 0; i < num_threads; i++) {
-        thread_data[i].data = data;
-        thread_data[i].target = target;
+    for (int i = 0; i < ctx->num_threads; i++) {
+        search_thread_data_t *thread_data = &ctx->thread_data[i];
+        thread_data->data = i < num_threads ? data : NULL;
+        thread_data->target = target;
         
         // Calculate start and end indices for this thread
-        thread_data[i].start_idx = i * elements_per_thread;
-        thread_data[i].end_idx = (i + 1) * elements_per_thread - 1;
+        thread_data->start_idx = i * elements_per_thread;
+        thread_data->end_idx = (i + 1) * elements_per_thread - 1;
         
         // Add remainder elements to the last thread
         if (i == num_threads - 1) {
-            thread_data[i].end_idx += remainder;
+            thread_data->end_idx += remainder;
         }
-        
-        // Create thread
-        if (pthread_create(&threads[i], NULL, binary_search_thread, &thread_data[i]) != 0) {
-            perror("pthread_create");
-            munmap(data, st.st_size);
-            close(fd);
-            free(threads);
-            free(thread_data);
-            return -1;
+    }
+}
+
+// Parallel binary search over memory-mapped sorted data: the array is split
+// into one slice per worker and each worker binary-searches its own slice.
+// Returns as soon as one worker finds the target; *comparisons then only
+// covers the probes of workers that had stopped by that time.
+int parallel_mmap_lookup(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                         int64_t *index, int *comparisons) {
+    // Scratch space is reused, so wait for stragglers of the previous lookup
+    bss_pool_quiesce(ctx->pool);
+    atomic_store_explicit(&ctx->found_idx, -1, memory_order_relaxed);
+    atomic_store_explicit(&ctx->total_comparisons, 0, memory_order_relaxed);
+    
+    split_slices(ctx, data, num_elements, target);
+    
+    // Run the slices on the pool until the first hit (or until all slices are exhausted)
+    bss_pool_run_any(ctx->pool, binary_search_job, ctx);
+    
+    *comparisons = atomic_load_explicit(&ctx->total_comparisons, memory_order_relaxed);
+    long long found_idx = atomic_load(&ctx->found_idx);
+    if (found_idx < 0) {
+        return 0;
+    }
+    *index = found_idx;
+    return 1;
+}
+
+// Worker job for parallel lower bound: each worker runs the kernel over its slice
+static void lower_bound_job(void *arg, int worker_id) {
+    bss_parallel_ctx *ctx = (bss_parallel_ctx *)arg;
+    search_thread_data_t *thread_data = &ctx->thread_data[worker_id];
+
+    if (!thread_data->data) {
+        return;
+    }
+    size_t len = thread_data->end_idx - thread_data->start_idx + 1;
+    thread_data->bound = ctx->lower_bound(thread_data->data + thread_data->start_idx, len, thread_data->target);
+}
+
+// Parallel lower bound over memory-mapped sorted data. Every slice finds its
+// own bound; the answer is the bound of the first slice that holds a value
+// >= target. Both parallel modes use slices, as a bound has no early hit.
+int parallel_mmap_lower_bound(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                              bss_lower_bound_fn lower_bound, size_t *pos) {
+    bss_pool_quiesce(ctx->pool);
+    ctx->lower_bound = lower_bound;
+    split_slices(ctx, data, num_elements, target);
+
+    bss_pool_run(ctx->pool, lower_bound_job, ctx);
+
+    *pos = num_elements;
+    for (int i = 0; i < ctx->num_threads && ctx->thread_data[i].data; i++) {
+        const search_thread_data_t *thread_data = &ctx->thread_data[i];
+        if (thread_data->start_idx + thread_data->bound <= thread_data->end_idx) {
+            *pos = thread_data->start_idx + thread_data->bound;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void spin_barrier_wait(spin_barrier_t *barrier, int *local_sense) {
+    *local_sense = !*local_sense;
+    if (atomic_fetch_sub_explicit(&barrier->remaining, 1, memory_order_acq_rel) == 1) {
+        // Last thread to arrive releases the others
+        atomic_store_explicit(&barrier->remaining, barrier->num_threads, memory_order_relaxed);
+        atomic_store_explicit(&barrier->sense, *local_sense, memory_order_release);
+        return;
+    }
+    for (int spins = 0; atomic_load_explicit(&barrier->sense, memory_order_acquire) != *local_sense; spins++) {
+        if (spins >= BARRIER_SPINS) {
+            sched_yield();
         }
     }
+}
+
+// Position of pivot i (of num_threads) in the range [lo, lo + m)
+static inline size_t kary_pivot(size_t lo, size_t m, int i, int num_threads) {
+    if (m <= (size_t)num_threads) {
+        return lo + i;
+    }
+    return lo + ((size_t)(i + 1) * m) / (num_threads + 1);
+}
+
+// Worker job for the cooperative k-ary search. All workers walk the same
+// sequence of ranges: each round worker i probes pivot i, the workers meet at
+// the barrier, and every worker derives the next range from the shared slots.
+// Slots are double-buffered, so one barrier per round is enough.
+static void kary_search_job(void *arg, int id) {
+    kary_search_t *search = (kary_search_t *)arg;
+    const int num_threads = search->num_threads;
+    // The barrier's sense persists across jobs; start from its current value
+    int local_sense = atomic_load_explicit(&search->barrier.sense, memory_order_relaxed);
+    size_t lo = 0;
+    size_t hi = search->num_elements;   // Exclusive
+    int comparisons = 0;
     
-    // Wait for all threads to complete
-    for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
-        total_comparisons += thread_data[i].num_comparisons;
+    for (int round = 0; lo < hi; round++) {
+        size_t m = hi - lo;
+        int active = m < (size_t)num_threads ? (int)m : num_threads;
+        kary_slot_t *slots = search->slots[round & 1];
         
-        // Check if target was found in this thread
-        if (thread_data[i].found) {
-            found = 1;
-            target_offset = thread_data[i].found_idx * sizeof(uint64_t);
+        // Probe this worker's pivot
+        if (id < active) {
+            uint64_t value = search->data[kary_pivot(lo, m, id, num_threads)];
+            slots[id].less = value < search->target;
+            slots[id].equal = value == search->target;
+            comparisons++;
         }
+        
+        spin_barrier_wait(&search->barrier, &local_sense);
+        
+        // Count pivots below the target; pivots are sorted, so they form a prefix
+        int below = 0;
+        int hit = -1;
+        for (int i = 0; i < active && hit < 0; i++) {
+            if (slots[i].equal) {
+                hit = i;
+            }
+            below += slots[i].less;
+        }
+        if (hit >= 0) {
+            if (id == 0) {
+                search->found_idx = kary_pivot(lo, m, hit, num_threads);
+            }
+            break;
+        }
+        
+        // Every element of a small range was probed
+        if (m <= (size_t)num_threads) {
+            break;
+        }
+        
+        // Keep the gap between the last pivot below and the first pivot above the target
+        size_t new_lo = below == 0 ? lo : kary_pivot(lo, m, below - 1, num_threads) + 1;
+        size_t new_hi = below == active ? hi : kary_pivot(lo, m, below, num_threads);
+        lo = new_lo;
+        hi = new_hi;
     }
     
-    // Clean up
-    free(threads);
-    free(thread_data);
-    munmap(data, st.st_size);
-    close(fd);
+    search->num_comparisons[id] = comparisons;
+}
+
+// Cooperative parallel search over memory-mapped sorted data: the T workers
+// probe T evenly spaced pivots per round, shrinking the range by a factor of
+// T + 1, so the search takes log_{T+1}(N) dependent page faults instead of log2(N)
+int parallel_mmap_kary_lookup(bss_parallel_ctx *ctx, const uint64_t *data, size_t num_elements, uint64_t target,
+                              int64_t *index, int *comparisons) {
+    kary_search_t *search = &ctx->kary;
     
-    // End timing
-    end_time = get_microseconds();
-    double elapsed_ms = (end_time - start_time) / 1000.0;
+    // Stragglers of an early-answered slice lookup must not join this search
+    bss_pool_quiesce(ctx->pool);
+    search->data = data;
+    search->num_elements = num_elements;
+    search->target = target;
+    search->found_idx = -1;
     
-    if (found) {
-        printf("Found uint64_t value %" PRIu64 " at offset %lld (element index %lld)\n", 
-               target, (long long)target_offset, (long long)(target_offset / sizeof(uint64_t)));
-    } else {
-        printf("uint64_t value %" PRIu64 " not found in file\n", target);
+    bss_pool_run(ctx->pool, kary_search_job, search);
+    
+    *comparisons = 0;
+    for (int i = 0; i < ctx->num_threads; i++) {
+        *comparisons += search->num_comparisons[i];
     }
     
-    // Print timing information
-    printf("Search statistics (parallel mmap with %d threads):\n", num_threads);
-    printf("  Total time: %.3f ms\n", elapsed_ms);
-    printf("  Total comparisons performed: %d\n", total_comparisons);
+    if (search->found_idx >= 0) {
+        *index = search->found_idx;
+        return 1;
+    }
+    return 0;
+}
+
+// Search for a target uint64_t in a file using num_threads threads over
+// mmap. Fills *result without printing anything. Returns 0 on success, -1 on error.
+int parallel_binary_search_uint64_mmap(const char *filepath, uint64_t target, int num_threads,
+                                       bss_search_result_t *result) {
+    bss_options_t opts;
+    bss_handle_t *handle;
 
+    search_result_reset(result);
+
+    // Start timing
+    uint64_t start_time = get_nanoseconds();
+
+    // Open and map the file (bss_open caps the threads at the number of elements)
+    bss_default_options(&opts);
+    opts.engine = BSS_ENGINE_PARALLEL_MMAP;
+    opts.num_threads = num_threads;
+    handle = bss_open(filepath, &opts);
+    if (!handle) {
+        return -1;
+    }
+
+    int found = parallel_mmap_lookup(handle->parallel, handle->data, handle->num_elements, target,
+                                     &result->index, &result->probes);
+    result->bytes_read = (uint64_t)result->probes * sizeof(uint64_t);   // One value per probe
+
+    // Clean up
+    bss_close(handle);
+    if (found < 0) {
+        return -1;
+    }
+    result->found = found;
+
+    // End timing
+    result->elapsed_ms = (get_nanoseconds() - start_time) / 1e6;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,105 @@
+#include "bssearch_internal.h"
+#include <stdint.h>
+#include <string.h>
+
+// Files of fixed-size records: every record_size bytes hold an unsigned,
+// native-endian key of key_size bytes (4, 8 or 16), followed by a payload.
+// Dense files of 8-byte keys keep the uint64_t engines; everything else
+// goes through the kernels below.
+
+typedef unsigned __int128 key128_t;
+
+static inline uint32_t load_key32(const uint8_t *p) {
+    uint32_t key;
+    memcpy(&key, p, sizeof(key));
+    return key;
+}
+
+static inline uint64_t load_key64(const uint8_t *p) {
+    uint64_t key;
+    memcpy(&key, p, sizeof(key));
+    return key;
+}
+
+static inline key128_t load_key128(const uint8_t *p) {
+    key128_t key;
+    memcpy(&key, p, sizeof(key));
+    return key;
+}
+
+// Branchless lower bound over records, prefetching both candidates of the
+// next level. STRIDE is a constant for dense keys, so the address
+// arithmetic folds into shifts just like an array of the key type.
+#define DEFINE_RECORD_LOWER_BOUND(name, key_t, load, STRIDE)                                     \
+    static size_t name(const uint8_t *data, size_t n, size_t stride, key_t target) {              \
+        (void)stride;                                                                             \
+        if (n == 0) {                                                                             \
+            return 0;                                                                             \
+        }                                                                                         \
+        size_t base = 0;                                                                          \
+        while (n > 1) {                                                                           \
+            size_t half = n / 2;                                                                  \
+            __builtin_prefetch(data + (base + half / 2) * (STRIDE));                              \
+            __builtin_prefetch(data + (base + half + half / 2) * (STRIDE));                       \
+            base = load(data + (base + half) * (STRIDE)) < target ? base + half : base;           \
+            n -= half;                                                                            \
+        }                                                                                         \
+        return base + (load(data + base * (STRIDE)) < target);                                    \
+    }
+
+DEFINE_RECORD_LOWER_BOUND(lower_bound_dense32, uint32_t, load_key32, sizeof(uint32_t))
+DEFINE_RECORD_LOWER_BOUND(lower_bound_dense128, key128_t, load_key128, sizeof(key128_t))
+DEFINE_RECORD_LOWER_BOUND(lower_bound_strided32, uint32_t, load_key32, stride)
+DEFINE_RECORD_LOWER_BOUND(lower_bound_strided64, uint64_t, load_key64, stride)
+DEFINE_RECORD_LOWER_BOUND(lower_bound_strided128, key128_t, load_key128, stride)
+
+// First record index in [0, n) whose key is >= *key, or n
+size_t record_lower_bound(const uint8_t *data, size_t n, size_t record_size, size_t key_size, const void *key) {
+    switch (key_size) {
+        case sizeof(uint32_t):
+            return record_size == key_size
+                ? lower_bound_dense32(data, n, record_size, load_key32(key))
+                : lower_bound_strided32(data, n, record_size, load_key32(key));
+        case sizeof(uint64_t):
+            return record_size == key_size
+                ? lower_bound_kernel(BSS_KERNEL_BRANCHLESS)((const uint64_t *)data, n, load_key64(key))
+                : lower_bound_strided64(data, n, record_size, load_key64(key));
+        default:
+            return record_size == key_size
+                ? lower_bound_dense128(data, n, record_size, load_key128(key))
+                : lower_bound_strided128(data, n, record_size, load_key128(key));
+    }
+}
+
+// Compare the key of a record with *key: negative, zero or positive
+int record_key_compare(const void *record, const void *key, size_t key_size) {
+    switch (key_size) {
+        case sizeof(uint32_t): {
+            uint32_t a = load_key32(record), b = load_key32(key);
+            return (a > b) - (a < b);
+        }
+        case sizeof(uint64_t): {
+            uint64_t a = load_key64(record), b = load_key64(key);
+            return (a > b) - (a < b);
+        }
+        default: {
+            key128_t a = load_key128(record), b = load_key128(key);
+            return (a > b) - (a < b);
+        }
+    }
+}
+
+// Exact-match lookup over mapped records. On a hit the whole record is
+// copied to record (unless it is NULL).
+int record_lookup(const uint8_t *data, size_t n, size_t record_size, size_t key_size, const void *key,
+                  int64_t *index, void *record) {
+    size_t pos = record_lower_bound(data, n, record_size, key_size, key);
+    if (pos == n || record_key_compare(data + pos * record_size, key, key_size) != 0) {
+        return 0;
+    }
+    *index = pos;
+    if (record) {
+        memcpy(record, data + pos * record_size, record_size);
+    }
+    return 1;
+}
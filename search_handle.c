@@ -0,0 +1,921 @@
+#define _GNU_SOURCE         // For O_DIRECT
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define DEFAULT_BLOCK_SIZE 4096     // Bytes per io_uring block read when use_readahead is set
+#define DEFAULT_CACHE_BLOCKS 256    // Blocks kept by the io_uring block cache
+
+// Fill in the default options (simple mmap engine)
+void bss_default_options(bss_options_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->engine = BSS_ENGINE_MMAP;
+    opts->num_threads = 32;
+    opts->index_stride = 4096 / sizeof(uint64_t);
+    opts->key_size = sizeof(uint64_t);
+}
+
+// Whether the file holds anything but dense uint64_t keys
+static int is_record_file(const bss_handle_t *handle) {
+    return handle->opts.key_size != sizeof(uint64_t) || handle->opts.record_size != sizeof(uint64_t);
+}
+
+// Widen or narrow a uint64_t target to the key width of the file. Returns 0
+// if no key of that width equals target.
+static int target_to_key(const bss_handle_t *handle, uint64_t target, void *key) {
+    switch (handle->opts.key_size) {
+        case sizeof(uint32_t): {
+            if (target > UINT32_MAX) {
+                return 0;
+            }
+            uint32_t narrow = (uint32_t)target;
+            memcpy(key, &narrow, sizeof(narrow));
+            return 1;
+        }
+        case sizeof(uint64_t):
+            memcpy(key, &target, sizeof(target));
+            return 1;
+        default: {
+            unsigned __int128 wide = target;
+            memcpy(key, &wide, sizeof(wide));
+            return 1;
+        }
+    }
+}
+
+// Prewarm and lock the top of the search tree: the block headers of a
+// compressed file, the prefix of an Eytzinger file, the first probes otherwise
+static int prepare_levels(bss_handle_t *handle) {
+    const uint8_t *data = (const uint8_t *)handle->data;
+    size_t count = handle->num_elements;
+    size_t stride = handle->opts.record_size;
+    int eytzinger = handle->opts.engine == BSS_ENGINE_EYTZINGER;
+    if (handle->compressed) {
+        data = compressed_block_index(handle->compressed, &count, &stride);
+    }
+
+    if (handle->opts.prewarm_levels > 0) {
+        int64_t pages = mmap_touch_levels(data, count, stride, eytzinger, handle->opts.prewarm_levels,
+                                          MADV_WILLNEED, 0);
+        if (pages >= 0) {
+            bss_log(BSS_VERBOSITY_NORMAL, "Prewarmed %" PRId64 " pages of the top %d search levels\n",
+                    pages, handle->opts.prewarm_levels);
+        }
+    }
+
+    // Locked pages stay resident until the mapping goes away
+    if (handle->opts.lock_levels > 0) {
+        int64_t pages = mmap_touch_levels(data, count, stride, eytzinger, handle->opts.lock_levels, 0, 1);
+        if (pages < 0) {
+            return -1;
+        }
+        bss_log(BSS_VERBOSITY_NORMAL, "Locked %" PRId64 " pages of the top %d search levels\n",
+                pages, handle->opts.lock_levels);
+    }
+    return 0;
+}
+
+// Open the engines the auto engine routes to, each with a handle of its own:
+// mmap always, parallel mmap for files of 8-byte keys, and io_uring unless
+// its ring cannot be set up
+static int open_routes(bss_handle_t *handle, const char *filepath) {
+    static const bss_engine_t engines[AUTO_ROUTES] = {BSS_ENGINE_MMAP, BSS_ENGINE_PARALLEL_MMAP, BSS_ENGINE_IOURING};
+    static const char *names[AUTO_ROUTES] = {"mmap", "parallel mmap", "io_uring"};
+    int available[AUTO_ROUTES] = {0};
+
+    for (int r = 0; r < AUTO_ROUTES; r++) {
+        if (r == AUTO_ROUTE_PARALLEL && is_record_file(handle)) {
+            continue;
+        }
+        bss_options_t opts = handle->opts;
+        opts.engine = engines[r];
+        opts.collect_counters = 0;   // The auto handle counts around the routed lookups
+        if (r == AUTO_ROUTE_IOURING) {
+            opts.map_hugepage = opts.map_populate = opts.lock_levels = opts.prewarm_levels = 0;
+        }
+        handle->routes[r] = bss_open(filepath, &opts);
+        if (!handle->routes[r]) {
+            if (r == AUTO_ROUTE_MMAP) {
+                return -1;
+            }
+            bss_log(BSS_VERBOSITY_NORMAL, "Note: The auto engine continues without %s\n", names[r]);
+            continue;
+        }
+        available[r] = 1;
+    }
+
+    // The mmap route's mapping tells which key ranges are cached
+    handle->autosel = auto_ctx_create(handle->routes[AUTO_ROUTE_MMAP]->data, handle->num_elements,
+                                      handle->opts.record_size, handle->opts.key_size, available);
+    return handle->autosel ? 0 : -1;
+}
+
+// Open a file of sorted uint64_t values (or of fixed-size records sorted by
+// key, see opts.key_size) and prepare it for repeated lookups.
+// Returns NULL on error.
+bss_handle_t *bss_open(const char *filepath, const bss_options_t *opts) {
+    struct stat st;
+
+    bss_handle_t *handle = (bss_handle_t *)calloc(1, sizeof(bss_handle_t));
+    if (!handle) {
+        perror("calloc");
+        return NULL;
+    }
+    handle->opts = *opts;
+    handle->data = MAP_FAILED;
+    handle->direct_fd = -1;
+    handle->lower_bound = lower_bound_kernel(opts->kernel);
+
+    // Keys other than dense uint64_t go through the record kernels
+    handle->opts.key_size = opts->key_size ? opts->key_size : sizeof(uint64_t);
+    handle->opts.record_size = opts->record_size ? opts->record_size : handle->opts.key_size;
+    if (handle->opts.key_size != 4 && handle->opts.key_size != 8 && handle->opts.key_size != 16) {
+        fprintf(stderr, "Key size must be 4, 8 or 16 bytes\n");
+        free(handle);
+        return NULL;
+    }
+    if (handle->opts.record_size < handle->opts.key_size) {
+        fprintf(stderr, "Records must be at least as large as their %zu byte key\n", handle->opts.key_size);
+        free(handle);
+        return NULL;
+    }
+    if (is_record_file(handle)) {
+        if (opts->engine != BSS_ENGINE_MMAP && opts->engine != BSS_ENGINE_IOURING && opts->engine != BSS_ENGINE_AUTO) {
+            fprintf(stderr, "Keys other than 8 bytes and records with a payload need the mmap, io_uring "
+                            "or auto engine\n");
+            free(handle);
+            return NULL;
+        }
+        if (opts->use_index || opts->io_block_size || opts->use_readahead || opts->use_direct) {
+            fprintf(stderr, "The sparse index, block reads and O_DIRECT need a file of 8-byte keys\n");
+            free(handle);
+            return NULL;
+        }
+    }
+    if ((opts->map_hugepage || opts->map_populate || opts->lock_levels || opts->prewarm_levels) &&
+        (opts->engine == BSS_ENGINE_IOURING || opts->engine == BSS_ENGINE_IOURING_MT)) {
+        fprintf(stderr, "Huge pages, MAP_POPULATE, mlock and prewarming apply to the mmap engines only\n");
+        free(handle);
+        return NULL;
+    }
+
+    // Open the file
+    handle->fd = open(filepath, O_RDONLY);
+    if (handle->fd < 0) {
+        perror("open");
+        free(handle);
+        return NULL;
+    }
+
+    // Get file size
+    if (fstat(handle->fd, &st) < 0) {
+        perror("fstat");
+        goto fail;
+    }
+
+    // Check if file size is valid for an array of records
+    if (st.st_size % handle->opts.record_size != 0) {
+        fprintf(stderr, "File size is not a multiple of the %zu byte record size\n", handle->opts.record_size);
+        goto fail;
+    }
+
+    // Calculate number of elements
+    handle->file_size = st.st_size;
+    handle->num_elements = st.st_size / handle->opts.record_size;
+    if (handle->num_elements == 0) {
+        fprintf(stderr, "File is empty\n");
+        goto fail;
+    }
+
+    switch (opts->engine) {
+        case BSS_ENGINE_MMAP:
+        case BSS_ENGINE_PARALLEL_MMAP:
+        case BSS_ENGINE_EYTZINGER:
+        case BSS_ENGINE_INTERPOLATION:
+        case BSS_ENGINE_COMPRESSED:
+            // Memory map the file, prefaulting every page if asked to
+            handle->data = (uint64_t *)mmap(NULL, handle->file_size, PROT_READ,
+                                            MAP_PRIVATE | (opts->map_populate ? MAP_POPULATE : 0), handle->fd, 0);
+            if (handle->data == MAP_FAILED) {
+                perror("mmap");
+                goto fail;
+            }
+
+            // Huge pages of the page cache need file THP (CONFIG_READ_ONLY_THP_FOR_FS or a
+            // THP-capable filesystem); without it the mapping keeps 4 KiB pages
+            if (opts->map_hugepage && madvise(handle->data, handle->file_size, MADV_HUGEPAGE) != 0) {
+                bss_log(BSS_VERBOSITY_NORMAL, "Note: Transparent huge pages are not available for this mapping (%s)\n",
+                        strerror(errno));
+            }
+            if (opts->engine == BSS_ENGINE_PARALLEL_MMAP) {
+                if (madvise(handle->data, handle->file_size, MADV_RANDOM) != 0) {
+                    perror("madvise");
+                    goto fail;
+                }
+
+                // Start the workers once; lookups only dispatch to them
+                int num_threads = opts->num_threads;
+                if (handle->num_elements < (size_t)num_threads) {
+                    num_threads = handle->num_elements;
+                }
+                handle->parallel = parallel_ctx_create(num_threads, opts->pin_threads);
+                if (!handle->parallel) {
+                    goto fail;
+                }
+            }
+
+            // The element count comes from the compressed file's header
+            if (opts->engine == BSS_ENGINE_COMPRESSED) {
+                handle->compressed = compressed_open(handle->data, handle->file_size, &handle->num_elements);
+                if (!handle->compressed) {
+                    goto fail;
+                }
+            }
+
+            // Fit the key distribution once; lookups then probe only the error window
+            if (opts->engine == BSS_ENGINE_INTERPOLATION && opts->model_error) {
+                if (learned_model_open(&handle->model, filepath, handle->fd, handle->data, handle->num_elements,
+                                       opts->model_error, opts->model_sidecar) < 0) {
+                    goto fail;
+                }
+            }
+
+            if (prepare_levels(handle) < 0) {
+                goto fail;
+            }
+            break;
+        case BSS_ENGINE_IOURING:
+        case BSS_ENGINE_IOURING_MT:
+            if (posix_fadvise(handle->fd, 0, handle->file_size, POSIX_FADV_RANDOM) < 0) {
+                fprintf(stderr, "Could not fadvise\n");
+                goto fail;
+            }
+
+            // Page-granular reads go through a block cache owned by the handle
+            size_t block_size = opts->io_block_size;
+            if (block_size == 0 && (opts->use_readahead || opts->use_direct)) {
+                block_size = DEFAULT_BLOCK_SIZE;
+            }
+            if (block_size) {
+                if (block_size % sizeof(uint64_t) != 0 || (block_size & (block_size - 1)) != 0) {
+                    fprintf(stderr, "Block size must be a power of two multiple of %zu bytes\n", sizeof(uint64_t));
+                    goto fail;
+                }
+                if (opts->use_direct && block_size < BSS_DIRECT_ALIGNMENT) {
+                    fprintf(stderr, "O_DIRECT needs blocks of at least %d bytes\n", BSS_DIRECT_ALIGNMENT);
+                    goto fail;
+                }
+            }
+            size_t cache_blocks = opts->io_cache_blocks ? opts->io_cache_blocks : DEFAULT_CACHE_BLOCKS;
+
+            // Lookups read through a second, unbuffered descriptor; the
+            // buffered one stays for building the sparse index
+            if (opts->use_direct) {
+                handle->direct_fd = open(filepath, O_RDONLY | O_DIRECT);
+                if (handle->direct_fd < 0) {
+                    perror("open O_DIRECT");
+                    goto fail;
+                }
+            }
+
+            // The multi-threaded engine gives every worker its own ring and cache
+            if (opts->engine == BSS_ENGINE_IOURING_MT) {
+                handle->uring_mt = iouring_mt_create(opts, handle->fd, handle->direct_fd, handle->num_elements,
+                                                     handle->lower_bound, block_size, cache_blocks);
+                if (!handle->uring_mt) {
+                    goto fail;
+                }
+                break;
+            }
+
+            if (block_size) {
+                handle->cache = block_cache_create(block_size, cache_blocks);
+                if (!handle->cache) {
+                    goto fail;
+                }
+            }
+            handle->uring = iouring_ctx_create(opts, handle->cache, handle->lower_bound, handle->direct_fd);
+            if (!handle->uring) {
+                goto fail;
+            }
+            break;
+        case BSS_ENGINE_AUTO:
+            // The routes build their own sparse indexes
+            if (open_routes(handle, filepath) < 0) {
+                goto fail;
+            }
+            return handle;
+        default:
+            fprintf(stderr, "Invalid engine: %d\n", opts->engine);
+            goto fail;
+    }
+
+    // Sample the top of the search tree into memory
+    if (opts->use_index && opts->engine == BSS_ENGINE_EYTZINGER) {
+        fprintf(stderr, "The sparse index needs a sorted file, not an Eytzinger layout\n");
+        goto fail;
+    }
+    if (opts->use_index && opts->engine == BSS_ENGINE_COMPRESSED) {
+        fprintf(stderr, "A compressed file carries its own block index; the sparse index is not supported\n");
+        goto fail;
+    }
+    if (opts->use_index && opts->engine == BSS_ENGINE_IOURING_MT) {
+        fprintf(stderr, "The sparse index is not supported by the multi-threaded io_uring engine\n");
+        goto fail;
+    }
+    if (opts->use_index) {
+        if (sparse_index_open(&handle->index, filepath, handle->fd, handle->num_elements,
+                              opts->index_stride, opts->index_sidecar, handle->lower_bound) < 0) {
+            goto fail;
+        }
+        if (opts->engine == BSS_ENGINE_IOURING) {
+            // O_DIRECT reads whole, aligned pages into an aligned buffer
+            size_t bytes = opts->index_stride * sizeof(uint64_t);
+            if (opts->use_direct && bytes % BSS_DIRECT_ALIGNMENT != 0) {
+                fprintf(stderr, "With O_DIRECT the index stride must cover whole %d byte pages\n",
+                        BSS_DIRECT_ALIGNMENT);
+                goto fail;
+            }
+            bytes = (bytes + BSS_DIRECT_ALIGNMENT - 1) / BSS_DIRECT_ALIGNMENT * BSS_DIRECT_ALIGNMENT;
+            handle->block_buf = (uint64_t *)aligned_alloc(BSS_DIRECT_ALIGNMENT, bytes);
+            if (!handle->block_buf) {
+                perror("malloc");
+                goto fail;
+            }
+        }
+    }
+
+    return handle;
+
+fail:
+    bss_close(handle);
+    return NULL;
+}
+
+// Faults and io_uring rounds at the start of a counted lookup
+typedef struct {
+    uint64_t minor_faults;
+    uint64_t major_faults;
+    unsigned rounds;
+} counter_snapshot;
+
+static void take_snapshot(const bss_handle_t *handle, counter_snapshot *snap) {
+    struct rusage usage;
+
+    // Lookups of the pooled engines fault on the workers, so those (and the
+    // auto engine, which may route to one) count the whole process
+    int who = handle->opts.engine == BSS_ENGINE_PARALLEL_MMAP || handle->opts.engine == BSS_ENGINE_IOURING_MT ||
+              handle->opts.engine == BSS_ENGINE_AUTO
+        ? RUSAGE_SELF : RUSAGE_THREAD;
+    getrusage(who, &usage);
+    snap->minor_faults = usage.ru_minflt;
+    snap->major_faults = usage.ru_majflt;
+    if (handle->autosel && handle->routes[AUTO_ROUTE_IOURING]) {
+        handle = handle->routes[AUTO_ROUTE_IOURING];
+    }
+    snap->rounds = handle->uring ? iouring_rounds(handle->uring) : 0;
+}
+
+// Account for num_lookups lookups that started at *before. probes is how deep
+// they searched, or -1 if the engine does not say; rounds of io_uring reads
+// take its place whenever there were any.
+static void count_lookups(bss_handle_t *handle, const counter_snapshot *before, uint64_t num_lookups, int probes) {
+    bss_counters_t *counters = &handle->counters;
+    counter_snapshot after;
+
+    take_snapshot(handle, &after);
+    if (after.rounds != before->rounds) {
+        probes = after.rounds - before->rounds;
+    }
+
+    // Handles of the multi-threaded io_uring engine take lookups from several threads at once
+    __atomic_fetch_add(&counters->lookups, num_lookups, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->minor_faults, after.minor_faults - before->minor_faults, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->major_faults, after.major_faults - before->major_faults, __ATOMIC_RELAXED);
+    if (probes >= 0) {
+        __atomic_fetch_add(&counters->probed_lookups, num_lookups, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&counters->probes, (uint64_t)probes, __ATOMIC_RELAXED);
+    }
+}
+
+static int find_key(bss_handle_t *handle, const void *key, int64_t *index, void *record, int *probes);
+
+// Exact-match lookup behind bss_find(). Engines that count how deep they
+// searched store it in *probes and leave it alone otherwise.
+static int find_value(bss_handle_t *handle, uint64_t target, int64_t *index, int *probes) {
+
+    if (is_record_file(handle)) {
+        unsigned char key[16];
+        if (!target_to_key(handle, target, key)) {
+            return 0;
+        }
+        return find_key(handle, key, index, NULL, probes);
+    }
+
+    // The auto engine hands the lookup to one of its routes and learns how long it took
+    if (handle->autosel) {
+        bss_auto_ticket ticket;
+        bss_handle_t *route = handle->routes[auto_begin(handle->autosel, &target, sizeof(target), &ticket)];
+        int found = find_value(route, target, index, probes);
+        auto_end(handle->autosel, &ticket, 1);
+        return found;
+    }
+
+    // With a sparse index the lookup narrows to one block in RAM first
+    if (handle->index.keys) {
+        size_t lo, hi;
+        if (sparse_index_lookup(&handle->index, handle->num_elements, target, &lo, &hi) < 0) {
+            return 0;
+        }
+
+        if (handle->opts.engine == BSS_ENGINE_IOURING) {
+            return iouring_lookup_block(handle->uring, handle->fd, handle->block_buf, lo, hi - lo + 1,
+                                        target, handle->lower_bound, index);
+        }
+
+        // A single block is not worth splitting across threads
+        int found = handle->opts.kernel != BSS_KERNEL_SCALAR
+            ? kernel_lookup(handle->lower_bound, handle->data + lo, hi - lo + 1, target, index)
+            : mmap_lookup(handle->data + lo, hi - lo + 1, target, index, probes);
+        if (found > 0) {
+            *index += lo;
+        }
+        return found;
+    }
+
+    switch (handle->opts.engine) {
+        case BSS_ENGINE_MMAP:
+            if (handle->opts.kernel != BSS_KERNEL_SCALAR) {
+                return kernel_lookup(handle->lower_bound, handle->data, handle->num_elements, target, index);
+            }
+            return mmap_lookup(handle->data, handle->num_elements, target, index, probes);
+        case BSS_ENGINE_PARALLEL_MMAP:
+            if (handle->opts.parallel_mode == BSS_PARALLEL_COOPERATIVE) {
+                return parallel_mmap_kary_lookup(handle->parallel, handle->data, handle->num_elements, target,
+                                                 index, probes);
+            }
+            return parallel_mmap_lookup(handle->parallel, handle->data, handle->num_elements, target,
+                                        index, probes);
+        case BSS_ENGINE_EYTZINGER:
+            return eytzinger_lookup(handle->data, handle->num_elements, target, index, probes);
+        case BSS_ENGINE_COMPRESSED:
+            return compressed_lookup(handle->compressed, handle->lower_bound, target, index);
+        case BSS_ENGINE_INTERPOLATION:
+            if (handle->model.segments) {
+                return learned_lookup(&handle->model, handle->lower_bound, handle->data, handle->num_elements,
+                                      target, index);
+            }
+            return interpolation_lookup(handle->data, handle->num_elements, target, index, probes);
+        case BSS_ENGINE_IOURING:
+            return iouring_lookup(handle->uring, handle->fd, handle->num_elements, target, index, probes);
+        case BSS_ENGINE_IOURING_MT:
+            return iouring_mt_lookup(handle->uring_mt, target, index);
+        default:
+            return -1;
+    }
+}
+
+// Look up a single value. Returns 1 and stores the element index in *index
+// if found, 0 if the value is not in the file, -1 on error.
+int bss_find(bss_handle_t *handle, uint64_t target, int64_t *index) {
+    int probes = -1;
+
+    if (!handle->opts.collect_counters) {
+        return find_value(handle, target, index, &probes);
+    }
+    counter_snapshot before;
+    take_snapshot(handle, &before);
+    int found = find_value(handle, target, index, &probes);
+    count_lookups(handle, &before, 1, probes);
+    return found;
+}
+
+// Look up a key of opts.key_size native-endian bytes. Returns 1 and stores
+// the record index in *index if found, 0 if the key is not in the file, -1
+// on error. On a hit the whole record (opts.record_size bytes, key first) is
+// copied to record unless it is NULL; it comes from the same read as the key.
+static int find_key(bss_handle_t *handle, const void *key, int64_t *index, void *record, int *probes) {
+    size_t record_size = handle->opts.record_size;
+
+    if (handle->autosel) {
+        bss_auto_ticket ticket;
+        bss_handle_t *route = handle->routes[auto_begin(handle->autosel, key, handle->opts.key_size, &ticket)];
+        int found = find_key(route, key, index, record, probes);
+        auto_end(handle->autosel, &ticket, 1);
+        return found;
+    }
+
+    // A file of bare uint64_t keys: the record is the key itself
+    if (!is_record_file(handle)) {
+        uint64_t target;
+        memcpy(&target, key, sizeof(target));
+        int found = find_value(handle, target, index, probes);
+        if (found > 0 && record) {
+            memcpy(record, key, sizeof(target));
+        }
+        return found;
+    }
+
+    if (handle->opts.engine == BSS_ENGINE_IOURING) {
+        size_t pos;
+        int found = iouring_lookup_record(handle->uring, handle->fd, handle->num_elements, record_size,
+                                          handle->opts.key_size, key, 0, &pos, record, probes);
+        if (found > 0) {
+            *index = pos;
+        }
+        return found;
+    }
+    return record_lookup((const uint8_t *)handle->data, handle->num_elements, record_size, handle->opts.key_size,
+                         key, index, record);
+}
+
+int bss_find_key(bss_handle_t *handle, const void *key, int64_t *index, void *record) {
+    int probes = -1;
+
+    if (!handle->opts.collect_counters) {
+        return find_key(handle, key, index, record, &probes);
+    }
+    counter_snapshot before;
+    take_snapshot(handle, &before);
+    int found = find_key(handle, key, index, record, &probes);
+    count_lookups(handle, &before, 1, probes);
+    return found;
+}
+
+// Look up many values at once. indices[i] receives the element index of
+// targets[i], or -1 if absent. Returns the number of values found, -1 on error.
+static int find_batch(bss_handle_t *handle, const uint64_t *targets, size_t num_targets, int64_t *indices) {
+    // The whole batch takes the route of its first target
+    if (handle->autosel && num_targets > 0) {
+        bss_auto_ticket ticket;
+        bss_handle_t *route = handle->routes[auto_begin(handle->autosel, &targets[0], sizeof(targets[0]), &ticket)];
+        int found = find_batch(route, targets, num_targets, indices);
+        auto_end(handle->autosel, &ticket, num_targets);
+        return found;
+    }
+
+    if (handle->opts.engine == BSS_ENGINE_IOURING_MT) {
+        return iouring_mt_lookup_batch(handle->uring_mt, targets, num_targets, indices);
+    }
+
+    // Sorted keys share the top of the search and walk the mapping in order
+    if (handle->opts.engine == BSS_ENGINE_MMAP && !handle->index.keys && !is_record_file(handle)) {
+        return mmap_lookup_batch(handle->lower_bound, handle->data, handle->num_elements, targets, num_targets,
+                                 indices);
+    }
+
+    // With the index in RAM each target needs one block read, and the reads overlap
+    if (handle->opts.engine == BSS_ENGINE_IOURING && handle->index.keys) {
+        return iouring_lookup_blocks(handle->uring, handle->fd, handle->num_elements, &handle->index,
+                                     targets, num_targets, indices);
+    }
+
+    // The batched core issues 8-byte reads, which O_DIRECT cannot serve
+    if (handle->opts.engine == BSS_ENGINE_IOURING && !handle->opts.use_direct && !is_record_file(handle)) {
+        uint64_t total_reads;
+        return iouring_lookup_batch(handle->uring, handle->fd, handle->num_elements, NULL,
+                                    targets, num_targets, indices, &total_reads);
+    }
+
+    int found = 0;
+    for (size_t i = 0; i < num_targets; i++) {
+        int probes;
+        int ret = find_value(handle, targets[i], &indices[i], &probes);
+        if (ret < 0) {
+            return -1;
+        }
+        if (!ret) {
+            indices[i] = -1;
+        }
+        found += ret;
+    }
+    return found;
+}
+
+int bss_find_batch(bss_handle_t *handle, const uint64_t *targets, size_t num_targets, int64_t *indices) {
+    if (!handle->opts.collect_counters) {
+        return find_batch(handle, targets, num_targets, indices);
+    }
+    counter_snapshot before;
+    take_snapshot(handle, &before);
+    int found = find_batch(handle, targets, num_targets, indices);
+    count_lookups(handle, &before, num_targets, -1);
+    return found;
+}
+
+// First element index whose value is >= target, or the number of elements if
+// there is none. On an Eytzinger file *pos is the element's index within the
+// file, not its rank. Returns 0 on success, -1 on error.
+static int find_lower_bound(bss_handle_t *handle, uint64_t target, size_t *pos, int *probes) {
+
+    if (handle->autosel) {
+        bss_auto_ticket ticket;
+        bss_handle_t *route = handle->routes[auto_begin(handle->autosel, &target, sizeof(target), &ticket)];
+        int ret = find_lower_bound(route, target, pos, probes);
+        auto_end(handle->autosel, &ticket, 1);
+        return ret;
+    }
+
+    if (is_record_file(handle)) {
+        unsigned char key[16];
+        if (!target_to_key(handle, target, key)) {
+            *pos = handle->num_elements;   // Above every 32-bit key
+            return 0;
+        }
+        if (handle->opts.engine == BSS_ENGINE_IOURING) {
+            return iouring_lookup_record(handle->uring, handle->fd, handle->num_elements, handle->opts.record_size,
+                                         handle->opts.key_size, key, 1, pos, NULL, probes);
+        }
+        *pos = record_lower_bound((const uint8_t *)handle->data, handle->num_elements, handle->opts.record_size,
+                                  handle->opts.key_size, key);
+        return 0;
+    }
+
+    // The index narrows the bound to one block (or the start of the next one)
+    if (handle->index.keys) {
+        size_t lo, hi;
+        if (sparse_index_lower_block(&handle->index, handle->num_elements, target, &lo, &hi) < 0) {
+            *pos = 0;
+            return 0;
+        }
+        if (handle->opts.engine == BSS_ENGINE_IOURING) {
+            return iouring_lower_bound_block(handle->uring, handle->fd, handle->block_buf, lo, hi - lo + 1,
+                                             target, handle->lower_bound, pos);
+        }
+        *pos = lo + handle->lower_bound(handle->data + lo, hi - lo + 1, target);
+        return 0;
+    }
+
+    switch (handle->opts.engine) {
+        case BSS_ENGINE_MMAP:
+            *pos = handle->lower_bound(handle->data, handle->num_elements, target);
+            return 0;
+        case BSS_ENGINE_PARALLEL_MMAP:
+            return parallel_mmap_lower_bound(handle->parallel, handle->data, handle->num_elements, target,
+                                             handle->lower_bound, pos);
+        case BSS_ENGINE_EYTZINGER:
+            *pos = eytzinger_lower_bound(handle->data, handle->num_elements, target);
+            return 0;
+        case BSS_ENGINE_COMPRESSED:
+            *pos = compressed_lower_bound(handle->compressed, handle->lower_bound, target);
+            return 0;
+        case BSS_ENGINE_INTERPOLATION:
+            if (handle->model.segments) {
+                *pos = learned_lower_bound(&handle->model, handle->lower_bound, handle->data, handle->num_elements,
+                                           target);
+                return 0;
+            }
+            *probes = 0;
+            *pos = interpolation_lower_bound(handle->data, handle->num_elements, target, probes);
+            return 0;
+        case BSS_ENGINE_IOURING:
+            return iouring_lower_bound(handle->uring, handle->fd, handle->num_elements, target, pos, probes);
+        case BSS_ENGINE_IOURING_MT:
+            return iouring_mt_lower_bound(handle->uring_mt, target, pos);
+        default:
+            return -1;
+    }
+}
+
+int bss_lower_bound(bss_handle_t *handle, uint64_t target, size_t *pos) {
+    int probes = -1;
+
+    if (!handle->opts.collect_counters) {
+        return find_lower_bound(handle, target, pos, &probes);
+    }
+    counter_snapshot before;
+    take_snapshot(handle, &before);
+    int ret = find_lower_bound(handle, target, pos, &probes);
+    count_lookups(handle, &before, 1, probes);
+    return ret;
+}
+
+// First element index whose value is > target, or the number of elements if
+// there is none. Returns 0 on success, -1 on error.
+int bss_upper_bound(bss_handle_t *handle, uint64_t target, size_t *pos) {
+    if (target == UINT64_MAX) {
+        *pos = handle->num_elements;
+        return 0;
+    }
+    return bss_lower_bound(handle, target + 1, pos);
+}
+
+// The copies of target: they start at its lower bound, and the mmap engines
+// walk on from there (galloping, or along the Eytzinger successors) while the
+// others search the lower bound of the next value as well.
+static int find_equal_range(bss_handle_t *handle, uint64_t target, size_t *first, size_t *last, size_t *count,
+                            int *probes) {
+    size_t n = handle->num_elements;
+
+    // Both ends come from the same route
+    if (handle->autosel) {
+        bss_auto_ticket ticket;
+        bss_handle_t *route = handle->routes[auto_begin(handle->autosel, &target, sizeof(target), &ticket)];
+        int found = find_equal_range(route, target, first, last, count, probes);
+        auto_end(handle->autosel, &ticket, 1);
+        return found;
+    }
+
+    *count = 0;
+    if (find_lower_bound(handle, target, first, probes) < 0) {
+        return -1;
+    }
+    *last = *first;
+    if (*first == n) {
+        return 0;
+    }
+
+    int mapped = handle->opts.engine == BSS_ENGINE_MMAP || handle->opts.engine == BSS_ENGINE_PARALLEL_MMAP ||
+                 handle->opts.engine == BSS_ENGINE_EYTZINGER || handle->opts.engine == BSS_ENGINE_INTERPOLATION;
+    if (mapped && !is_record_file(handle)) {
+        if (handle->data[*first] != target) {
+            return 0;
+        }
+        if (handle->opts.engine == BSS_ENGINE_EYTZINGER) {
+            *count = eytzinger_run(handle->data, n, *first, target, last);
+        } else {
+            size_t end = mmap_run_end(handle->data, n, *first, target);
+            *count = end - *first;
+            *last = end - 1;
+        }
+        return 1;
+    }
+
+    size_t end = n;
+    int more = -1;
+    if (target < UINT64_MAX && find_lower_bound(handle, target + 1, &end, &more) < 0) {
+        return -1;
+    }
+    if (*probes >= 0 && more >= 0) {
+        *probes += more;
+    }
+    *count = end - *first;
+    *last = *count ? end - 1 : *first;
+    return *count > 0;
+}
+
+// Every copy of target, for files with runs of duplicate keys: *first and
+// *last are the smallest and largest copy and *count how many there are. On a
+// sorted file they are element indexes with *last = *first + *count - 1; on
+// an Eytzinger file they are the copies' element indexes within the file.
+// Returns 1 if target is present, 0 if not (*count is 0 and *first its lower
+// bound), -1 on error.
+int bss_equal_range(bss_handle_t *handle, uint64_t target, size_t *first, size_t *last, size_t *count) {
+    int probes = -1;
+
+    if (!handle->opts.collect_counters) {
+        return find_equal_range(handle, target, first, last, count, &probes);
+    }
+    counter_snapshot before;
+    take_snapshot(handle, &before);
+    int found = find_equal_range(handle, target, first, last, count, &probes);
+    count_lookups(handle, &before, 1, probes);
+    return found;
+}
+
+// Stream every value in [lo_key, hi_key) to fn, in order, in chunks. fn may
+// stop the scan by returning nonzero. Returns the number of values handed to
+// fn, or -1 on error. The mmap engines read the span sequentially
+// (MADV_SEQUENTIAL), the io_uring engine with large linked reads and the
+// compressed engine unpacks one block at a time.
+int64_t bss_scan(bss_handle_t *handle, uint64_t lo_key, uint64_t hi_key, bss_scan_fn fn, void *arg) {
+    size_t start, end;
+
+    // Sequential reads through the page cache suit cached and cold spans alike
+    if (handle->autosel) {
+        return bss_scan(handle->routes[AUTO_ROUTE_MMAP], lo_key, hi_key, fn, arg);
+    }
+
+    if (handle->opts.engine == BSS_ENGINE_EYTZINGER) {
+        fprintf(stderr, "Range scans need a sorted file, not an Eytzinger layout\n");
+        return -1;
+    }
+    if (handle->opts.engine == BSS_ENGINE_IOURING_MT) {
+        fprintf(stderr, "Range scans are not supported by the multi-threaded io_uring engine\n");
+        return -1;
+    }
+    if (is_record_file(handle)) {
+        fprintf(stderr, "Range scans hand uint64_t values to the callback and need a file of 8-byte keys\n");
+        return -1;
+    }
+    if (hi_key <= lo_key) {
+        return 0;
+    }
+
+    // Both bounds make up one lookup in the counters
+    counter_snapshot before;
+    int lo_probes = -1, hi_probes = -1;
+    if (handle->opts.collect_counters) {
+        take_snapshot(handle, &before);
+    }
+    int ret = find_lower_bound(handle, lo_key, &start, &lo_probes);
+    if (ret == 0) {
+        ret = find_lower_bound(handle, hi_key, &end, &hi_probes);
+    }
+    if (handle->opts.collect_counters) {
+        count_lookups(handle, &before, 1, lo_probes < 0 || hi_probes < 0 ? -1 : lo_probes + hi_probes);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (handle->opts.engine == BSS_ENGINE_COMPRESSED) {
+        return compressed_scan(handle->compressed, start, end, fn, arg);
+    }
+    if (handle->opts.engine == BSS_ENGINE_IOURING) {
+        return iouring_scan(handle->uring, handle->fd, start, end, fn, arg);
+    }
+    int advice = handle->opts.engine == BSS_ENGINE_PARALLEL_MMAP ? MADV_RANDOM : MADV_NORMAL;
+    return mmap_scan(handle->data, start, end, advice, fn, arg);
+}
+
+// Number of values (or records) in the file
+size_t bss_num_elements(const bss_handle_t *handle) {
+    return handle->num_elements;
+}
+
+// Totals of the handle's rings (and of the auto engine's routes) since open
+static void ring_counters(const bss_handle_t *handle, bss_counters_t *counters) {
+    memset(counters, 0, sizeof(*counters));
+    if (handle->uring) {
+        iouring_add_counters(handle->uring, counters);
+    }
+    if (handle->uring_mt) {
+        iouring_mt_add_counters(handle->uring_mt, counters);
+    }
+    if (handle->autosel) {
+        auto_add_counters(handle->autosel, counters);
+        if (handle->routes[AUTO_ROUTE_IOURING]) {
+            iouring_add_counters(handle->routes[AUTO_ROUTE_IOURING]->uring, counters);
+        }
+    }
+}
+
+// Counters since open or the last bss_reset_counters()
+void bss_get_counters(const bss_handle_t *handle, bss_counters_t *counters) {
+    bss_counters_t rings;
+
+    *counters = handle->counters;
+    counters->log2_elements = handle->num_elements ? log2((double)handle->num_elements) : 0;
+    ring_counters(handle, &rings);
+    counters->io_requests = rings.io_requests - handle->io_base.io_requests;
+    counters->io_bytes = rings.io_bytes - handle->io_base.io_bytes;
+    counters->cache_hits = rings.cache_hits - handle->io_base.cache_hits;
+    counters->cache_misses = rings.cache_misses - handle->io_base.cache_misses;
+    counters->routed_mmap = rings.routed_mmap - handle->io_base.routed_mmap;
+    counters->routed_parallel = rings.routed_parallel - handle->io_base.routed_parallel;
+    counters->routed_iouring = rings.routed_iouring - handle->io_base.routed_iouring;
+}
+
+// Start counting afresh, e.g. after a warm-up
+void bss_reset_counters(bss_handle_t *handle) {
+    memset(&handle->counters, 0, sizeof(handle->counters));
+    ring_counters(handle, &handle->io_base);
+}
+
+// Release everything held by the handle
+void bss_close(bss_handle_t *handle) {
+    if (!handle) {
+        return;
+    }
+    auto_ctx_destroy(handle->autosel);
+    for (int r = 0; r < AUTO_ROUTES; r++) {
+        bss_close(handle->routes[r]);
+    }
+    sparse_index_free(&handle->index);
+    learned_model_free(&handle->model);
+    if (handle->compressed) {
+        compressed_close(handle->compressed);
+    }
+    if (handle->uring) {
+        iouring_ctx_destroy(handle->uring);
+    }
+    free(handle->block_buf);     // After the ring: a failed block read may still land in it
+    if (handle->uring_mt) {
+        iouring_mt_destroy(handle->uring_mt);
+    }
+    block_cache_destroy(handle->cache);
+    if (handle->parallel) {
+        parallel_ctx_destroy(handle->parallel);
+    }
+    if (handle->data != MAP_FAILED) {
+        munmap(handle->data, handle->file_size);
+    }
+    if (handle->direct_fd >= 0) {
+        close(handle->direct_fd);
+    }
+    if (handle->fd >= 0) {
+        close(handle->fd);
+    }
+    free(handle);
+}
@@ -0,0 +1,203 @@
+#include "bssearch_internal.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// All kernels compute the lower bound: the first index i in [0, n) with
+// data[i] >= target, or n if every element is smaller.
+
+// Below this many elements the SIMD kernels stop narrowing and count the rest
+#define SIMD_LINEAR_THRESHOLD 32
+
+// Plain scalar lower bound
+static size_t scalar_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    size_t lo = 0;
+    while (n > 0) {
+        size_t half = n / 2;
+        if (data[lo + half] < target) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+// Branchless lower bound with software prefetching. The range update compiles
+// to a conditional move instead of an unpredictable branch, and both possible
+// midpoints of the next level are prefetched while the current one is compared.
+static size_t branchless_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    if (n == 0) {
+        return 0;
+    }
+
+    const uint64_t *base = data;
+    size_t len = n;
+    while (len > 1) {
+        size_t half = len / 2;
+        size_t next = len - half;
+        __builtin_prefetch(base + next / 2);
+        __builtin_prefetch(base + half + next / 2);
+        base += (base[half] < target) * half;
+        len = next;
+    }
+    return (base - data) + (*base < target);
+}
+
+// Scalar linear scan: counts the elements smaller than target
+static size_t scalar_linear_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += data[i] < target;
+    }
+    return count;
+}
+
+#if defined(__x86_64__)
+
+// AVX2 has only signed 64-bit compares; flipping the sign bit maps unsigned order onto signed order
+#define SIGN_BIT 0x8000000000000000ULL
+
+__attribute__((target("avx2")))
+static size_t avx2_linear_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    const __m256i flip = _mm256_set1_epi64x((long long)SIGN_BIT);
+    const __m256i t = _mm256_xor_si256(_mm256_set1_epi64x((long long)target), flip);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(data + i)), flip);
+        __m256i lt = _mm256_cmpgt_epi64(t, v);
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+    }
+    return count + scalar_linear_lower_bound(data + i, n - i, target);
+}
+
+// 5-ary search: each step compares 4 gathered pivots at once and keeps the
+// segment between the last pivot below target and the first one at/above it
+__attribute__((target("avx2")))
+static size_t avx2_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    const __m256i flip = _mm256_set1_epi64x((long long)SIGN_BIT);
+    const __m256i t = _mm256_xor_si256(_mm256_set1_epi64x((long long)target), flip);
+    size_t lo = 0;
+    size_t len = n;
+
+    while (len > SIMD_LINEAR_THRESHOLD) {
+        size_t step = len / 5;
+        __m256i idx = _mm256_set_epi64x((long long)(lo + 4 * step), (long long)(lo + 3 * step),
+                                        (long long)(lo + 2 * step), (long long)(lo + step));
+        __m256i v = _mm256_i64gather_epi64((const long long *)data, idx, 8);
+        __m256i lt = _mm256_cmpgt_epi64(t, _mm256_xor_si256(v, flip));
+        size_t c = __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+
+        // Pivot j sits at lo + (j + 1) * step; keep (pivot c-1, pivot c]
+        size_t end = c < 4 ? lo + (c + 1) * step : lo + len;
+        if (c > 0) {
+            lo += c * step + 1;
+        }
+        len = end - lo;
+    }
+    return lo + avx2_linear_lower_bound(data + lo, len, target);
+}
+
+__attribute__((target("avx512f")))
+static size_t avx512_linear_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    const __m512i t = _mm512_set1_epi64((long long)target);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        count += __builtin_popcount(_mm512_cmplt_epu64_mask(v, t));
+    }
+    if (i < n) {
+        // Masked load of the tail; inactive lanes never count
+        __mmask8 tail = (__mmask8)((1u << (n - i)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi64(tail, (const void *)(data + i));
+        count += __builtin_popcount(_mm512_mask_cmplt_epu64_mask(tail, v, t));
+    }
+    return count;
+}
+
+// 9-ary search: 8 gathered pivots and one unsigned compare per step
+__attribute__((target("avx512f")))
+static size_t avx512_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    const __m512i t = _mm512_set1_epi64((long long)target);
+    size_t lo = 0;
+    size_t len = n;
+
+    while (len > SIMD_LINEAR_THRESHOLD) {
+        size_t step = len / 9;
+        __m512i idx = _mm512_add_epi64(_mm512_set1_epi64((long long)lo),
+                                       _mm512_set_epi64((long long)(8 * step), (long long)(7 * step),
+                                                        (long long)(6 * step), (long long)(5 * step),
+                                                        (long long)(4 * step), (long long)(3 * step),
+                                                        (long long)(2 * step), (long long)step));
+        __m512i v = _mm512_i64gather_epi64(idx, (const void *)data, 8);
+        size_t c = __builtin_popcount(_mm512_cmplt_epu64_mask(v, t));
+
+        // Pivot j sits at lo + (j + 1) * step; keep (pivot c-1, pivot c]
+        size_t end = c < 8 ? lo + (c + 1) * step : lo + len;
+        if (c > 0) {
+            lo += c * step + 1;
+        }
+        len = end - lo;
+    }
+    return lo + avx512_linear_lower_bound(data + lo, len, target);
+}
+
+#endif // __x86_64__
+
+// Pick the widest implementation the running CPU supports
+static bss_lower_bound_fn select_simd(int linear) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return linear ? avx512_linear_lower_bound : avx512_lower_bound;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return linear ? avx2_linear_lower_bound : avx2_lower_bound;
+    }
+#endif
+    return linear ? scalar_linear_lower_bound : scalar_lower_bound;
+}
+
+// Lower bound kernel for the requested variant
+bss_lower_bound_fn lower_bound_kernel(bss_kernel_t kernel) {
+    switch (kernel) {
+        case BSS_KERNEL_SIMD:
+            return select_simd(0);
+        case BSS_KERNEL_BRANCHLESS:
+            return branchless_lower_bound;
+        case BSS_KERNEL_SCALAR:
+        default:
+            return scalar_lower_bound;
+    }
+}
+
+// Linear scan over a short range, vectorized when the CPU allows it
+size_t linear_lower_bound(const uint64_t *data, size_t n, uint64_t target) {
+    static bss_lower_bound_fn scan = NULL;
+    if (!scan) {
+        scan = select_simd(1);
+    }
+    return scan(data, n, target);
+}
+
+// Name of the instruction set the SIMD kernels run on
+const char *simd_kernel_isa(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return "AVX-512";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return "AVX2";
+    }
+#endif
+    return "scalar fallback";
+}
@@ -0,0 +1,445 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define MANIFEST_LINE 8192       // Longest manifest line
+
+typedef unsigned __int128 key128_t;
+
+// One segment file
+typedef struct {
+    char *path;
+    uint64_t min_key;            // Smallest and largest key, from the manifest or the file
+    uint64_t max_key;
+    int has_bounds;              // The manifest gave the key range
+    bss_handle_t *handle;
+} bss_segment;
+
+struct bss_segments {
+    bss_segment *segs;           // In manifest (or file name) order
+    size_t num_segments;
+    bss_options_t opts;
+    // Pruning: segments by ascending min_key, with the largest max_key of
+    // each prefix, so the segments whose range holds a key are found without
+    // looking at the ones that cannot
+    uint64_t *mins;
+    uint64_t *run_max;
+    size_t *order;               // Position in segs of the i-th segment by min_key
+    // State of the current lookup, shared with the pool
+    bss_pool_t *pool;            // Workers searching candidates (NULL with one thread or one segment)
+    uint64_t target;
+    size_t *candidates;          // Positions in segs of the segments to search
+    size_t num_candidates;
+    int *found;                  // Outcome and element index of each candidate
+    int64_t *indices;
+    atomic_size_t next_candidate;
+};
+
+// Add a segment at the end of the set. Returns 0 on success, -1 on error.
+static int add_segment(bss_segments_t *set, size_t *capacity, const char *path, int has_bounds,
+                       uint64_t min_key, uint64_t max_key) {
+    if (set->num_segments == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 16;
+        bss_segment *segs = (bss_segment *)realloc(set->segs, grown * sizeof(bss_segment));
+        if (!segs) {
+            perror("realloc");
+            return -1;
+        }
+        set->segs = segs;
+        *capacity = grown;
+    }
+
+    bss_segment *seg = &set->segs[set->num_segments];
+    memset(seg, 0, sizeof(*seg));
+    seg->path = strdup(path);
+    if (!seg->path) {
+        perror("strdup");
+        return -1;
+    }
+    seg->min_key = min_key;
+    seg->max_key = max_key;
+    seg->has_bounds = has_bounds;
+    set->num_segments++;
+    return 0;
+}
+
+// Whether a directory entry is a sidecar or temporary file rather than a segment
+static int is_sidecar(const char *name) {
+    static const char *const suffixes[] = {".idx", ".pla", ".tmp"};
+    size_t len = strlen(name);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        size_t n = strlen(suffixes[i]);
+        if (len > n && strcmp(name + len - n, suffixes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Every regular file of the directory, by name, except hidden files and
+// the index and model sidecars. Returns 0 on success, -1 on error.
+static int list_directory(bss_segments_t *set, const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        perror("opendir");
+        return -1;
+    }
+
+    char **names = NULL;
+    size_t num_names = 0, capacity = 0;
+    int ret = -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || is_sidecar(entry->d_name)) {
+            continue;
+        }
+        if (num_names == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char **grown = (char **)realloc(names, capacity * sizeof(char *));
+            if (!grown) {
+                perror("realloc");
+                goto out;
+            }
+            names = grown;
+        }
+        names[num_names] = strdup(entry->d_name);
+        if (!names[num_names]) {
+            perror("strdup");
+            goto out;
+        }
+        num_names++;
+    }
+    qsort(names, num_names, sizeof(char *), compare_names);
+
+    size_t seg_capacity = 0;
+    for (size_t i = 0; i < num_names; i++) {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (add_segment(set, &seg_capacity, path, 0, 0, 0) < 0) {
+            goto out;
+        }
+    }
+    ret = 0;
+
+out:
+    closedir(dir);
+    for (size_t i = 0; i < num_names; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return ret;
+}
+
+// Read a manifest: one segment per line, "<path> [<min_key> <max_key>]",
+// blank lines and # comments ignored. Relative paths are relative to the
+// manifest's directory. Returns 0 on success, -1 on error.
+static int read_manifest(bss_segments_t *set, const char *manifest_path) {
+    FILE *file = fopen(manifest_path, "r");
+    if (!file) {
+        perror("fopen");
+        return -1;
+    }
+
+    char base[4096];
+    const char *slash = strrchr(manifest_path, '/');
+    size_t base_len = slash ? (size_t)(slash - manifest_path) + 1 : 0;
+    snprintf(base, sizeof(base), "%.*s", (int)base_len, manifest_path);
+
+    char line[MANIFEST_LINE];
+    char name[4096];
+    size_t capacity = 0;
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        unsigned long long min_key, max_key;
+        char extra;
+        int fields = sscanf(line, "%4095s %llu %llu %c", name, &min_key, &max_key, &extra);
+        if (fields < 1) {
+            continue;
+        }
+        if ((fields != 1 && fields != 3) || (fields == 3 && min_key > max_key)) {
+            fprintf(stderr, "%s:%d: expected <path> [<min_key> <max_key>] with min_key <= max_key\n",
+                    manifest_path, line_no);
+            fclose(file);
+            return -1;
+        }
+
+        char path[8192];
+        snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : base, name);
+        if (add_segment(set, &capacity, path, fields == 3, min_key, max_key) < 0) {
+            fclose(file);
+            return -1;
+        }
+    }
+    if (ferror(file)) {
+        perror("fgets");
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Key at byte offset of the file, clamped to the uint64_t targets of the
+// lookups. Returns 0 on success, -1 on error.
+static int read_key(int fd, off_t offset, size_t key_size, uint64_t *key) {
+    key128_t wide = 0;
+    if (pread(fd, &wide, key_size, offset) != (ssize_t)key_size) {
+        perror("pread");
+        return -1;
+    }
+    *key = wide > UINT64_MAX ? UINT64_MAX : (uint64_t)wide;   // Little-endian: the low bytes come first
+    return 0;
+}
+
+// Key range of a segment without manifest bounds: its first and last key
+// (sorted layouts only). Returns 0 on success, -1 on error.
+static int read_bounds(bss_segment *seg) {
+    const bss_options_t *opts = &seg->handle->opts;
+    if (opts->engine == BSS_ENGINE_EYTZINGER || opts->engine == BSS_ENGINE_COMPRESSED) {
+        fprintf(stderr, "%s: Eytzinger and compressed segments need their key range in the manifest\n", seg->path);
+        return -1;
+    }
+
+    size_t num_elements = bss_num_elements(seg->handle);
+    int fd = open(seg->path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    int ret = read_key(fd, 0, opts->key_size, &seg->min_key);
+    if (ret == 0) {
+        ret = read_key(fd, (off_t)(num_elements - 1) * opts->record_size, opts->key_size, &seg->max_key);
+    }
+    close(fd);
+    return ret;
+}
+
+// Segment by its smallest key, for sorting
+typedef struct {
+    uint64_t min_key;
+    size_t pos;
+} segment_start;
+
+static int compare_starts(const void *a, const void *b) {
+    const segment_start *x = (const segment_start *)a, *y = (const segment_start *)b;
+    if (x->min_key != y->min_key) {
+        return x->min_key < y->min_key ? -1 : 1;
+    }
+    return x->pos < y->pos ? -1 : 1;   // Manifest order among equal minima
+}
+
+// Sort the segments by min_key and take the running maximum of max_key.
+// Returns 0 on success, -1 on error.
+static int build_pruning(bss_segments_t *set) {
+    size_t n = set->num_segments;
+    set->mins = (uint64_t *)malloc(n * sizeof(uint64_t));
+    set->run_max = (uint64_t *)malloc(n * sizeof(uint64_t));
+    set->order = (size_t *)malloc(n * sizeof(size_t));
+    set->candidates = (size_t *)malloc(n * sizeof(size_t));
+    set->found = (int *)malloc(n * sizeof(int));
+    set->indices = (int64_t *)malloc(n * sizeof(int64_t));
+    if (!set->mins || !set->run_max || !set->order || !set->candidates || !set->found || !set->indices) {
+        perror("malloc");
+        return -1;
+    }
+
+    segment_start *starts = (segment_start *)malloc(n * sizeof(segment_start));
+    if (!starts) {
+        perror("malloc");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        starts[i].min_key = set->segs[i].min_key;
+        starts[i].pos = i;
+    }
+    qsort(starts, n, sizeof(segment_start), compare_starts);
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t max_key = set->segs[starts[i].pos].max_key;
+        set->order[i] = starts[i].pos;
+        set->mins[i] = starts[i].min_key;
+        set->run_max[i] = i && set->run_max[i - 1] > max_key ? set->run_max[i - 1] : max_key;
+    }
+    free(starts);
+    return 0;
+}
+
+// Open every segment of a directory (all regular files, by name) or of a
+// manifest file with one handle each, opened with opts. Segment ranges not
+// given by the manifest are read from the first and last key of the file.
+// With several segments and opts->num_threads above 1, a pool of up to
+// that many threads searches the candidates of a lookup side by side (the
+// parallel engines' own workers come on top, per segment).
+bss_segments_t *bss_segments_open(const char *path, const bss_options_t *opts) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror("stat");
+        return NULL;
+    }
+
+    bss_segments_t *set = (bss_segments_t *)calloc(1, sizeof(bss_segments_t));
+    if (!set) {
+        perror("calloc");
+        return NULL;
+    }
+    set->opts = *opts;
+
+    if ((S_ISDIR(st.st_mode) ? list_directory(set, path) : read_manifest(set, path)) < 0) {
+        goto fail;
+    }
+    if (set->num_segments == 0) {
+        fprintf(stderr, "%s: no segment files\n", path);
+        goto fail;
+    }
+
+    for (size_t i = 0; i < set->num_segments; i++) {
+        bss_segment *seg = &set->segs[i];
+        seg->handle = bss_open(seg->path, opts);
+        if (!seg->handle) {
+            fprintf(stderr, "Cannot open segment %s\n", seg->path);
+            goto fail;
+        }
+        if (!seg->has_bounds && read_bounds(seg) < 0) {
+            goto fail;
+        }
+    }
+    if (build_pruning(set) < 0) {
+        goto fail;
+    }
+
+    int num_threads = opts->num_threads < (int)set->num_segments ? opts->num_threads : (int)set->num_segments;
+    if (num_threads > 1) {
+        set->pool = bss_pool_create(num_threads, opts->pin_threads);
+        if (!set->pool) {
+            goto fail;
+        }
+    }
+
+    bss_log(BSS_VERBOSITY_NORMAL, "Opened %zu segments from %s\n", set->num_segments, path);
+    return set;
+
+fail:
+    bss_segments_close(set);
+    return NULL;
+}
+
+// Pool job: search candidates until none are left
+static void segments_worker(void *arg, int worker_id) {
+    bss_segments_t *set = (bss_segments_t *)arg;
+    (void)worker_id;
+    for (;;) {
+        size_t c = atomic_fetch_add_explicit(&set->next_candidate, 1, memory_order_relaxed);
+        if (c >= set->num_candidates) {
+            return;
+        }
+        // No two workers share a candidate, so every handle has one user at a time
+        set->found[c] = bss_find(set->segs[set->candidates[c]].handle, set->target, &set->indices[c]);
+    }
+}
+
+// Look up target in every segment whose key range holds it. Only those are
+// searched: the ones with min_key <= target come from a binary search over
+// the sorted minima, and the walk down from there stops where the running
+// maximum drops below target. When the key is in several segments, the one
+// first in the manifest wins. Returns 1 if found (storing the segment's
+// position in the manifest in *segment and the element index in *index),
+// 0 if not found, -1 on error.
+int bss_segments_find(bss_segments_t *set, uint64_t target, int *segment, int64_t *index) {
+    size_t lo = 0, hi = set->num_segments;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (set->mins[mid] <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    set->num_candidates = 0;
+    for (size_t i = lo; i-- > 0 && set->run_max[i] >= target;) {
+        if (set->segs[set->order[i]].max_key >= target) {
+            set->candidates[set->num_candidates++] = set->order[i];
+        }
+    }
+    set->target = target;
+
+    if (set->num_candidates > 1 && set->pool) {
+        atomic_store(&set->next_candidate, 0);
+        bss_pool_run(set->pool, segments_worker, set);
+    } else {
+        for (size_t c = 0; c < set->num_candidates; c++) {
+            set->found[c] = bss_find(set->segs[set->candidates[c]].handle, target, &set->indices[c]);
+        }
+    }
+
+    int ret = 0;
+    size_t best = 0;
+    for (size_t c = 0; c < set->num_candidates; c++) {
+        if (set->found[c] < 0) {
+            return -1;
+        }
+        if (set->found[c] && (!ret || set->candidates[c] < set->candidates[best])) {
+            ret = 1;
+            best = c;
+        }
+    }
+    if (ret) {
+        *segment = (int)set->candidates[best];
+        *index = set->indices[best];
+    }
+    return ret;
+}
+
+size_t bss_segments_count(const bss_segments_t *set) {
+    return set->num_segments;
+}
+
+// Path and handle of the segment at position i of the manifest
+const char *bss_segments_path(const bss_segments_t *set, size_t i) {
+    return set->segs[i].path;
+}
+
+bss_handle_t *bss_segments_handle(const bss_segments_t *set, size_t i) {
+    return set->segs[i].handle;
+}
+
+void bss_segments_close(bss_segments_t *set) {
+    if (!set) {
+        return;
+    }
+    bss_pool_destroy(set->pool);
+    for (size_t i = 0; i < set->num_segments; i++) {
+        bss_close(set->segs[i].handle);
+        free(set->segs[i].path);
+    }
+    free(set->segs);
+    free(set->mins);
+    free(set->run_max);
+    free(set->order);
+    free(set->candidates);
+    free(set->found);
+    free(set->indices);
+    free(set);
+}
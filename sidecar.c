@@ -0,0 +1,61 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Open the sidecar if it exists and is not older than the data file, and
+// read its header_size byte header. Returns the descriptor, or -1 when the
+// sidecar is missing, stale or short (the caller then rebuilds).
+int sidecar_open(const char *sidecar, const struct stat *data_st, void *header, size_t header_size) {
+    struct stat st;
+
+    int fd = open(sidecar, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_mtime < data_st->st_mtime ||
+        pread(fd, header, header_size, 0) != (ssize_t)header_size) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read the bytes after the header of a sidecar from sidecar_open() and
+// close it. Returns 0 on success, -1 if the sidecar is short.
+int sidecar_read(int fd, size_t header_size, void *payload, size_t bytes) {
+    ssize_t got = pread(fd, payload, bytes, header_size);
+    close(fd);
+    return got == (ssize_t)bytes ? 0 : -1;
+}
+
+// Write the header and payload to a temporary file, then rename it over the
+// sidecar, so readers never see a partial one. Returns 0 on success, -1 on
+// error.
+int sidecar_store(const char *sidecar, const void *header, size_t header_size, const void *payload,
+                  size_t bytes) {
+    char tmp_path[BSS_SIDECAR_PATH + sizeof(".tmp")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", sidecar);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("fopen");
+        return -1;
+    }
+
+    if (fwrite(header, header_size, 1, file) != 1 || (bytes && fwrite(payload, bytes, 1, file) != 1)) {
+        perror("fwrite");
+        fclose(file);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    if (fclose(file) != 0 || rename(tmp_path, sidecar) != 0) {
+        perror("rename");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC 0x3130584449535342ULL   // "BSSIDX01"
+#define INDEX_BUILD_CHUNK (1024 * 1024)     // Bytes read at once while sampling the data file
+
+// Header of the sidecar index file, followed by num_keys uint64_t keys
+typedef struct {
+    uint64_t magic;
+    uint64_t stride;
+    uint64_t num_elements;
+    uint64_t num_keys;
+} sparse_index_header;
+
+// Sample the first key of every stride elements by reading the file sequentially
+static int sparse_index_build(bss_sparse_index *index, int fd, size_t num_elements) {
+    size_t chunk_elems = INDEX_BUILD_CHUNK / sizeof(uint64_t);
+    if (chunk_elems < index->stride) {
+        chunk_elems = index->stride;
+    }
+    chunk_elems -= chunk_elems % index->stride;   // Every chunk starts on a block boundary
+
+    uint64_t *chunk = (uint64_t *)malloc(chunk_elems * sizeof(uint64_t));
+    if (!chunk) {
+        perror("malloc");
+        return -1;
+    }
+
+    size_t k = 0;
+    for (size_t pos = 0; pos < num_elements; pos += chunk_elems) {
+        size_t count = num_elements - pos < chunk_elems ? num_elements - pos : chunk_elems;
+        ssize_t bytes = pread(fd, chunk, count * sizeof(uint64_t), pos * sizeof(uint64_t));
+        if (bytes != (ssize_t)(count * sizeof(uint64_t))) {
+            perror("pread");
+            free(chunk);
+            return -1;
+        }
+        for (size_t i = 0; i < count; i += index->stride) {
+            index->keys[k++] = chunk[i];
+        }
+    }
+
+    free(chunk);
+    return 0;
+}
+
+// Load the sidecar index if it exists, matches the data file and is not older than it
+static int sparse_index_load(bss_sparse_index *index, const char *sidecar, const struct stat *data_st,
+                             size_t num_elements) {
+    sparse_index_header header;
+
+    int fd = sidecar_open(sidecar, data_st, &header, sizeof(header));
+    if (fd < 0) {
+        return -1;
+    }
+    if (header.magic != INDEX_MAGIC || header.stride != index->stride ||
+        header.num_elements != num_elements || header.num_keys != index->num_keys) {
+        close(fd);
+        return -1;
+    }
+    return sidecar_read(fd, sizeof(header), index->keys, index->num_keys * sizeof(uint64_t));
+}
+
+// Store the index next to the data file
+static int sparse_index_store(const bss_sparse_index *index, const char *sidecar, size_t num_elements) {
+    sparse_index_header header = { INDEX_MAGIC, index->stride, num_elements, index->num_keys };
+    return sidecar_store(sidecar, &header, sizeof(header), index->keys, index->num_keys * sizeof(uint64_t));
+}
+
+// Build (or load from the <filepath>.idx sidecar) a sparse index holding the
+// first key of every stride elements of the file. Lookups search the keys
+// with lower_bound, the handle's in-memory kernel.
+int sparse_index_open(bss_sparse_index *index, const char *filepath, int fd, size_t num_elements,
+                      size_t stride, int use_sidecar, bss_lower_bound_fn lower_bound) {
+    struct stat st;
+    char sidecar[BSS_SIDECAR_PATH];
+
+    if (stride == 0) {
+        fprintf(stderr, "Sparse index stride must be positive\n");
+        return -1;
+    }
+
+    index->stride = stride;
+    index->lower_bound = lower_bound;
+    index->num_keys = (num_elements + stride - 1) / stride;
+    index->keys = (uint64_t *)malloc(index->num_keys * sizeof(uint64_t));
+    if (!index->keys) {
+        perror("malloc");
+        return -1;
+    }
+
+    if (use_sidecar) {
+        snprintf(sidecar, sizeof(sidecar), "%s.idx", filepath);
+        if (fstat(fd, &st) == 0 && sparse_index_load(index, sidecar, &st, num_elements) == 0) {
+            bss_log(BSS_VERBOSITY_NORMAL, "Loaded sparse index with %zu entries from %s\n", index->num_keys, sidecar);
+            return 0;
+        }
+    }
+
+    if (sparse_index_build(index, fd, num_elements) < 0) {
+        sparse_index_free(index);
+        return -1;
+    }
+    bss_log(BSS_VERBOSITY_NORMAL, "Built sparse index with %zu entries (every %zu elements)\n",
+            index->num_keys, stride);
+
+    // A sidecar that cannot be written only costs a rebuild next time
+    if (use_sidecar && sparse_index_store(index, sidecar, num_elements) == 0) {
+        bss_log(BSS_VERBOSITY_NORMAL, "Saved sparse index to %s\n", sidecar);
+    }
+    return 0;
+}
+
+void sparse_index_free(bss_sparse_index *index) {
+    free(index->keys);
+    index->keys = NULL;
+    index->num_keys = 0;
+}
+
+// Block [*lo, *hi] of the last key that is <= target (or < target when
+// strict is set). Returns -1 if there is no such key.
+static int find_block(const bss_sparse_index *index, size_t num_elements, uint64_t target, int strict,
+                      size_t *lo, size_t *hi) {
+    // Number of keys < target (<= target unless strict)
+    size_t left;
+    if (strict) {
+        left = index->lower_bound(index->keys, index->num_keys, target);
+    } else {
+        left = target == UINT64_MAX ? index->num_keys : index->lower_bound(index->keys, index->num_keys, target + 1);
+    }
+    if (left == 0) {
+        return -1;
+    }
+
+    size_t block = left - 1;
+    *lo = block * index->stride;
+    *hi = *lo + index->stride - 1;
+    if (*hi >= num_elements) {
+        *hi = num_elements - 1;
+    }
+    return 0;
+}
+
+// Narrow a lookup to the one block that may hold target. Returns 0 (and sets
+// [*lo, *hi]) if such a block exists, -1 if target is smaller than every key.
+int sparse_index_lookup(const bss_sparse_index *index, size_t num_elements, uint64_t target,
+                        size_t *lo, size_t *hi) {
+    return find_block(index, num_elements, target, 0, lo, hi);
+}
+
+// Narrow a lower bound search to one block: the last one whose first key is
+// < target, so runs of target spanning blocks start inside it. The bound is
+// then in [*lo, *hi + 1]. Returns -1 if target is <= every key (bound 0).
+int sparse_index_lower_block(const bss_sparse_index *index, size_t num_elements, uint64_t target,
+                             size_t *lo, size_t *hi) {
+    return find_block(index, num_elements, target, 1, lo, hi);
+}
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include "bssearch_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define POOL_SPINS 4096   // Spin this many times before parking on the futex
+
+// Long-lived worker threads that run one job at a time on every worker
+struct bss_pool {
+    pthread_t *threads;
+    int num_threads;
+    int pin_threads;
+    bss_pool_fn fn;                         // Current job
+    void *arg;
+    _Alignas(64) atomic_uint generation;    // Bumped to publish a new job
+    atomic_int sleepers;                    // Workers parked on generation
+    _Alignas(64) atomic_int pending;        // Workers still running the current job
+    atomic_int signaled;                    // A worker answered the current job early
+    atomic_int completion;                  // Bumped on every finish/signal; the caller parks on it
+    atomic_int waiting;                     // Caller is parked on completion
+    atomic_int stop;
+};
+
+typedef struct {
+    bss_pool_t *pool;
+    int id;
+} pool_worker_t;
+
+// Sleep while the 32-bit word at addr still holds expected
+void bss_futex_wait(void *addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+// Wake up to count threads sleeping on addr
+void bss_futex_wake(void *addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Pin the calling worker to the id-th CPU this process may run on
+static void pin_to_cpu(int id) {
+    cpu_set_t allowed, target;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+
+    int count = CPU_COUNT(&allowed);
+    if (count == 0) {
+        return;
+    }
+    int nth = id % count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && nth-- == 0) {
+            CPU_ZERO(&target);
+            CPU_SET(cpu, &target);
+            pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+            return;
+        }
+    }
+}
+
+// Wake the caller if it is parked waiting for the current job
+static void notify_caller(bss_pool_t *pool) {
+    atomic_fetch_add(&pool->completion, 1);
+    if (atomic_load(&pool->waiting)) {
+        bss_futex_wake(&pool->completion, 1);
+    }
+}
+
+// Wait until every worker is done with the current job, or (if any is set)
+// until one of them signaled an early answer
+static void pool_wait(bss_pool_t *pool, int any) {
+    for (int spins = 0; ; spins++) {
+        int seen = atomic_load(&pool->completion);
+        if (atomic_load_explicit(&pool->pending, memory_order_acquire) == 0 ||
+            (any && atomic_load_explicit(&pool->signaled, memory_order_acquire))) {
+            return;
+        }
+        if (spins >= POOL_SPINS) {
+            atomic_store(&pool->waiting, 1);
+            bss_futex_wait(&pool->completion, seen);
+            atomic_store(&pool->waiting, 0);
+        }
+    }
+}
+
+static void *pool_worker(void *arg) {
+    pool_worker_t *worker = (pool_worker_t *)arg;
+    bss_pool_t *pool = worker->pool;
+    int id = worker->id;
+    free(worker);
+
+    if (pool->pin_threads) {
+        pin_to_cpu(id);
+    }
+
+    unsigned seen = 0;
+    for (;;) {
+        // Wait for the next job: spin briefly, then park
+        unsigned gen;
+        for (int spins = 0; (gen = atomic_load_explicit(&pool->generation, memory_order_acquire)) == seen; spins++) {
+            if (spins >= POOL_SPINS) {
+                atomic_fetch_add(&pool->sleepers, 1);
+                bss_futex_wait(&pool->generation, (int)seen);
+                atomic_fetch_sub(&pool->sleepers, 1);
+                spins = 0;
+            }
+        }
+        seen = gen;
+
+        if (atomic_load(&pool->stop)) {
+            break;
+        }
+
+        pool->fn(pool->arg, id);
+
+        // Let the caller re-check whether the job is over
+        atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel);
+        notify_caller(pool);
+    }
+
+    return NULL;
+}
+
+// Start num_threads workers, optionally pinning each to its own CPU
+bss_pool_t *bss_pool_create(int num_threads, int pin_threads) {
+    bss_pool_t *pool = (bss_pool_t *)calloc(1, sizeof(bss_pool_t));
+    if (!pool) {
+        perror("calloc");
+        return NULL;
+    }
+    pool->pin_threads = pin_threads;
+    pool->threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if (!pool->threads) {
+        perror("malloc");
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        pool_worker_t *worker = (pool_worker_t *)malloc(sizeof(pool_worker_t));
+        if (!worker) {
+            perror("malloc");
+            break;
+        }
+        worker->pool = pool;
+        worker->id = i;
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, worker) != 0) {
+            perror("pthread_create");
+            free(worker);
+            break;
+        }
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        bss_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Number of workers actually running
+int bss_pool_size(const bss_pool_t *pool) {
+    return pool->num_threads;
+}
+
+// Publish a job to every worker
+static void pool_start(bss_pool_t *pool, bss_pool_fn fn, void *arg) {
+    // Stragglers of a job that was answered early may still be running
+    pool_wait(pool, 0);
+
+    pool->fn = fn;
+    pool->arg = arg;
+    atomic_store_explicit(&pool->signaled, 0, memory_order_relaxed);
+    atomic_store_explicit(&pool->pending, pool->num_threads, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_seq_cst);
+    if (atomic_load(&pool->sleepers) > 0) {
+        bss_futex_wake(&pool->generation, INT_MAX);
+    }
+}
+
+// Run fn(arg, worker_id) on every worker and wait until all of them return
+void bss_pool_run(bss_pool_t *pool, bss_pool_fn fn, void *arg) {
+    pool_start(pool, fn, arg);
+    pool_wait(pool, 0);
+}
+
+// Run fn(arg, worker_id) on every worker and return as soon as one of them
+// calls bss_pool_signal() or all of them return. Workers still running keep
+// the job's data in use; the next job on this pool waits for them first.
+void bss_pool_run_any(bss_pool_t *pool, bss_pool_fn fn, void *arg) {
+    pool_start(pool, fn, arg);
+    pool_wait(pool, 1);
+}
+
+// Called by a worker that has the answer of a bss_pool_run_any() job
+void bss_pool_signal(bss_pool_t *pool) {
+    atomic_store_explicit(&pool->signaled, 1, memory_order_release);
+    notify_caller(pool);
+}
+
+// Wait for every worker to finish the current job
+void bss_pool_quiesce(bss_pool_t *pool) {
+    pool_wait(pool, 0);
+}
+
+// Stop and join all workers
+void bss_pool_destroy(bss_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    atomic_store(&pool->stop, 1);
+    atomic_fetch_add(&pool->generation, 1);
+    bss_futex_wake(&pool->generation, INT_MAX);
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    free(pool);
+}